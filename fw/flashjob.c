@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) 2022-2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "flashjob.h"
+
+#include "flashrom.h"
+#include "pico/stdlib.h"
+#include "romfs/romfs.h"
+
+//
+// Erase and program jobs for the flash in SPI mode. The USB handler queues
+// them and goes on, a timer interrupt on core0 issues the commands and polls
+// the status register. Both run at the same interrupt priority as the save
+// flush, so the flash is never driven from two places at a time.
+// Every page is read back once the chip is done with it, a mismatch is
+// latched until flash_jobs_error() reports it.
+//
+#define FLASH_JOB_POLL_US 250
+#define FLASH_BLOCK_SIZE (ROMFS_FLASH_SECTOR * 16)
+#define FLASH_PAGE_SIZE 256
+
+enum {
+    FLASH_JOB_ERASE,
+    FLASH_JOB_BLOCK_ERASE,
+    FLASH_JOB_PROGRAM,
+    FLASH_JOB_COPY,
+};
+
+struct flash_job {
+    uint8_t type;
+    bool started;
+    uint32_t pos;
+    uint32_t addr;
+    uint32_t src;
+    uint8_t *buffer;
+};
+
+static struct flash_job jobs[FLASH_JOB_QUEUE];
+static int job_head;
+static volatile int job_count;
+static volatile bool job_error;
+
+static repeating_timer_t job_timer;
+
+static bool flash_job_tick(repeating_timer_t *rt)
+{
+    (void)rt;
+    flash_jobs_poll();
+
+    return true;
+}
+
+void flash_jobs_init(void)
+{
+    add_repeating_timer_us(-FLASH_JOB_POLL_US, flash_job_tick, NULL, &job_timer);
+}
+
+static bool flash_job_add(uint8_t type, uint32_t addr, uint32_t src, uint8_t *buffer)
+{
+    if (job_count == FLASH_JOB_QUEUE) {
+        return false;
+    }
+
+    struct flash_job *job = &jobs[(job_head + job_count) % FLASH_JOB_QUEUE];
+    job->type = type;
+    job->started = false;
+    job->pos = 0;
+    job->addr = addr;
+    job->src = src;
+    job->buffer = buffer;
+    job_count++;
+
+    flash_jobs_poll();
+
+    return true;
+}
+
+bool flash_job_erase(uint32_t addr)
+{
+    return flash_job_add(FLASH_JOB_ERASE, addr, 0, NULL);
+}
+
+bool flash_job_block_erase(uint32_t addr)
+{
+    return flash_job_add(FLASH_JOB_BLOCK_ERASE, addr, 0, NULL);
+}
+
+bool flash_job_program(uint32_t addr, uint8_t *buffer)
+{
+    return flash_job_add(FLASH_JOB_PROGRAM, addr, 0, buffer);
+}
+
+bool flash_job_copy(uint32_t addr, uint32_t src)
+{
+    if (job_count > FLASH_JOB_QUEUE - 2) {
+        return false;
+    }
+
+    flash_job_add(FLASH_JOB_ERASE, addr, 0, NULL);
+
+    return flash_job_add(FLASH_JOB_COPY, addr, src, NULL);
+}
+
+// compare a finished page with what it should hold, NULL for erased
+static void flash_job_verify(uint32_t addr, const uint8_t *expect)
+{
+    static uint8_t page[FLASH_PAGE_SIZE];
+
+    flash_read(addr, page, FLASH_PAGE_SIZE);
+    for (int i = 0; i < FLASH_PAGE_SIZE; i++) {
+        if (page[i] != (expect ? expect[i] : 0xff)) {
+            job_error = true;
+            return;
+        }
+    }
+}
+
+bool flash_job_uses_buffer(const uint8_t *buffer)
+{
+    for (int i = 0; i < job_count; i++) {
+        if (jobs[(job_head + i) % FLASH_JOB_QUEUE].buffer == buffer) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool flash_jobs_poll(void)
+{
+    while (job_count) {
+        struct flash_job *job = &jobs[job_head];
+
+        if (job->started && flash_busy()) {
+            return false;
+        }
+
+        if (job->type == FLASH_JOB_PROGRAM || job->type == FLASH_JOB_COPY) {
+            static uint8_t copy_page[FLASH_PAGE_SIZE];
+            if (job->started) {
+                uint32_t last = job->pos - FLASH_PAGE_SIZE;
+                flash_job_verify(job->addr + last, (job->type == FLASH_JOB_COPY) ? copy_page : &job->buffer[last]);
+            }
+            if (job->pos < ROMFS_FLASH_SECTOR) {
+                uint8_t *page = copy_page;
+                if (job->type == FLASH_JOB_COPY) {
+                    // the source is read when its turn comes, after every job queued before it
+                    flash_read(job->src + job->pos, copy_page, FLASH_PAGE_SIZE);
+                } else {
+                    page = &job->buffer[job->pos];
+                }
+                bool programming = flash_write_page_start(job->addr + job->pos, page);
+                job->pos += FLASH_PAGE_SIZE;
+                job->started = true;
+                if (programming) {
+                    return false;
+                }
+                continue;
+            }
+        } else if (!job->started) {
+            if (job->type == FLASH_JOB_BLOCK_ERASE) {
+                flash_erase_block_start(job->addr);
+            } else {
+                flash_erase_sector_start(job->addr);
+            }
+            job->started = true;
+            return false;
+        } else if (job->pos < ((job->type == FLASH_JOB_BLOCK_ERASE) ? FLASH_BLOCK_SIZE : ROMFS_FLASH_SECTOR)) {
+            // an erased block is checked a page per call, reading it at once would stall the interrupt
+            flash_job_verify(job->addr + job->pos, NULL);
+            job->pos += FLASH_PAGE_SIZE;
+            return false;
+        }
+
+        job_head = (job_head + 1) % FLASH_JOB_QUEUE;
+        job_count--;
+    }
+
+    return true;
+}
+
+bool flash_jobs_idle(void)
+{
+    return !job_count;
+}
+
+bool flash_jobs_error(void)
+{
+    bool error = job_error;
+
+    job_error = false;
+
+    return error;
+}
+
+void flash_jobs_finish(void)
+{
+    while (!flash_jobs_poll()) {
+    }
+}
+
+static bool flash_jobs_overlap(uint32_t addr, uint32_t len)
+{
+    for (int i = 0; i < job_count; i++) {
+        const struct flash_job *job = &jobs[(job_head + i) % FLASH_JOB_QUEUE];
+        uint32_t size = (job->type == FLASH_JOB_BLOCK_ERASE) ? FLASH_BLOCK_SIZE : ROMFS_FLASH_SECTOR;
+        if (addr < job->addr + size && job->addr < addr + len) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void flash_jobs_read(uint32_t addr, uint8_t *buffer, uint32_t len)
+{
+    while (flash_jobs_overlap(addr, len)) {
+        flash_jobs_poll();
+    }
+
+    if (job_count && jobs[job_head].started && flash_busy()) {
+        if ((jobs[job_head].type == FLASH_JOB_ERASE || jobs[job_head].type == FLASH_JOB_BLOCK_ERASE) && flash_erase_suspend()) {
+            flash_read(addr, buffer, len);
+            flash_erase_resume();
+            return;
+        }
+        // a page program is over in well under a millisecond
+        while (flash_busy()) {
+        }
+    }
+
+    flash_read(addr, buffer, len);
+}
@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) 2022-2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FLASH_JOB_QUEUE 16
+
+void flash_jobs_init(void);
+
+// Queue a 4K erase, a 64K erase or a 4K program, false when the queue is full.
+// A program buffer must stay untouched until flash_job_uses_buffer() says so.
+bool flash_job_erase(uint32_t addr);
+bool flash_job_block_erase(uint32_t addr);
+bool flash_job_program(uint32_t addr, uint8_t * buffer);
+
+// Queue the erase of addr and a program from the sector at src, false without room for both
+bool flash_job_copy(uint32_t addr, uint32_t src);
+
+bool flash_job_uses_buffer(const uint8_t * buffer);
+
+// Advances the queue without waiting, true once it is empty
+bool flash_jobs_poll(void);
+
+bool flash_jobs_idle(void);
+
+// True when a job read back different data since the last call, clears the flag
+bool flash_jobs_error(void);
+
+void flash_jobs_finish(void);
+
+// Read that sees every queued write to the range, suspends a running erase if it can
+void flash_jobs_read(uint32_t addr, uint8_t * buffer, uint32_t len);
@@ -11,21 +11,33 @@
 #include "hardware/resets.h"
 #include "hardware/structs/ioqspi.h"
 #include "hardware/structs/pads_qspi.h"
+#include "hardware/sync.h"
 
 #if defined(DISABLE_FLASH_ADDR_32) && (DISABLE_FLASH_ADDR_32 == 1)
 #define ADDR_L (8u)
 #define SECTOR_ERASE (0x20)
+#define BLOCK_ERASE (0xd8)
 #define SECTOR_WRITE (0x02)
+#define QUAD_WRITE (0x32)
+#define QUAD_IO_WRITE (0x38)
+#define QUAD_WRITE_ADDR_L (6u)
 #define BYTE_READ (0x0b)
 #define CMD_ADDR_LEN (4)
 #else
 #define ADDR_L (10u)
 #define SECTOR_ERASE (0x21)
+#define BLOCK_ERASE (0xdc)
 #define SECTOR_WRITE (0x12)
+#define QUAD_WRITE (0x34)
+#define QUAD_IO_WRITE (0x3e)
+#define QUAD_WRITE_ADDR_L (8u)
 #define BYTE_READ (0x0c)
 #define CMD_ADDR_LEN (5)
 #endif
 
+static uint8_t quad_program;
+static uint8_t erase_suspend;
+
 static inline void xflash_put_get(const uint8_t * tx, uint8_t * rx, size_t count, size_t rx_skip)
 {
     const uint max_in_flight = 16 - 2; // account for data internal to SSI
@@ -90,12 +102,19 @@ void flash_config(void)
     xflash_do_cmd(0x11, &sr3, NULL, 1);
 }
 
-static void xflash_wait_ready(void)
+bool flash_busy(void)
 {
     uint8_t stat;
-    do {
-        xflash_do_cmd(0x05, NULL, &stat, 1);
-    } while (stat & 0x1);
+
+    xflash_do_cmd(0x05, NULL, &stat, 1);
+
+    return stat & 0x1;
+}
+
+static void xflash_wait_ready(void)
+{
+    while (flash_busy()) {
+    }
 }
 
 static inline void xflash_put_cmd_addr(uint8_t cmd, uint32_t addr)
@@ -113,32 +132,145 @@ static inline void xflash_put_cmd_addr(uint8_t cmd, uint32_t addr)
     }
 }
 
-bool flash_erase_sector(uint32_t addr)
+static void xflash_erase_start(uint8_t cmd, uint32_t addr)
 {
     xflash_do_cmd(0x06, NULL, NULL, 0);
 
-    xflash_put_cmd_addr(SECTOR_ERASE, addr);
+    xflash_put_cmd_addr(cmd, addr);
     xflash_put_get(NULL, NULL, 0, CMD_ADDR_LEN);
+}
+
+void flash_erase_sector_start(uint32_t addr)
+{
+    xflash_erase_start(SECTOR_ERASE, addr);
+}
+
+void flash_erase_block_start(uint32_t addr)
+{
+    xflash_erase_start(BLOCK_ERASE, addr);
+}
+
+bool flash_erase_sector(uint32_t addr)
+{
+    flash_erase_sector_start(addr);
 
     xflash_wait_ready();
 
     return true;
 }
 
-bool flash_write_sector(uint32_t addr, uint8_t * buffer)
+void flash_set_erase_suspend(uint8_t type)
 {
-    for (int i = 0; i < 4096; i += 256) {
-        xflash_do_cmd(0x06, NULL, NULL, 0);
+    erase_suspend = type;
+}
+
+bool flash_erase_suspend(void)
+{
+    if (erase_suspend == FLASH_SUSPEND_NONE) {
+        return false;
+    }
+
+    xflash_do_cmd((erase_suspend == FLASH_SUSPEND_MX) ? 0xb0 : 0x75, NULL, NULL, 0);
+    xflash_wait_ready();
 
-        xflash_put_cmd_addr(SECTOR_WRITE, addr + i);
-        xflash_put_get(&buffer[i], NULL, 256, CMD_ADDR_LEN);
+    return true;
+}
 
+void flash_erase_resume(void)
+{
+    xflash_do_cmd((erase_suspend == FLASH_SUSPEND_MX) ? 0x30 : 0x7a, NULL, NULL, 0);
+}
+
+void flash_set_quad_program(uint8_t type)
+{
+    quad_program = type;
+}
+
+//
+// Quad page program with the SSI in TX-only enhanced mode. Data goes out
+// as 32-bit frames, the FIFO must not run dry or the SSI would start a new
+// instruction phase under the forced chip select.
+//
+static void xflash_quad_write_page(uint32_t addr, uint8_t * buffer)
+{
+    uint32_t irq = save_and_disable_interrupts();
+
+    ssi_hw->ssienr = 0;
+    ssi_hw->ctrlr0 = (SSI_CTRLR0_SPI_FRF_VALUE_QUAD << SSI_CTRLR0_SPI_FRF_LSB) |
+            (31 << SSI_CTRLR0_DFS_32_LSB) |
+            (SSI_CTRLR0_TMOD_VALUE_TX_ONLY << SSI_CTRLR0_TMOD_LSB);
+    ssi_hw->spi_ctrlr0 = (QUAD_WRITE_ADDR_L << SSI_SPI_CTRLR0_ADDR_L_LSB) |
+            (SSI_SPI_CTRLR0_INST_L_VALUE_8B << SSI_SPI_CTRLR0_INST_L_LSB) |
+            ((quad_program == FLASH_QUAD_PP_ADDR_DATA ? SSI_SPI_CTRLR0_TRANS_TYPE_VALUE_1C2A : SSI_SPI_CTRLR0_TRANS_TYPE_VALUE_1C1A)
+             << SSI_SPI_CTRLR0_TRANS_TYPE_LSB);
+    ssi_hw->ssienr = 1;
+
+    flash_cs_force(0);
+    ssi_hw->dr0 = (quad_program == FLASH_QUAD_PP_ADDR_DATA) ? QUAD_IO_WRITE : QUAD_WRITE;
+    ssi_hw->dr0 = addr;
+    for (int i = 0; i < 256; i += 4) {
+        while (!(ssi_hw->sr & SSI_SR_TFNF_BITS)) {
+        }
+        ssi_hw->dr0 = (buffer[i] << 24) | (buffer[i + 1] << 16) | (buffer[i + 2] << 8) | buffer[i + 3];
+    }
+    while (!(ssi_hw->sr & SSI_SR_TFE_BITS) || (ssi_hw->sr & SSI_SR_BUSY_BITS)) {
+    }
+    flash_cs_force(1);
+
+    flash_spi_mode();
+
+    restore_interrupts(irq);
+}
+
+static uint32_t blank_pages;
+
+bool flash_write_page_start(uint32_t addr, uint8_t * buffer)
+{
+    int i;
+
+    for (i = 0; i < 256 && buffer[i] == 0xff; i++) {
+    }
+    if (i == 256) {
+        blank_pages++;
+        return false;
+    }
+
+    xflash_do_cmd(0x06, NULL, NULL, 0);
+
+    if (quad_program != FLASH_QUAD_PP_NONE) {
+        xflash_quad_write_page(addr, buffer);
+        return true;
+    }
+
+    xflash_put_cmd_addr(SECTOR_WRITE, addr);
+    xflash_put_get(buffer, NULL, 256, CMD_ADDR_LEN);
+
+    return true;
+}
+
+uint32_t flash_blank_pages(void)
+{
+    return blank_pages;
+}
+
+bool flash_write_page(uint32_t addr, uint8_t * buffer)
+{
+    if (flash_write_page_start(addr, buffer)) {
         xflash_wait_ready();
     }
 
     return true;
 }
 
+bool flash_write_sector(uint32_t addr, uint8_t * buffer)
+{
+    for (int i = 0; i < 4096; i += 256) {
+        flash_write_page(addr + i, &buffer[i]);
+    }
+
+    return true;
+}
+
 bool flash_read(uint32_t addr, uint8_t * buffer, uint32_t len)
 {
     xflash_put_cmd_addr(BYTE_READ, addr);
@@ -26,10 +26,44 @@ void flash_spi_mode(void);
 
 void flash_config(void);
 
+// Quad page program variants, see flash_chip in main.c
+#define FLASH_QUAD_PP_NONE      0
+#define FLASH_QUAD_PP_DATA      1       // 0x32/0x34, data on four lines
+#define FLASH_QUAD_PP_ADDR_DATA 2       // 0x38/0x3e, address and data on four lines
+
+void flash_set_quad_program(uint8_t type);
+
+// Erase suspend/resume commands, see flash_chip in main.c
+#define FLASH_SUSPEND_NONE      0
+#define FLASH_SUSPEND_WB        1       // 0x75/0x7a
+#define FLASH_SUSPEND_MX        2       // 0xb0/0x30
+
+void flash_set_erase_suspend(uint8_t type);
+
 bool flash_erase_sector(uint32_t addr);
 
+// Sector (4K) and block (64K) erase without waiting, poll flash_busy()
+void flash_erase_sector_start(uint32_t addr);
+
+void flash_erase_block_start(uint32_t addr);
+
+// Parks a running erase so the array can be read, false if the chip can't
+bool flash_erase_suspend(void);
+
+void flash_erase_resume(void);
+
+bool flash_busy(void);
+
 bool flash_write_sector(uint32_t addr, uint8_t * buffer);
 
+bool flash_write_page(uint32_t addr, uint8_t * buffer);
+
+// Page program without waiting, poll flash_busy() before the next command.
+// A page of 0xff is already there after the erase, false when it was skipped.
+bool flash_write_page_start(uint32_t addr, uint8_t * buffer);
+
+uint32_t flash_blank_pages(void);
+
 bool flash_read(uint32_t addr, uint8_t * buffer, uint32_t len);
 
 uint8_t flash_read8(uint32_t addr);
@@ -64,6 +98,42 @@ uint16_t inline flash_quad_read16(uint32_t addr)
     return ssi_hw->dr0;
 }
 
+// SSI RX FIFO depth, the longest burst that can't overrun while the PI drains it
+#define FLASH_QUAD_BURST_MAX 16
+
+//
+// Burst read: one address phase, then up to FLASH_QUAD_BURST_MAX halfwords
+// streamed by the SSI. CTRLR1 is only writable with the SSI disabled, and
+// disabling it also drops whatever the PI did not consume.
+//
+static inline void flash_quad_burst_start(uint32_t addr, uint32_t count)
+{
+    ssi_hw->ssienr = 0;
+    ssi_hw->ctrlr1 = count - 1;
+    ssi_hw->ssienr = 1;
+
+#if defined(DISABLE_FLASH_ADDR_32) && (DISABLE_FLASH_ADDR_32 == 1)
+    ssi_hw->dr0 = (addr << 8) | MODE_CONTINUOS_READ;
+#else
+    ssi_hw->dr0 = addr;
+    ssi_hw->dr0 = MODE_CONTINUOS_READ;
+#endif
+}
+
+static inline uint16_t flash_quad_burst_read16(void)
+{
+    while (!(ssi_hw->sr & SSI_SR_RFNE_BITS)) {
+    }
+    return ssi_hw->dr0;
+}
+
+static inline void flash_quad_burst_stop(void)
+{
+    ssi_hw->ssienr = 0;
+    ssi_hw->ctrlr1 = 0;
+    ssi_hw->ssienr = 1;
+}
+
 void inline flash_quad_exit_cont_read_mode()
 {
 #if defined(DISABLE_FLASH_ADDR_32) && (DISABLE_FLASH_ADDR_32 == 1)
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "flashjob.h"
 #include "flashrom.h"
 #include "hardware/clocks.h"
 #include "hardware/flash.h"
@@ -16,6 +17,7 @@
 #include "hardware/structs/xip_ctrl.h"
 #include "n64.h"
 #include "n64_pi.h"
+#include "n64_save.h"
 #include "pico/multicore.h"
 #include "pico/stdio.h"
 #include "pico/stdlib.h"
@@ -28,13 +30,13 @@
 #endif
 
 static const struct flash_chip flash_chip[] = {
-{ 0xc2, 0x201b, 128, 364000, VREG_VOLTAGE_1_20, "MX66L1G45G" },
-{ 0xef, 0x4020, 64, 364000, VREG_VOLTAGE_1_20, "W25Q512" },
-{ 0xef, 0x4019, 32, 364000, VREG_VOLTAGE_1_20, "W25Q256" },
-{ 0xef, 0x4018, 16, 364000, VREG_VOLTAGE_1_20, "W25Q128" },
-{ 0xef, 0x4017, 8, 364000, VREG_VOLTAGE_1_20, "W25Q64" },
-{ 0xef, 0x4016, 4, 364000, VREG_VOLTAGE_1_20, "W25Q32" },
-{ 0xef, 0x4015, 2, 364000, VREG_VOLTAGE_1_20, "W25Q16" },
+{ 0xc2, 0x201b, 128, 364000, VREG_VOLTAGE_1_20, FLASH_QUAD_PP_ADDR_DATA, FLASH_SUSPEND_MX, "MX66L1G45G" },
+{ 0xef, 0x4020, 64, 364000, VREG_VOLTAGE_1_20, FLASH_QUAD_PP_DATA, FLASH_SUSPEND_WB, "W25Q512" },
+{ 0xef, 0x4019, 32, 364000, VREG_VOLTAGE_1_20, FLASH_QUAD_PP_DATA, FLASH_SUSPEND_WB, "W25Q256" },
+{ 0xef, 0x4018, 16, 364000, VREG_VOLTAGE_1_20, FLASH_QUAD_PP_DATA, FLASH_SUSPEND_WB, "W25Q128" },
+{ 0xef, 0x4017, 8, 364000, VREG_VOLTAGE_1_20, FLASH_QUAD_PP_DATA, FLASH_SUSPEND_WB, "W25Q64" },
+{ 0xef, 0x4016, 4, 364000, VREG_VOLTAGE_1_20, FLASH_QUAD_PP_DATA, FLASH_SUSPEND_WB, "W25Q32" },
+{ 0xef, 0x4015, 2, 364000, VREG_VOLTAGE_1_20, FLASH_QUAD_PP_DATA, FLASH_SUSPEND_WB, "W25Q16" },
 };
 
 static const struct flash_chip *used_flash_chip;
@@ -194,6 +196,12 @@ int main(void)
     flash_quad_exit_cont_read_mode();
     flash_spi_mode();
     flash_config();
+#if FLASH_QUAD_PP
+    flash_set_quad_program(used_flash_chip->quad_pp);
+#endif
+    flash_set_erase_suspend(used_flash_chip->suspend);
+    flash_jobs_init();
+    save_flush_init();
 
     uintptr_t fw_binary_end = (uintptr_t) & __flash_binary_end;
 
@@ -214,9 +222,22 @@ int main(void)
 
     romfs_file file;
     if (romfs_open_file("n64cart-manager.z64", &file, romfs_flash_buffer) == ROMFS_NOERR) {
-        romfs_read_map_table(pi_rom_lookup, 16384, &file);
+        uint16_t window[256];
+        uint32_t page = 0;
+        uint32_t count;
 
-        backup_rom_lookup();
+        pi_rom_map_reset();
+        do {
+            count = romfs_map_iter_next(&file, window, sizeof(window) / sizeof(window[0]));
+            pi_rom_map_append(page, window, count);
+            page += count;
+        } while (count == sizeof(window) / sizeof(window[0]));
+        pi_rom_map_end(page);
+
+        if (!backup_rom_lookup()) {
+            printf("n64cart-manager.z64 is too fragmented, NMI will not restore it\n");
+        }
+        load_rom_hot_pages();
     } else {
         printf("romfs error: %s\n", romfs_strerror(file.err));
         while (true) {
@@ -8,8 +8,32 @@
 
 #include <stdint.h>
 
+#ifndef PI_SRAM
 #define PI_SRAM 1
+#endif
+#ifndef PI_USBCTRL
 #define PI_USBCTRL  1
+#endif
+#ifndef PI_ROM_BURST
+#define PI_ROM_BURST 1
+#endif
+// PI bus counters, readable at 0x1fd01040 and with CART_PI_STATS over USB
+#ifndef PI_STATS
+#define PI_STATS 1
+#endif
+// Quiet time after the last save write before dirty save pages go back to flash, 0 disables
+#ifndef SAVE_FLUSH_MS
+#define SAVE_FLUSH_MS 1000
+#endif
+// Quad page program for chips that list it in flash_chip[], 0 keeps single SPI writes
+#ifndef FLASH_QUAD_PP
+#define FLASH_QUAD_PP 1
+#endif
+// ROM pages (4K, from offset 0) served from RAM, up to 16.
+// Must match N64CART_ROM_HOT_PAGES in rom/src/n64cart.h
+#ifndef PI_ROM_HOT_PAGES
+#define PI_ROM_HOT_PAGES 2
+#endif
 
 #define UART_ID     uart0
 
@@ -23,6 +47,8 @@ struct flash_chip {
     uint8_t rom_size;
     uint32_t sys_freq;
     uint8_t voltage;
+    uint8_t quad_pp;
+    uint8_t suspend;
     const char *name;
 };
 
@@ -30,7 +56,6 @@ extern uint16_t sys64_ctrl_reg;
 extern uint16_t usb64_ctrl_reg;
 
 extern uint8_t pi_sram[];
-extern uint16_t *pi_rom_lookup;
 extern uint8_t *si_eeprom;
 
 extern char __flash_binary_end;
@@ -12,6 +12,7 @@
 #include "hardware/structs/ssi.h"
 #include "main.h"
 #include "n64.h"
+#include "n64_pi.h"
 #include "n64_pi.pio.h"
 #include "pico/multicore.h"
 #include "pico/stdio.h"
@@ -37,21 +38,186 @@ uint16_t sys64_ctrl_reg = 0x11;
 //
 uint16_t usb64_ctrl_reg = 0x0000;
 
-uint8_t pi_sram[SRAM_1MBIT_SIZE + ROMFS_FLASH_SECTOR * 4 * 2 * 2 + 2048 + 512];
-uint16_t *pi_rom_lookup = (uint16_t *) & pi_sram[SRAM_1MBIT_SIZE];
+volatile struct pi_stats pi_stats;
+
+volatile uint8_t pi_save_dirty[PI_SAVE_PAGES];
+volatile uint32_t pi_save_writes;
+volatile uint32_t pi_txn_count;
+
+uint32_t pi_fw_caps = PI_FW_CAPS_ROM_EXTENTS;
+
+void pi_stats_reset(void)
+{
+    pi_stats.rom_words = 0;
+    pi_stats.sram_accesses = 0;
+    pi_stats.fram_accesses = 0;
+    pi_stats.unknown_hits = 0;
+    pi_stats.max_wait = 0;
+}
+
+#define PI_ROM_HOT_OFFSET (SRAM_1MBIT_SIZE + ROMFS_FLASH_SECTOR * 4 * 2 * 2 + 2048 + 512)
+
+uint8_t pi_sram[PI_ROM_HOT_OFFSET + PI_ROM_HOT_PAGES * ROMFS_FLASH_SECTOR + 4];
 uint8_t *si_eeprom = &pi_sram[SRAM_1MBIT_SIZE + ROMFS_FLASH_SECTOR * 4 * 2 * 2];
 
 static uint16_t *sram_16 = (uint16_t *) pi_sram;
-static const uint16_t *rom_lookup = (uint16_t *) & pi_sram[SRAM_1MBIT_SIZE];
 
-void backup_rom_lookup(void)
+//
+// ROM map, written by the menu as 32-bit words: the extent count, then
+// (first ROM page << 16 | first flash sector) for each run of consecutive
+// sectors, sorted by page. An extent ends where the next one starts. The
+// last entry has PI_ROM_MAP_END for a sector and marks the end of the file,
+// pages past it read flash sector 0 like the old zeroed lookup table did.
+//
+static volatile uint16_t *rom_map = (uint16_t *) & pi_sram[SRAM_1MBIT_SIZE];
+
+#define rom_map_count rom_map[1]
+#define rom_ext_page(i) rom_map[2 + ((i) << 1)]
+#define rom_ext_sector(i) rom_map[3 + ((i) << 1)]
+
+static uint32_t rom_ext;
+
+static inline uint32_t rom_ext_end(uint32_t ext, uint32_t count)
+{
+    return (ext + 1 < count) ? rom_ext_page(ext + 1) : PI_ROM_PAGES;
+}
+
+//
+// Flash sector holding a ROM page and the number of pages left in its extent.
+// The last extent used and the one after it are tried first, so sequential
+// reads of a contiguous file never search.
+//
+static uint32_t rom_map_page(uint32_t page, uint32_t *pages_left)
+{
+    uint32_t count = rom_map_count;
+    uint32_t ext = rom_ext;
+
+    if (ext >= count || page < rom_ext_page(ext) || page >= rom_ext_end(ext, count)) {
+        if (ext + 1 < count && page >= rom_ext_page(ext + 1) && page < rom_ext_end(ext + 1, count)) {
+            ext++;
+        } else {
+            uint32_t lo = 0;
+            uint32_t hi = count;
+            while (hi - lo > 1) {
+                uint32_t mid = (lo + hi) >> 1;
+                if (rom_ext_page(mid) <= page) {
+                    lo = mid;
+                } else {
+                    hi = mid;
+                }
+            }
+            ext = lo;
+        }
+        rom_ext = ext;
+    }
+
+    if (!count || page < rom_ext_page(ext) || rom_ext_sector(ext) == PI_ROM_MAP_END) {
+        *pages_left = 1;
+        return 0;
+    }
+
+    *pages_left = rom_ext_end(ext, count) - page;
+    return rom_ext_sector(ext) + page - rom_ext_page(ext);
+}
+
+static inline uint32_t rom_map_addr(uint32_t addr, uint32_t *pages_left)
+{
+    return (rom_map_page((addr & PI_ROM_ADDR_MASK) >> 12, pages_left) << 12) | (addr & 0xfff);
+}
+
+void pi_rom_map_reset(void)
+{
+    rom_map[0] = 0;
+    rom_map_count = 0;
+    rom_ext = 0;
+}
+
+bool pi_rom_map_append(uint32_t page, const uint16_t *sectors, uint32_t n)
 {
-    memmove(&pi_rom_lookup[ROMFS_FLASH_SECTOR * 4], pi_rom_lookup, ROMFS_FLASH_SECTOR * 4 * 2);
+    uint32_t count = rom_map_count;
+
+    for (uint32_t i = 0; i < n; i++, page++) {
+        if (count && rom_ext_sector(count - 1) + page - rom_ext_page(count - 1) == sectors[i]) {
+            continue;
+        }
+        if (count == PI_ROM_EXTENTS) {
+            return false;
+        }
+        rom_ext_page(count) = page;
+        rom_ext_sector(count) = sectors[i];
+        rom_map_count = ++count;
+    }
+
+    return true;
+}
+
+bool pi_rom_map_end(uint32_t page)
+{
+    uint32_t count = rom_map_count;
+
+    if (count == PI_ROM_EXTENTS) {
+        return false;
+    }
+    rom_ext_page(count) = page;
+    rom_ext_sector(count) = PI_ROM_MAP_END;
+    rom_map_count = ++count;
+
+    return true;
+}
+
+//
+// Pinned ROM pages, halfwords in the same order the SSI returns them.
+// The valid mask follows the pages; the menu writes it as a 32-bit word,
+// so the mask itself is the second halfword.
+//
+static uint16_t *rom_hot = (uint16_t *) & pi_sram[PI_ROM_HOT_OFFSET];
+static volatile uint16_t *rom_hot_mask = (uint16_t *) & pi_sram[PI_ROM_HOT_OFFSET + PI_ROM_HOT_PAGES * ROMFS_FLASH_SECTOR + 2];
+
+void load_rom_hot_pages(void)
+{
+    *rom_hot_mask = 0;
+    for (int page = 0; page < PI_ROM_HOT_PAGES; page++) {
+        uint16_t *dst = &rom_hot[page * (ROMFS_FLASH_SECTOR / 2)];
+        uint32_t pages_left;
+        flash_read(rom_map_page(page, &pages_left) << 12, (uint8_t *) dst, ROMFS_FLASH_SECTOR);
+        for (int i = 0; i < ROMFS_FLASH_SECTOR / 2; i++) {
+            dst[i] = __builtin_bswap16(dst[i]);
+        }
+    }
+    *rom_hot_mask = (1 << PI_ROM_HOT_PAGES) - 1;
+}
+
+static inline const uint16_t *rom_hot_page(uint32_t addr)
+{
+    uint32_t page = (addr & PI_ROM_ADDR_MASK) >> 12;
+    if (page < PI_ROM_HOT_PAGES && (*rom_hot_mask & (1 << page))) {
+        return &rom_hot[(addr & PI_ROM_ADDR_MASK) >> 1];
+    }
+    return NULL;
+}
+
+// the menu's own map, put back when the N64 resets into it
+static uint16_t rom_map_backup[2 + PI_ROM_BACKUP_EXTENTS * 2];
+
+bool backup_rom_lookup(void)
+{
+    if (rom_map_count > PI_ROM_BACKUP_EXTENTS) {
+        return false;
+    }
+    memmove(rom_map_backup, (const uint16_t *)rom_map, (2 + rom_map_count * 2) * sizeof(uint16_t));
+    return true;
 }
 
 void restore_rom_lookup(void)
 {
-    memmove(pi_rom_lookup, &pi_rom_lookup[ROMFS_FLASH_SECTOR * 4], ROMFS_FLASH_SECTOR * 4 * 2);
+    // pinned pages belong to the game that was running
+    *rom_hot_mask = 0;
+    // drop the count first so core1 never walks into extents being copied
+    rom_map_count = 0;
+    __dmb();
+    memmove((uint16_t *)&rom_map[2], &rom_map_backup[2], rom_map_backup[1] * 2 * sizeof(uint16_t));
+    __dmb();
+    rom_map_count = rom_map_backup[1];
     __dmb();
 }
 
@@ -74,6 +240,250 @@ static inline uint32_t resolve_sram_address(uint32_t address)
     return resolved_address;
 }
 
+//
+// Cartridge registers at 0x1fd01000, one 32-bit word each.
+// read() is called when the high halfword is fetched and both halves are
+// served from its result, write() gets the word once the low halfword is in.
+//
+#define PI_REG_BASE 0x1fd01000
+#define PI_REG_COUNT 32
+
+struct pi_reg {
+    uint32_t (*read)(void);
+    void (*write)(uint32_t value);
+};
+
+static uint32_t pi_reg_none_read(void)
+{
+    return 0xdeadbeef;
+}
+
+static void pi_reg_none_write(uint32_t value)
+{
+    (void)value;
+}
+
+static uint32_t pi_reg_uart_ctrl_read(void)
+{
+    uint32_t flags = uart_get_hw(UART_ID)->fr;
+
+    return ((flags & UART_UARTFR_TXFF_BITS) ? 0x00 : 0x02) | ((flags & UART_UARTFR_RXFE_BITS) ? 0x00 : 0x01) | 0x00f0;
+}
+
+static uint32_t pi_reg_uart_data_read(void)
+{
+    return uart_get_hw(UART_ID)->dr;
+}
+
+static void pi_reg_uart_data_write(uint32_t value)
+{
+    uart_get_hw(UART_ID)->dr = value & 0xff;
+}
+
+static uint32_t led_reg = 0;
+
+static uint32_t pi_reg_led_read(void)
+{
+    return led_reg;
+}
+
+static void pi_reg_led_write(uint32_t value)
+{
+    led_reg = value;
+#ifdef PICO_DEFAULT_LED_PIN
+#if PICO_LED_WS2812 == 1
+    set_rgb_led(led_reg);
+#else
+    gpio_put(PICO_DEFAULT_LED_PIN, led_reg & 0x01);
+#endif
+#endif
+}
+
+static uint32_t pi_reg_sys_ctrl_read(void)
+{
+    return sys64_ctrl_reg;
+}
+
+static void pi_reg_sys_ctrl_write(uint32_t value)
+{
+    uint16_t ctrl_reg = value & 0xffff;
+
+    if (ctrl_reg & 0x01) {
+        if (!(sys64_ctrl_reg & 0x01)) {
+            flash_cs_force(1);
+        }
+    } else {
+        if ((sys64_ctrl_reg & 0x01)) {
+            flash_cs_force(0);
+        }
+    }
+
+    if (ctrl_reg & 0x10) {
+        if (!(sys64_ctrl_reg & 0x10)) {
+            flash_quad_cont_read_mode();
+        }
+    } else {
+        if (sys64_ctrl_reg & 0x10) {
+            flash_quad_exit_cont_read_mode();
+            flash_spi_mode();
+        }
+    }
+
+    sys64_ctrl_reg = ctrl_reg;
+}
+
+static uint32_t pi_reg_ssi_sr_read(void)
+{
+    uint32_t flags = ssi_hw->sr;
+
+    return ((flags & SSI_SR_TFNF_BITS) ? 0x01 : 0x00) | ((flags & SSI_SR_RFNE_BITS) ? 0x02 : 0x00);
+}
+
+static uint32_t pi_reg_ssi_dr0_read(void)
+{
+    return ssi_hw->dr0;
+}
+
+static void pi_reg_ssi_dr0_write(uint32_t value)
+{
+    ssi_hw->dr0 = value & 0xffff;
+}
+
+static uint32_t pi_reg_fw_size_read(void)
+{
+    return (uintptr_t) & __flash_binary_end - XIP_BASE;
+}
+
+static uint32_t pi_reg_fw_caps_read(void)
+{
+    return pi_fw_caps;
+}
+
+static uint32_t pi_reg_usb_ctrl_read(void)
+{
+    uint32_t value = usb64_ctrl_reg;
+
+#if PI_USBCTRL
+    gpio_put(N64_INT, 1);
+    usb64_ctrl_reg &= ~0x8000;
+    if (usb64_ctrl_reg & 0x10) {
+        *((io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ISER_OFFSET)) = 1 << USBCTRL_IRQ;
+    }
+#endif
+
+    return value;
+}
+
+static void pi_reg_usb_ctrl_write(uint32_t value)
+{
+    uint16_t ctrl_reg = value & 0xffff;
+
+#if PI_USBCTRL
+    if (ctrl_reg & 0x0001) {
+        if (!(usb64_ctrl_reg & 0x0001)) {
+            reset_block(RESETS_RESET_USBCTRL_BITS);
+        }
+    } else {
+        if (usb64_ctrl_reg & 0x0001) {
+            unreset_block_wait(RESETS_RESET_USBCTRL_BITS);
+        }
+    }
+
+    if (ctrl_reg & 0x0010) {
+        if (!(usb64_ctrl_reg & 0x0010)) {
+            // irq_set_mask_enabled(1 << USBCTRL_IRQ, true);
+            *((io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ICPR_OFFSET)) = 1 << USBCTRL_IRQ;
+            *((io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ISER_OFFSET)) = 1 << USBCTRL_IRQ;
+        }
+    } else {
+        if (usb64_ctrl_reg & 0x0010) {
+            // irq_set_mask_enabled(1 << USBCTRL_IRQ, false);
+            *((io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ICER_OFFSET)) = 1 << USBCTRL_IRQ;
+        }
+    }
+#endif
+    usb64_ctrl_reg = ctrl_reg;
+}
+
+#if PI_STATS
+static uint32_t pi_reg_stat_rom_read(void)
+{
+    return pi_stats.rom_words;
+}
+
+static uint32_t pi_reg_stat_sram_read(void)
+{
+    return pi_stats.sram_accesses;
+}
+
+static uint32_t pi_reg_stat_fram_read(void)
+{
+    return pi_stats.fram_accesses;
+}
+
+static uint32_t pi_reg_stat_unknown_read(void)
+{
+    return pi_stats.unknown_hits;
+}
+
+static uint32_t pi_reg_stat_wait_read(void)
+{
+    return pi_stats.max_wait;
+}
+
+// any write to a counter clears all of them
+static void pi_reg_stat_write(uint32_t value)
+{
+    (void)value;
+    pi_stats_reset();
+}
+#endif
+
+static const struct pi_reg pi_reg_none = { pi_reg_none_read, pi_reg_none_write };
+
+static const struct pi_reg pi_regs[PI_REG_COUNT] = {
+    { pi_reg_uart_ctrl_read, pi_reg_none_write },       // 0x1fd01000 UART_CTRL
+    { pi_reg_uart_data_read, pi_reg_uart_data_write },  // 0x1fd01004 UART_RXTX
+    { pi_reg_led_read, pi_reg_led_write },      // 0x1fd01008 LED_CTRL
+    { pi_reg_sys_ctrl_read, pi_reg_sys_ctrl_write },    // 0x1fd0100c SYS_CTRL
+    { pi_reg_ssi_sr_read, pi_reg_none_write },  // 0x1fd01010 SSI_SR
+    { pi_reg_ssi_dr0_read, pi_reg_ssi_dr0_write },      // 0x1fd01014 SSI_DR0
+    { pi_reg_fw_size_read, pi_reg_none_write }, // 0x1fd01018 FW_SIZE
+    { pi_reg_fw_caps_read, pi_reg_none_write }, // 0x1fd0101c FW_CAPS
+    { pi_reg_usb_ctrl_read, pi_reg_usb_ctrl_write },    // 0x1fd01020 USB_CTRL
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+#if PI_STATS
+    { pi_reg_stat_rom_read, pi_reg_stat_write },        // 0x1fd01040 PI_STAT_ROM
+    { pi_reg_stat_sram_read, pi_reg_stat_write },       // 0x1fd01044 PI_STAT_SRAM
+    { pi_reg_stat_fram_read, pi_reg_stat_write },       // 0x1fd01048 PI_STAT_FRAM
+    { pi_reg_stat_unknown_read, pi_reg_stat_write },    // 0x1fd0104c PI_STAT_UNKNOWN
+    { pi_reg_stat_wait_read, pi_reg_stat_write },       // 0x1fd01050 PI_STAT_WAIT
+#else
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+#endif
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+    { pi_reg_none_read, pi_reg_none_write },
+};
+
 void n64_pi(void)
 {
     PIO pio = pio0;
@@ -82,6 +492,9 @@ void n64_pi(void)
     pi_program_init(pio, 0, offset);
     pio_sm_set_enabled(pio, 0, true);
 
+    // core0 parks us while it writes save pages back to flash
+    multicore_lockout_victim_init();
+
     // Wait for reset to be released
     while (gpio_get(N64_COLD_RESET) == 0) {
         tight_loop_contents();
@@ -116,9 +529,6 @@ void n64_pi(void)
     uint32_t fram_status = 0;
     uint32_t fram_word = 0;
 
-    uint32_t flags;
-    uint16_t ctrl_reg;
-    static const uintptr_t fw_binary_end = (uintptr_t) & __flash_binary_end;
 
     // uint32_t addr = pio_sm_get_blocking(pio, 0);
     while ((pio->fstat & 0x100) != 0) {
@@ -127,11 +537,45 @@ void n64_pi(void)
 
     do {
         last_addr = addr;
+        pi_txn_count++;
 
         if (last_addr >= 0x10000000 && last_addr <= 0x1FBFFFFF) {
+#if PI_STATS
+            uint32_t served = 0;
+            uint32_t wait = 0;
+#endif
+#if PI_ROM_BURST
+            uint32_t burst_left = 0;
+            const uint16_t *hot = NULL;
             do {
-                mapped_addr = (rom_lookup[(last_addr & 0x3ffffff) >> 12]) << 12 | (last_addr & 0xfff);
-                word = flash_quad_read16(mapped_addr);
+                if (!burst_left) {
+                    // never leave the extent, the next one may live anywhere in flash
+                    burst_left = (0x1000 - (last_addr & 0xfff)) >> 1;
+                    hot = rom_hot_page(last_addr);
+                    if (!hot) {
+                        uint32_t pages_left;
+                        mapped_addr = rom_map_addr(last_addr, &pages_left);
+                        burst_left += (pages_left - 1) << 11;
+                        if (burst_left > FLASH_QUAD_BURST_MAX) {
+                            burst_left = FLASH_QUAD_BURST_MAX;
+                        }
+                        flash_quad_burst_start(mapped_addr, burst_left);
+                    }
+                }
+                if (hot) {
+                    word = *hot++;
+                } else {
+#if PI_STATS
+                    // flash_quad_burst_read16() with the poll counted
+                    while (!(ssi_hw->sr & SSI_SR_RFNE_BITS)) {
+                        wait++;
+                    }
+                    word = ssi_hw->dr0;
+#else
+                    word = flash_quad_burst_read16();
+#endif
+                }
+                burst_left--;
 
                 while ((pio->fstat & 0x100) != 0) {
                 }
@@ -139,13 +583,56 @@ void n64_pi(void)
 
                 if (addr == 0) {
                     pio->txf[0] = word;
+#if PI_STATS
+                    served++;
+#endif
                 } else if (!(addr & 1)) {
                     break;
                 }
                 last_addr += 2;
             } while (true);
+            flash_quad_burst_stop();
+#else
+            do {
+                const uint16_t *hot = rom_hot_page(last_addr);
+                if (hot) {
+                    word = *hot;
+                } else {
+                    uint32_t pages_left;
+                    mapped_addr = rom_map_addr(last_addr, &pages_left);
+                    word = flash_quad_read16(mapped_addr);
+                }
+
+                while ((pio->fstat & 0x100) != 0) {
+                }
+                addr = pio->rxf[0];
+
+                if (addr == 0) {
+                    pio->txf[0] = word;
+#if PI_STATS
+                    served++;
+#endif
+                } else if (!(addr & 1)) {
+                    break;
+                }
+                last_addr += 2;
+            } while (true);
+#endif
+#if PI_STATS
+            pi_stats.rom_words += served;
+            if (wait > pi_stats.max_wait) {
+                pi_stats.max_wait = wait;
+            }
+#endif
 #if PI_SRAM
         } else if (last_addr >= 0x08000000 && last_addr <= 0x0FFFFFFF) {
+#if PI_STATS
+            if (!(sys64_ctrl_reg & 0x200)) {
+                pi_stats.sram_accesses++;
+            } else {
+                pi_stats.fram_accesses++;
+            }
+#endif
             if (!(sys64_ctrl_reg & 0x200)) {
                 sram_address = resolve_sram_address(last_addr) >> 1;
                 do {
@@ -156,6 +643,8 @@ void n64_pi(void)
                     if (addr == 0) {
                         pio->txf[0] = sram_16[sram_address++];
                     } else if (addr & 1) {
+                        pi_save_dirty[sram_address >> 11] = 1;
+                        pi_save_writes++;
                         sram_16[sram_address++] = addr >> 16;
                     } else {
                         break;
@@ -235,6 +724,8 @@ void n64_pi(void)
                             pio->txf[0] = fram_word & 0xffff;
                             if (fram_erase_counter) {
                                 memset(&sram_16[fram_erase_counter], 0xff, 0x1000);
+                                pi_save_dirty[fram_erase_counter >> 11] = 1;
+                                pi_save_writes++;
                                 fram_erase_counter += 0x800;
                                 if (fram_erase_counter == 0x10000) {
                                     fram_erase_counter = 0;
@@ -279,9 +770,13 @@ void n64_pi(void)
                                 memset(sram_16, 0xff, 0x1000);
                                 fram_erase_counter = 0x800;
                                 fram_status = 0x02;
+                                pi_save_dirty[0] = 1;
+                                pi_save_writes++;
                             } else if (fram_mode == FLASH_CMD_SECTOR_ERASE) {
                                 memset(&sram_16[fram_page << 6], 0xff, 128);
                                 fram_status = 0x08;
+                                pi_save_dirty[fram_page >> 5] = 1;
+                                pi_save_writes++;
                             }
                             fram_mode = fram_mode_tmp;
                             continue;
@@ -297,6 +792,8 @@ void n64_pi(void)
                         } else if (fram_mode == FLASH_CMD_PROGRAM_PAGE) {
                             memmove(&sram_16[(fram_word & 0x3ff) << 6], flash_buffer, 128);
                             fram_status = 0x04;
+                            pi_save_dirty[(fram_word & 0x3ff) >> 5] = 1;
+                            pi_save_writes++;
                             continue;
                         }
                         continue;
@@ -347,288 +844,25 @@ void n64_pi(void)
                 sram_address += 4;
             } while (true);
 #endif
-        } else if (last_addr == 0x1fd01000) {
-            do {
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = 0;
-                } else if (addr & 1) {
-                    word = addr & 0xffff0000;
-                } else {
-                    break;
-                }
-
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = ((uart_get_hw(UART_ID)->fr & UART_UARTFR_TXFF_BITS) ? 0x00 : 0x02) | ((uart_get_hw(UART_ID)->fr & UART_UARTFR_RXFE_BITS) ? 0x00 : 0x01) | 0x00f0;
-                } else if (addr & 1) {
-                    word = (addr >> 16) | word;
-                } else {
-                    break;
-                }
-            } while (true);
-        } else if (last_addr == 0x1fd01004) {
-            do {
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = 0;
-                } else if (addr & 1) {
-                    word = addr & 0xffff0000;
-                } else {
-                    break;
-                }
-
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = uart_get_hw(UART_ID)->dr;
-                } else if (addr & 1) {
-                    uart_get_hw(UART_ID)->dr = (addr >> 16) & 0xff;
-                } else {
-                    break;
-                }
-            } while (true);
-        } else if (last_addr == 0x1fd01008) {
-            static uint32_t led_reg = 0;
-            do {
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = led_reg >> 16;
-                } else if (addr & 1) {
-                    led_reg = addr & 0xffff0000;
-                } else {
-                    break;
-                }
-
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = led_reg & 0xffff;
-                } else if (addr & 1) {
-                    led_reg = (addr >> 16) | led_reg;
-#ifdef PICO_DEFAULT_LED_PIN
-#if PICO_LED_WS2812 == 1
-                    set_rgb_led(led_reg);
-#else
-                    gpio_put(PICO_DEFAULT_LED_PIN, led_reg & 0x01);
-#endif
-#endif
-                } else {
-                    break;
-                }
-            } while (true);
-        } else if (last_addr == 0x1fd0100c) {
-            do {
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = 0;
-                } else if (addr & 1) {
-                    word = addr & 0xffff0000;
-                } else {
-                    break;
-                }
-
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = sys64_ctrl_reg;
-                } else if (addr & 1) {
-                    ctrl_reg = addr >> 16;
-
-                    if (ctrl_reg & 0x01) {
-                        if (!(sys64_ctrl_reg & 0x01)) {
-                            flash_cs_force(1);
-                        }
-                    } else {
-                        if ((sys64_ctrl_reg & 0x01)) {
-                            flash_cs_force(0);
-                        }
-                    }
-
-                    if (ctrl_reg & 0x10) {
-                        if (!(sys64_ctrl_reg & 0x10)) {
-                            flash_quad_cont_read_mode();
-                        }
-                    } else {
-                        if (sys64_ctrl_reg & 0x10) {
-                            flash_quad_exit_cont_read_mode();
-                            flash_spi_mode();
-                        }
-                    }
-
-                    sys64_ctrl_reg = ctrl_reg;
-                } else {
-                    break;
-                }
-            } while (true);
-        } else if (last_addr == 0x1fd01010) {
-            do {
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = 0;
-                } else if (addr & 1) {
-                    word = addr & 0xffff0000;
-                } else {
-                    break;
-                }
-
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    flags = ssi_hw->sr;
-                    pio->txf[0] = ((flags & SSI_SR_TFNF_BITS) ? 0x01 : 0x00) | ((flags & SSI_SR_RFNE_BITS) ? 0x02 : 0x00);
-                } else if (addr & 1) {
-                    word = (addr >> 16) | word;
-                } else {
-                    break;
-                }
-            } while (true);
-        } else if (last_addr == 0x1fd01014) {
-            do {
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = 0;
-                } else if (addr & 1) {
-                    word = addr & 0xffff0000;
-                } else {
-                    break;
-                }
-
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] =  ssi_hw->dr0;
-                } else if (addr & 1) {
-                    ssi_hw->dr0 = addr >> 16;
-                } else {
-                    break;
-                }
-            } while (true);
-        } else if (last_addr == 0x1fd01018) {
-            static const uint32_t fw_size = fw_binary_end - XIP_BASE;
-            do {
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = fw_size >> 16;
-                } else if (addr & 1) {
-                    word = addr & 0xffff0000;
-                } else {
-                    break;
-                }
-
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = fw_size & 0xffff;
-                } else if (addr & 1) {
-                    word = (addr >> 16) | word;
-                } else {
-                    break;
-                }
-            } while (true);
-        } else if (last_addr == 0x1fd01020) {
-            do {
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = 0;
-                } else if (addr & 1) {
-                    word = addr & 0xffff0000;
-                } else {
-                    break;
-                }
-
-                while ((pio->fstat & 0x100) != 0) {
-                }
-                addr = pio->rxf[0];
-
-                if (addr == 0) {
-                    pio->txf[0] = usb64_ctrl_reg;
-#if PI_USBCTRL
-                    gpio_put(N64_INT, 1);
-                    usb64_ctrl_reg &= ~0x8000;
-                    if (usb64_ctrl_reg & 0x10) {
-                        *((io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ISER_OFFSET)) = 1 << USBCTRL_IRQ;
-                    }
-#endif
-                } else if (addr & 1) {
-                    ctrl_reg = addr >> 16;
-
-#if PI_USBCTRL
-                    if (ctrl_reg & 0x0001) {
-                        if (!(usb64_ctrl_reg & 0x0001)) {
-                            reset_block(RESETS_RESET_USBCTRL_BITS);
-                        }
-                    } else {
-                        if (usb64_ctrl_reg & 0x0001) {
-                            unreset_block_wait(RESETS_RESET_USBCTRL_BITS);
-                        }
-                    }
-
-                    if (ctrl_reg & 0x0010) {
-                        if (!(usb64_ctrl_reg & 0x0010)) {
-                            // irq_set_mask_enabled(1 << USBCTRL_IRQ, true);
-                            *((io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ICPR_OFFSET)) = 1 << USBCTRL_IRQ;
-                            *((io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ISER_OFFSET)) = 1 << USBCTRL_IRQ;
-                        }
-                    } else {
-                        if (usb64_ctrl_reg & 0x0010) {
-                            // irq_set_mask_enabled(1 << USBCTRL_IRQ, false);
-                            *((io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ICER_OFFSET)) = 1 << USBCTRL_IRQ;
-                        }
-                    }
-#endif
-                    usb64_ctrl_reg = ctrl_reg;
-                } else {
-                    break;
-                }
-            } while (true);
         } else {
+            // 0x1fd01000 register file, anything else reads as 0xdeadbeef
+            const struct pi_reg *reg = &pi_reg_none;
+            if ((last_addr & ~(PI_REG_COUNT * 4 - 1)) == PI_REG_BASE) {
+                reg = &pi_regs[(last_addr >> 2) & (PI_REG_COUNT - 1)];
+            }
+#if PI_STATS
+            if (reg->read == pi_reg_none_read) {
+                pi_stats.unknown_hits++;
+            }
+#endif
             do {
                 while ((pio->fstat & 0x100) != 0) {
                 }
                 addr = pio->rxf[0];
 
                 if (addr == 0) {
-                    pio->txf[0] = 0xdead;
+                    word = reg->read();
+                    pio->txf[0] = word >> 16;
                 } else if (addr & 1) {
                     word = addr & 0xffff0000;
                 } else {
@@ -640,13 +874,16 @@ void n64_pi(void)
                 addr = pio->rxf[0];
 
 #ifdef DEBUG_PI
-                set_rgb_led(0xff0000);
-                printf("%08X\n", last_addr);
+                if (reg == &pi_reg_none) {
+                    set_rgb_led(0xff0000);
+                    printf("%08X\n", last_addr);
+                }
 #endif
                 if (addr == 0) {
-                    pio->txf[0] = 0xbeef;
+                    pio->txf[0] = word & 0xffff;
                 } else if (addr & 1) {
                     word = (addr >> 16) | word;
+                    reg->write(word);
                 } else {
                     break;
                 }
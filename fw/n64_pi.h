@@ -6,7 +6,53 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
+struct pi_stats {
+    uint32_t rom_words;         // ROM halfwords returned to the N64
+    uint32_t sram_accesses;     // SRAM transactions
+    uint32_t fram_accesses;     // FlashRAM data and command transactions
+    uint32_t unknown_hits;      // transactions to unmapped addresses
+    uint32_t max_wait;          // longest flash data wait in one ROM transaction, in SSI polls
+};
+
+extern volatile struct pi_stats pi_stats;
+
+// 4K ROM pages, the 128 MB of a v3 board
+#define PI_ROM_PAGES 32768
+#define PI_ROM_ADDR_MASK 0x7ffffff
+
+// ROM map extents, the 64 KB PI window less its count word
+#define PI_ROM_EXTENTS 16383
+// sector of the entry that ends the ROM map
+#define PI_ROM_MAP_END 0xffff
+
+// extents of the menu ROM kept for NMI
+#define PI_ROM_BACKUP_EXTENTS 64
+
+// 4K pages of pi_sram written by the N64 or the SI EEPROM handler since the last flush
+#define PI_SAVE_PAGES 64
+
+extern volatile uint8_t pi_save_dirty[PI_SAVE_PAGES];
+extern volatile uint32_t pi_save_writes;
+extern volatile uint32_t pi_txn_count;
+
+// Firmware features the menu can rely on, read at 0x1fd0101c
+#define PI_FW_CAPS_SAVE_FLUSH 0x01
+#define PI_FW_CAPS_ROM_EXTENTS 0x02
+
+extern uint32_t pi_fw_caps;
+
 void n64_pi(void);
 
-void backup_rom_lookup(void);
+void pi_rom_map_reset(void);
+bool pi_rom_map_append(uint32_t page, const uint16_t *sectors, uint32_t n);
+bool pi_rom_map_end(uint32_t page);
+
+bool backup_rom_lookup(void);
 void restore_rom_lookup(void);
+
+void load_rom_hot_pages(void);
+
+void pi_stats_reset(void);
@@ -0,0 +1,318 @@
+/**
+ * Copyright (c) 2022-2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "n64_save.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "flashjob.h"
+#include "flashrom.h"
+#include "main.h"
+#include "n64.h"
+#include "n64_pi.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+#include "romfs/romfs.h"
+
+//
+// Save description left by the menu in RMRAM (see rom/src/n64cart.h).
+// 32-bit words are stored as two halfwords, high half first.
+//
+#define SAVE_INFO_OFFSET (SRAM_1MBIT_SIZE + ROMFS_FLASH_SECTOR * 4 * 2 * 2 + 2048)
+#define SAVE_INFO_ADDR 0
+#define SAVE_INFO_SIZE 4
+#define SAVE_INFO_SECTORS 96
+#define SAVE_INFO_MAP 128
+#define SAVE_MAP_ENTRIES 32
+
+#define SAVE_PI_BASE 0x08000000
+
+// PI bus silence required before core1 is parked for a flush step
+#define SAVE_FLUSH_IDLE_US 2000
+#define SAVE_FLUSH_POLL_US 500
+// longest an erase runs in one step before it is suspended
+#define SAVE_FLUSH_ERASE_US 1000
+#define SAVE_FLUSH_PAGE 256
+
+static uint32_t save_info_read(uint32_t offset)
+{
+    const uint16_t *info = (const uint16_t *)&pi_sram[SAVE_INFO_OFFSET + offset];
+
+    return (info[0] << 16) | info[1];
+}
+
+uint32_t save_area_end(void)
+{
+    uint32_t save_addr = save_info_read(SAVE_INFO_ADDR);
+    uint32_t save_size = save_info_read(SAVE_INFO_SIZE);
+
+    // EEPROM saves live past the SRAM image
+    if (save_addr < SAVE_PI_BASE || save_addr - SAVE_PI_BASE >= SRAM_1MBIT_SIZE) {
+        return 0;
+    }
+
+    if (save_size > SRAM_1MBIT_SIZE - (save_addr - SAVE_PI_BASE)) {
+        return SRAM_1MBIT_SIZE;
+    }
+
+    return save_addr - SAVE_PI_BASE + save_size;
+}
+
+#if SAVE_FLUSH_MS
+
+//
+// pi_sram keeps PI halfwords in host order. EEPROM files are raw bytes,
+// SRAM and FlashRAM files hold each 32-bit PI word little-endian.
+//
+static void save_to_file_order(uint8_t *dst, const uint8_t *src, uint32_t len, bool swap)
+{
+    if (!swap) {
+        memmove(dst, src, len);
+        return;
+    }
+
+    for (uint32_t i = 0; i < len; i += 4) {
+        dst[i] = src[i + 2];
+        dst[i + 1] = src[i + 3];
+        dst[i + 2] = src[i];
+        dst[i + 3] = src[i + 1];
+    }
+}
+
+//
+// A flush rewrites one save sector from a copy taken on core0. The work is
+// split in steps that park core1 only briefly: the compare, erase slices
+// that end with an erase suspend, and one page program at a time. Between
+// the steps the flash is back in quad continuous read mode and core1 serves
+// the PI bus. The sector under erase belongs to the save file, which the
+// N64 only sees through pi_sram.
+//
+enum {
+    FLUSH_IDLE,
+    FLUSH_COMPARE,
+    FLUSH_ERASE,
+    FLUSH_PROGRAM,
+};
+
+static repeating_timer_t flush_timer;
+static uint8_t flush_buffer[ROMFS_FLASH_SECTOR];
+static uint8_t flush_state;
+static bool flush_erasing;
+static uint32_t flush_addr;
+static uint32_t flush_pos;
+static bool flush_held;
+
+static void save_flush_park(void)
+{
+    multicore_lockout_start_blocking();
+
+    flash_quad_burst_stop();
+    flash_quad_exit_cont_read_mode();
+    flash_spi_mode();
+}
+
+static void save_flush_unpark(void)
+{
+    flash_quad_cont_read_mode();
+
+    multicore_lockout_end_blocking();
+}
+
+// Runs with core1 parked, false once the sector is done
+static bool save_flush_step(uint32_t erase_us)
+{
+    if (flush_state == FLUSH_COMPARE) {
+        static uint8_t flash[SAVE_FLUSH_PAGE];
+
+        for (flush_pos = 0; flush_pos < ROMFS_FLASH_SECTOR; flush_pos += sizeof(flash)) {
+            flash_read(flush_addr + flush_pos, flash, sizeof(flash));
+            if (memcmp(&flush_buffer[flush_pos], flash, sizeof(flash))) {
+                break;
+            }
+        }
+        if (flush_pos == ROMFS_FLASH_SECTOR) {
+            return false;
+        }
+
+        flush_state = FLUSH_ERASE;
+        flush_erasing = false;
+        return true;
+    }
+
+    if (flush_state == FLUSH_ERASE) {
+        if (flush_erasing) {
+            flash_erase_resume();
+        } else {
+            flash_erase_sector_start(flush_addr);
+            flush_erasing = true;
+        }
+
+        uint32_t start = time_us_32();
+        while (flash_busy()) {
+            if (time_us_32() - start >= erase_us && flash_erase_suspend()) {
+                return true;
+            }
+        }
+
+        flush_state = FLUSH_PROGRAM;
+        flush_pos = 0;
+        return true;
+    }
+
+    flash_write_page(flush_addr + flush_pos, &flush_buffer[flush_pos]);
+    flush_pos += SAVE_FLUSH_PAGE;
+
+    return flush_pos < ROMFS_FLASH_SECTOR;
+}
+
+// Copies the next dirty save sector for a flush, false when there is none
+static bool save_flush_start(void)
+{
+    uint32_t save_addr = save_info_read(SAVE_INFO_ADDR);
+    uint32_t save_size = save_info_read(SAVE_INFO_SIZE);
+    uint32_t sectors = save_info_read(SAVE_INFO_SECTORS);
+
+    if (save_addr < SAVE_PI_BASE || !save_size || sectors > SAVE_MAP_ENTRIES || sectors != (save_size + ROMFS_FLASH_SECTOR - 1) / ROMFS_FLASH_SECTOR) {
+        return false;
+    }
+
+    uint32_t base = save_addr - SAVE_PI_BASE;
+    if (base + save_size > SAVE_INFO_OFFSET || (base & (ROMFS_FLASH_SECTOR - 1))) {
+        return false;
+    }
+
+    uint32_t sector;
+    for (sector = 0; sector < sectors; sector++) {
+        if (pi_save_dirty[(base >> 12) + sector]) {
+            break;
+        }
+    }
+    if (sector == sectors) {
+        return false;
+    }
+
+    const uint16_t *map = (const uint16_t *)&pi_sram[SAVE_INFO_OFFSET + SAVE_INFO_MAP];
+    uint32_t offset = sector * ROMFS_FLASH_SECTOR;
+    uint32_t len = (save_size - offset < ROMFS_FLASH_SECTOR) ? save_size - offset : ROMFS_FLASH_SECTOR;
+
+    // clear before copying, a write that lands meanwhile marks the page again
+    pi_save_dirty[(base >> 12) + sector] = 0;
+
+    save_to_file_order(flush_buffer, &pi_sram[base + offset], len, save_size > 2048);
+    memset(&flush_buffer[len], 0xff, sizeof(flush_buffer) - len);
+
+    flush_addr = map[sector] << 12;
+    flush_state = FLUSH_COMPARE;
+
+#ifdef DEBUG_INFO
+    printf("save sector %d flush\n", sector);
+#endif
+
+    return true;
+}
+
+// Runs a started flush to the end in one go, core1 stays parked for all of it
+static void save_flush_finish(void)
+{
+    if (flush_state == FLUSH_IDLE) {
+        return;
+    }
+
+    save_flush_park();
+    while (save_flush_step(UINT32_MAX)) {
+    }
+    save_flush_unpark();
+
+    flush_state = FLUSH_IDLE;
+}
+
+//
+// Runs from the alarm interrupt, like the flash job timer, so it never
+// interleaves with the USB handler or the job queue. A tick does at most
+// one flush step, and only after the PI bus has been quiet for a while.
+//
+static bool save_flush_tick(repeating_timer_t *rt)
+{
+    static uint32_t seen_writes;
+    static uint32_t quiet_since;
+    static uint32_t seen_txn;
+    static uint32_t txn_since;
+
+    (void)rt;
+
+#ifndef N64CART_RP2040_PICO
+    // the menu comes up after NMI and drives the flash for its own save
+    if (gpio_get(N64_NMI) == 0) {
+        save_flush_finish();
+        return true;
+    }
+#endif
+
+    uint32_t now = time_us_32();
+    if (pi_txn_count != seen_txn) {
+        seen_txn = pi_txn_count;
+        txn_since = now;
+        return true;
+    }
+
+    if (now - txn_since < SAVE_FLUSH_IDLE_US) {
+        return true;
+    }
+
+    // the menu drives the flash itself while quad mode is off, the USB host after FLASH_SPI_MODE
+    if (flush_held || !(sys64_ctrl_reg & 0x10)) {
+        return true;
+    }
+
+    if (flush_state != FLUSH_IDLE) {
+        save_flush_park();
+        if (!save_flush_step(SAVE_FLUSH_ERASE_US)) {
+            flush_state = FLUSH_IDLE;
+        }
+        save_flush_unpark();
+        return true;
+    }
+
+    if (pi_save_writes != seen_writes) {
+        seen_writes = pi_save_writes;
+        quiet_since = now;
+        return true;
+    }
+
+    if (now - quiet_since >= SAVE_FLUSH_MS * 1000 && flash_jobs_idle()) {
+        save_flush_start();
+    }
+
+    return true;
+}
+#endif
+
+void save_flush_init(void)
+{
+#if SAVE_FLUSH_MS
+    // without erase suspend the PI bus would wait for a whole sector erase
+    if (get_flash_info()->suspend == FLASH_SUSPEND_NONE) {
+        return;
+    }
+
+    add_repeating_timer_us(-SAVE_FLUSH_POLL_US, save_flush_tick, NULL, &flush_timer);
+
+    // the menu only sets up the save file map when somebody uses it
+    pi_fw_caps |= PI_FW_CAPS_SAVE_FLUSH;
+#endif
+}
+
+void save_flush_hold(bool hold)
+{
+#if SAVE_FLUSH_MS
+    save_flush_finish();
+
+    flush_held = hold;
+#else
+    (void)hold;
+#endif
+}
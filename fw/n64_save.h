@@ -0,0 +1,18 @@
+/**
+ * Copyright (c) 2022-2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void save_flush_init(void);
+
+// End of the save data the menu loaded into the SRAM image, 0 when it holds none
+uint32_t save_area_end(void);
+
+// Finishes a running flush, no new one starts while held (the USB host owns the flash)
+void save_flush_hold(bool hold);
@@ -3,133 +3,83 @@
 #include <stdio.h>
 #include <string.h>
 
-#include "hardware/gpio.h"
-#include "hardware/watchdog.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
 #include "main.h"
 #include "n64.h"
 #include "n64_pi.h"
+#include "n64_si.pio.h"
+#include "n64_si_cmd.h"
 #include "pico/stdlib.h"
 
-static int si_pulse_counter;
-static int si_out_pulses;
-static unsigned char si_data_bits[324];
-static unsigned char si_data_byte[16];
+// pio0 belongs to the PI bus
+#define SI_PIO pio1
 
-static void cic_dclk_callback(void)
+static uint si_sm;
+static struct si_frame si_frame;
+
+// a reply takes more words than the 4 deep TX FIFO holds, the RX FIFO
+// is in use so the two can't be joined
+static uint32_t si_reply[SI_REPLY_WORDS];
+static uint32_t si_reply_count;
+static uint32_t si_reply_pos;
+
+static void si_reply_fill(void)
 {
-#if PICO_SDK_VERSION_MAJOR == 2
-    io_bank0_irq_ctrl_hw_t *irq_ctrl_base = get_core_num()? &io_bank0_hw->proc1_irq_ctrl : &io_bank0_hw->proc0_irq_ctrl;
-#else
-    io_irq_ctrl_hw_t *irq_ctrl_base = get_core_num()? &iobank0_hw->proc1_irq_ctrl : &iobank0_hw->proc0_irq_ctrl;
-#endif
+    while (si_reply_pos < si_reply_count && !pio_sm_is_tx_fifo_full(SI_PIO, si_sm)) {
+        pio_sm_put(SI_PIO, si_sm, si_reply[si_reply_pos++]);
+    }
+
+    // the rest goes out from the TX not full interrupt as the cells are sent
+    pio_set_irq0_source_enabled(SI_PIO, pis_sm0_tx_fifo_not_full + si_sm, si_reply_pos < si_reply_count);
+}
+
+static void si_pio_callback(void)
+{
+    si_reply_fill();
 
-    uint gpio = N64_SI_CLK;
-    io_ro_32 *status_reg = &irq_ctrl_base->ints[gpio / 8];
-    uint events = (*status_reg >> 4 * (gpio % 8)) & 0xf;
-
-    if (events) {
-        static bool skip_pulse = true;
-        skip_pulse = !skip_pulse;
-
-        if (si_out_pulses) {
-            if (!skip_pulse) {
-                if (si_data_bits[si_pulse_counter++]) {
-                    gpio_set_dir(N64_SI_DATA, GPIO_IN);
-                } else {
-                    gpio_set_dir(N64_SI_DATA, GPIO_OUT);
-                    gpio_put(N64_SI_DATA, 0);
-                }
-
-                si_out_pulses--;
-                if (!si_out_pulses) {
-                    si_pulse_counter = 0;
-                    gpio_set_dir(N64_SI_DATA, GPIO_IN);
-                }
-            }
-        } else {
-            if (!skip_pulse) {
-                si_data_bits[si_pulse_counter++] = gpio_get(N64_SI_DATA) ? 1 : 0;
-                if (si_pulse_counter % 4 == 1 && si_data_bits[si_pulse_counter - 1] == 1) {
-                    if (si_pulse_counter > 1) {
-                        si_pulse_counter--;
-                        if (si_pulse_counter % 32 == 4) {
-                            if (*((uint32_t *) & si_data_bits[si_pulse_counter - 4]) == 0x01010100) {
-                                //                              printf("Stop bit detected\n");
-                                int bit_counter = 0;
-                                int byte_counter = 0;
-                                unsigned char byte = 0;
-
-                                for (int i = 0; i < si_pulse_counter - 4; i += 4) {
-                                    if (*((uint32_t *) & si_data_bits[i]) == 0x01000000) {
-                                        byte <<= 1;
-                                    } else if (*((uint32_t *) & si_data_bits[i]) == 0x01010100) {
-                                        byte = (byte << 1) | 1;
-                                    }
-                                    bit_counter++;
-                                    if (bit_counter == 8) {
-                                        si_data_byte[byte_counter++] = byte;
-                                        bit_counter = 0;
-                                    }
-                                }
-
-                                si_out_pulses = 0;
-
-                                // printf("%02X\n", si_data_byte[0]);
-                                if (si_data_byte[0] == 0x00 || si_data_byte[0] == 0xff) {
-                                    si_data_byte[0] = 0x00;
-                                    si_data_byte[1] = (sys64_ctrl_reg & 0x1000) ? 0xc0 : 0x80;
-                                    si_data_byte[2] = 0x00;
-                                    byte_counter = 3;
-                                } else if (si_data_byte[0] == 0x04) {
-                                    memmove(&si_data_byte[0], &si_eeprom[si_data_byte[1] << 3], 8);
-                                    byte_counter = 8;
-                                } else if (si_data_byte[0] == 0x05) {
-                                    memmove(&si_eeprom[si_data_byte[1] << 3], &si_data_byte[2], 8);
-                                    si_data_byte[0] = 0x00;
-                                    byte_counter = 1;
-                                } else {
-                                    goto cmd_error;
-                                }
-
-                                for (int i = 0; i < byte_counter; i++) {
-                                    for (int j = 0; j < 8; j++) {
-                                        if (si_data_byte[i] & 0x80) {
-                                            *((uint32_t *) & si_data_bits[si_out_pulses]) = 0x01010100;
-                                        } else {
-                                            *((uint32_t *) & si_data_bits[si_out_pulses]) = 0x01000000;
-                                        }
-                                        si_out_pulses += 4;
-                                        si_data_byte[i] <<= 1;
-                                    }
-                                }
-                                *((uint32_t *) & si_data_bits[si_out_pulses]) = 0x01010000;
-                                si_out_pulses += 4;
-cmd_error:
-                            }
-                        }
-                    }
-                    si_pulse_counter = 0;
-                }
-            }
+    while (!pio_sm_is_rx_fifo_empty(SI_PIO, si_sm)) {
+        if (!si_frame_push(&si_frame, pio_sm_get(SI_PIO, si_sm))) {
+            continue;
         }
 
-#if PICO_SDK_VERSION_MAJOR == 2
-        io_bank0_hw->intr[gpio / 8] = events << (4 * (gpio % 8));
-#else
-        iobank0_hw->intr[gpio / 8] = events << (4 * (gpio % 8));
-#endif
+        uint8_t reply[SI_REPLY_MAX];
+        int write_offset;
+
+        uint32_t len = si_eeprom_command(&si_frame, si_eeprom, sys64_ctrl_reg & 0x1000, reply, &write_offset);
+        if (write_offset >= 0) {
+            pi_save_dirty[(si_eeprom - pi_sram + write_offset) >> 12] = 1;
+            pi_save_writes++;
+        }
+
+        // the state machine waits for the cell count even when there is no reply
+        si_reply_count = si_encode_reply(reply, len, si_reply);
+        si_reply_pos = 0;
+        si_reply_fill();
+
+        si_frame.len = 0;
+        si_frame.overflow = false;
     }
 }
 
 void si_main(void)
 {
 #ifndef N64CART_RP2040_PICO
-    si_pulse_counter = 0;
-    si_out_pulses = 0;
+    uint sm_tick = pio_claim_unused_sm(SI_PIO, true);
+    si_sm = pio_claim_unused_sm(SI_PIO, true);
+
+    uint offset_tick = pio_add_program(SI_PIO, &si_tick_program);
+    uint offset = pio_add_program(SI_PIO, &si_program);
+
+    si_program_init(SI_PIO, sm_tick, offset_tick, si_sm, offset, N64_SI_DATA, N64_SI_CLK);
+
+    si_frame.len = 0;
+    si_frame.overflow = false;
 
-    gpio_set_irq_enabled(N64_SI_CLK, GPIO_IRQ_EDGE_RISE, true);
+    pio_set_irq0_source_enabled(SI_PIO, pis_sm0_rx_fifo_not_empty + si_sm, true);
+    irq_set_exclusive_handler(PIO1_IRQ_0, si_pio_callback);
+    irq_set_enabled(PIO1_IRQ_0, true);
 
-    irq_set_exclusive_handler(IO_IRQ_BANK0, cic_dclk_callback);
-    irq_set_enabled(IO_IRQ_BANK0, true);
+    pio_enable_sm_mask_in_sync(SI_PIO, (1u << sm_tick) | (1u << si_sm));
 #endif
 }
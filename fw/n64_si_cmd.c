@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2022-2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "n64_si_cmd.h"
+
+#include <string.h>
+
+#define SI_CMD_STATUS 0x00
+#define SI_CMD_EEPROM_READ 0x04
+#define SI_CMD_EEPROM_WRITE 0x05
+#define SI_CMD_RESET 0xff
+
+#define SI_EEPROM_BLOCK 8
+
+bool si_frame_push(struct si_frame *frame, uint32_t word)
+{
+    if (word == SI_FRAME_END) {
+        return true;
+    }
+
+    if (frame->len < SI_FRAME_MAX) {
+        frame->data[frame->len++] = word;
+    } else {
+        frame->overflow = true;
+    }
+
+    return false;
+}
+
+uint32_t si_eeprom_command(const struct si_frame *frame, uint8_t *eeprom, bool eeprom_16k, uint8_t *reply, int *write_offset)
+{
+    const uint8_t *cmd = frame->data;
+
+    *write_offset = -1;
+
+    if (!frame->len || frame->overflow) {
+        return 0;
+    }
+
+    switch (cmd[0]) {
+    case SI_CMD_STATUS:
+    case SI_CMD_RESET:
+        reply[0] = 0x00;
+        reply[1] = eeprom_16k ? 0xc0 : 0x80;
+        reply[2] = 0x00;
+        return 3;
+    case SI_CMD_EEPROM_READ:
+        if (frame->len < 2) {
+            return 0;
+        }
+        memmove(reply, &eeprom[cmd[1] * SI_EEPROM_BLOCK], SI_EEPROM_BLOCK);
+        return SI_EEPROM_BLOCK;
+    case SI_CMD_EEPROM_WRITE:
+        if (frame->len < 2 + SI_EEPROM_BLOCK) {
+            return 0;
+        }
+        memmove(&eeprom[cmd[1] * SI_EEPROM_BLOCK], &cmd[2], SI_EEPROM_BLOCK);
+        *write_offset = cmd[1] * SI_EEPROM_BLOCK;
+        reply[0] = 0x00;
+        return 1;
+    }
+
+    return 0;
+}
+
+//
+// A cell is one bit on the line, the PIO drives its first sample low and
+// releases the last one. The words carry pindirs for the two in between,
+// 1 drives the line low: 00 sends a 1, 11 sends a 0 and 10 is the stop bit.
+//
+uint32_t si_encode_reply(const uint8_t *reply, uint32_t len, uint32_t *words)
+{
+    uint32_t cells = len ? len * 8 + 1 : 0;
+    uint32_t bits = 0;
+
+    memset(&words[1], 0, (SI_REPLY_WORDS - 1) * sizeof(uint32_t));
+    words[0] = cells;
+
+    for (uint32_t i = 0; i < cells; i++) {
+        uint32_t pair;
+        if (i == cells - 1) {
+            pair = 2;
+        } else {
+            pair = (reply[i / 8] & (0x80 >> (i % 8))) ? 0 : 3;
+        }
+        words[1 + bits / 32] |= pair << (30 - bits % 32);
+        bits += 2;
+    }
+
+    return 1 + (bits + 31) / 32;
+}
@@ -0,0 +1,35 @@
+/**
+ * Copyright (c) 2022-2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Pushed by the si PIO program after the stop bit of a console frame
+#define SI_FRAME_END 0xffffffff
+
+#define SI_FRAME_MAX 16
+#define SI_REPLY_MAX 8
+
+// cell count and two bits per cell, see n64_si.pio
+#define SI_REPLY_WORDS (1 + (2 * (SI_REPLY_MAX * 8 + 1) + 31) / 32)
+
+struct si_frame {
+    uint8_t data[SI_FRAME_MAX];
+    uint32_t len;
+    bool overflow;
+};
+
+// Collects one RX FIFO word, true once a whole frame is in data
+bool si_frame_push(struct si_frame *frame, uint32_t word);
+
+// Runs an EEPROM command, returns the reply length or 0 when the cart stays silent.
+// write_offset is the EEPROM offset of a written block, -1 when nothing changed.
+uint32_t si_eeprom_command(const struct si_frame *frame, uint8_t * eeprom, bool eeprom_16k, uint8_t * reply, int *write_offset);
+
+// Encodes a reply for the si PIO program, returns the number of TX FIFO words
+uint32_t si_encode_reply(const uint8_t * reply, uint32_t len, uint32_t * words);
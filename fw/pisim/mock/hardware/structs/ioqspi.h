@@ -0,0 +1,3 @@
+#pragma once
+
+#include "pisim_hw.h"
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "pisim_hw.h"
+
+static const pio_program_t pi_program = { NULL, 0, -1 };
+
+static inline void pi_program_init(PIO pio, uint sm, uint offset)
+{
+    (void)pio;
+    (void)sm;
+    (void)offset;
+}
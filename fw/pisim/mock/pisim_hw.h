@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2022-2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+//
+// Host stand-ins for the RP2040 blocks touched by n64_pi.c.
+// The firmware source is built as C++ so PIO FIFO and SSI register
+// accesses land in these classes and can be traced by the simulator.
+//
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef unsigned int uint;
+typedef volatile uint32_t io_rw_32;
+typedef volatile uint32_t io_ro_32;
+
+#define XIP_BASE 0x10000000
+#define PPB_BASE 0xe0000000
+#define USBCTRL_BASE 0x50100000
+#define USBCTRL_IRQ 5
+#define M0PLUS_NVIC_ISER_OFFSET 0x0000e100
+#define M0PLUS_NVIC_ICER_OFFSET 0x0000e180
+#define M0PLUS_NVIC_ICPR_OFFSET 0x0000e280
+#define RESETS_RESET_USBCTRL_BITS 0x01000000
+
+#define SSI_SR_BUSY_BITS 0x00000001
+#define SSI_SR_TFNF_BITS 0x00000002
+#define SSI_SR_RFNE_BITS 0x00000008
+
+#define UART_UARTFR_RXFE_BITS 0x00000010
+#define UART_UARTFR_TXFF_BITS 0x00000020
+
+#define IO_QSPI_GPIO_QSPI_SS_CTRL_OUTOVER_VALUE_LOW 0x2
+#define IO_QSPI_GPIO_QSPI_SS_CTRL_OUTOVER_VALUE_HIGH 0x3
+#define IO_QSPI_GPIO_QSPI_SS_CTRL_OUTOVER_LSB 8
+#define IO_QSPI_GPIO_QSPI_SS_CTRL_OUTOVER_BITS 0x00000300
+
+// SSI
+
+struct sim_ssi_sr {
+    operator uint32_t() const;
+};
+
+struct sim_ssi_dr {
+    operator uint32_t();
+    sim_ssi_dr &operator=(uint32_t value);
+};
+
+struct sim_ssi_level {
+    operator uint32_t() const;
+};
+
+struct sim_ssi_enable {
+    uint32_t value;
+    operator uint32_t() const
+    {
+        return value;
+    }
+    sim_ssi_enable &operator=(uint32_t value);
+};
+
+typedef struct {
+    uint32_t ctrlr0;
+    uint32_t ctrlr1;
+    sim_ssi_enable ssienr;
+    uint32_t baudr;
+    uint32_t spi_ctrlr0;
+    sim_ssi_level txflr;
+    sim_ssi_level rxflr;
+    sim_ssi_sr sr;
+    sim_ssi_dr dr0;
+} ssi_hw_t;
+
+extern ssi_hw_t sim_ssi;
+#define ssi_hw (&sim_ssi)
+
+// QSPI pads, only written by flash_cs_force()
+
+typedef struct {
+    struct {
+        io_rw_32 status;
+        io_rw_32 ctrl;
+    } io[6];
+} ioqspi_hw_t;
+
+extern ioqspi_hw_t sim_ioqspi;
+#define ioqspi_hw (&sim_ioqspi)
+
+static inline void *hw_xor_alias_untyped(volatile void *addr)
+{
+    return (void *)addr;
+}
+
+// PIO
+
+struct sim_pio_fstat {
+    uint32_t operator&(uint32_t mask) const;
+};
+
+struct sim_pio_rx {
+    operator uint32_t();
+};
+
+struct sim_pio_tx {
+    sim_pio_tx &operator=(uint32_t value);
+};
+
+typedef struct {
+    sim_pio_fstat fstat;
+    sim_pio_tx txf[4];
+    sim_pio_rx rxf[4];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t sim_pio;
+#define pio0 (&sim_pio)
+
+typedef struct {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+static inline void pio_clear_instruction_memory(PIO pio)
+{
+    (void)pio;
+}
+
+static inline uint pio_add_program(PIO pio, const pio_program_t *program)
+{
+    (void)pio;
+    (void)program;
+    return 0;
+}
+
+static inline void pio_sm_set_enabled(PIO pio, uint sm, bool enabled)
+{
+    (void)pio;
+    (void)sm;
+    (void)enabled;
+}
+
+// UART
+
+typedef struct {
+    io_rw_32 dr;
+    io_rw_32 fr;
+} uart_hw_t;
+
+typedef struct uart_inst uart_inst_t;
+
+extern uart_hw_t sim_uart;
+#define uart0 ((uart_inst_t *)0)
+
+static inline uart_hw_t *uart_get_hw(uart_inst_t *uart)
+{
+    (void)uart;
+    return &sim_uart;
+}
+
+// Misc
+
+static inline bool gpio_get(uint gpio)
+{
+    (void)gpio;
+    return true;
+}
+
+static inline void gpio_put(uint gpio, bool value)
+{
+    (void)gpio;
+    (void)value;
+}
+
+static inline void reset_block(uint32_t bits)
+{
+    (void)bits;
+}
+
+static inline void unreset_block_wait(uint32_t bits)
+{
+    (void)bits;
+}
+
+static inline void multicore_lockout_victim_init(void)
+{
+}
+
+static inline void tight_loop_contents(void)
+{
+}
+
+static inline void __dmb(void)
+{
+}
@@ -0,0 +1,582 @@
+/**
+ * Copyright (c) 2022-2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+//
+// Host simulator for the n64_pi() bus handler.
+//
+// n64_pi.c is compiled unchanged against mock/ and fed a stream of PIO RX
+// entries exactly as the PI state machine would push them: the latched
+// address, 0 for every read strobe and (data << 16) | 1 for every write.
+// Replies written to the TX FIFO are checked against the expected data,
+// and every SSI register access is counted as the work done per halfword.
+//
+
+#include <deque>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "flashrom.h"
+#include "main.h"
+#include "n64_pi.h"
+#include "romfs/romfs.h"
+
+#define SIM_FLASH_SIZE (4 * 1024 * 1024)
+#define SIM_SSI_FIFO_DEPTH 16
+#define SIM_MAX_ERRORS 8
+
+ssi_hw_t sim_ssi;
+ioqspi_hw_t sim_ioqspi;
+pio_hw_t sim_pio;
+uart_hw_t sim_uart;
+char __flash_binary_end;
+
+static uint8_t flash_image[SIM_FLASH_SIZE];
+
+struct sim_entry {
+    uint32_t value;
+    int32_t expect;             // -1: reply not checked
+};
+
+struct sim_trace {
+    std::vector<sim_entry> stream;
+    uint32_t txns = 0;
+
+    void addr(uint32_t a)
+    {
+        stream.push_back({ a, -1 });
+        txns++;
+    }
+
+    void read(int32_t expect = -1)
+    {
+        stream.push_back({ 0, expect });
+    }
+
+    void write(uint16_t data)
+    {
+        stream.push_back({ ((uint32_t) data << 16) | 1, -1 });
+    }
+};
+
+struct sim_done {
+};
+
+static struct {
+    const sim_trace *trace;
+    size_t pos;
+    bool read_pending;
+    int32_t read_expect;
+    uint32_t read_addr;
+    uint32_t last_addr;
+
+    uint32_t served;
+    uint32_t polls;
+    uint32_t ssi_ops;
+    uint32_t ssi_cmds;
+    uint32_t ssi_frames;
+    uint32_t ssi_dropped;
+    uint32_t errors;
+} sim;
+
+static struct {
+    std::deque<uint16_t> rx;
+    bool have_addr;
+    uint32_t addr;
+} ssi_state;
+
+static void sim_error(const char *fmt, ...)
+{
+    if (sim.errors++ < SIM_MAX_ERRORS) {
+        va_list ap;
+        va_start(ap, fmt);
+        printf("  error: ");
+        vprintf(fmt, ap);
+        printf("\n");
+        va_end(ap);
+    }
+}
+
+// PIO FIFOs
+
+uint32_t sim_pio_fstat::operator&(uint32_t mask) const
+{
+    sim.polls++;
+    if (sim.pos >= sim.trace->stream.size()) {
+        throw sim_done();
+    }
+    // RX FIFO is never empty while the trace lasts
+    return 0 & mask;
+}
+
+sim_pio_rx::operator uint32_t()
+{
+    if (sim.read_pending) {
+        sim_error("read at %08X was not answered before the next PIO entry", sim.read_addr);
+        sim.read_pending = false;
+    }
+
+    const sim_entry &e = sim.trace->stream[sim.pos++];
+    if (e.value == 0) {
+        sim.read_pending = true;
+        sim.read_expect = e.expect;
+        sim.read_addr = sim.last_addr;
+        sim.last_addr += 2;
+    } else if (e.value & 1) {
+        sim.last_addr += 2;
+    } else {
+        sim.last_addr = e.value;
+    }
+    return e.value;
+}
+
+sim_pio_tx &sim_pio_tx::operator=(uint32_t value)
+{
+    if (!sim.read_pending) {
+        sim_error("TX FIFO write %04X without a read strobe (after %08X)", value & 0xffff, sim.last_addr);
+        return *this;
+    }
+    sim.read_pending = false;
+    sim.served++;
+    if (sim.read_expect >= 0 && (value & 0xffff) != (uint32_t) sim.read_expect) {
+        sim_error("read at %08X returned %04X, expected %04X", sim.read_addr, value & 0xffff, sim.read_expect);
+    }
+    return *this;
+}
+
+// SSI in continuous quad read mode
+
+static uint16_t flash_frame(uint32_t offset)
+{
+    offset %= SIM_FLASH_SIZE;
+    return (flash_image[offset] << 8) | flash_image[(offset + 1) % SIM_FLASH_SIZE];
+}
+
+sim_ssi_sr::operator uint32_t() const
+{
+    sim.ssi_ops++;
+    return SSI_SR_TFNF_BITS | (ssi_state.rx.empty() ? 0 : SSI_SR_RFNE_BITS);
+}
+
+sim_ssi_level::operator uint32_t() const
+{
+    sim.ssi_ops++;
+    return ssi_state.rx.size();
+}
+
+sim_ssi_dr::operator uint32_t()
+{
+    sim.ssi_ops++;
+    if (ssi_state.rx.empty()) {
+        sim_error("SSI RX FIFO underflow");
+        return 0;
+    }
+    uint16_t frame = ssi_state.rx.front();
+    ssi_state.rx.pop_front();
+    return frame;
+}
+
+sim_ssi_dr &sim_ssi_dr::operator=(uint32_t value)
+{
+    sim.ssi_ops++;
+    if (!ssi_state.have_addr) {
+        ssi_state.addr = value;
+        ssi_state.have_addr = true;
+        return *this;
+    }
+    ssi_state.have_addr = false;
+    sim.ssi_cmds++;
+
+    // mode switches leave their single frame behind, real reads never should
+    ssi_state.rx.clear();
+
+    uint32_t frames = sim_ssi.ctrlr1 + 1;
+    if (frames > SIM_SSI_FIFO_DEPTH) {
+        sim_error("SSI burst of %d frames overruns the RX FIFO", frames);
+        frames = SIM_SSI_FIFO_DEPTH;
+    }
+    for (uint32_t i = 0; i < frames; i++) {
+        ssi_state.rx.push_back(value == MODE_CONTINUOS_READ ? flash_frame(ssi_state.addr + i * 2) : 0);
+    }
+    sim.ssi_frames += frames;
+    return *this;
+}
+
+sim_ssi_enable &sim_ssi_enable::operator=(uint32_t enable)
+{
+    sim.ssi_ops++;
+    if (!enable) {
+        sim.ssi_dropped += ssi_state.rx.size();
+        ssi_state.rx.clear();
+        ssi_state.have_addr = false;
+    }
+    value = enable;
+    return *this;
+}
+
+// flashrom.c stand-ins
+
+void flash_spi_mode(void)
+{
+}
+
+void flash_quad_cont_read_mode(void)
+{
+    sim_ssi.ctrlr1 = 0;
+}
+
+bool flash_read(uint32_t addr, uint8_t * buffer, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        buffer[i] = flash_image[(addr + i) % SIM_FLASH_SIZE];
+    }
+    return true;
+}
+
+// expected data
+
+// the mapped file stops short of the ROM window, pages past it read flash sector 0
+#define SIM_ROM_PAGES (PI_ROM_PAGES - 64)
+
+static uint16_t sim_rom_pages[SIM_ROM_PAGES];
+
+static uint16_t rom_expect(uint32_t addr)
+{
+    uint32_t page = (addr & PI_ROM_ADDR_MASK) >> 12;
+    uint32_t sector = (page < SIM_ROM_PAGES) ? sim_rom_pages[page] : 0;
+    return flash_frame((sector << 12) | (addr & 0xfff));
+}
+
+static void rom_read(sim_trace & t, uint32_t addr, uint32_t halfwords)
+{
+    t.addr(addr);
+    for (uint32_t i = 0; i < halfwords; i++) {
+        t.read(rom_expect(addr + i * 2));
+    }
+}
+
+static void reg_write(sim_trace & t, uint32_t addr, uint32_t value)
+{
+    t.addr(addr);
+    t.write(value >> 16);
+    t.write(value & 0xffff);
+}
+
+static void reg_read(sim_trace & t, uint32_t addr, int32_t hi, int32_t lo)
+{
+    t.addr(addr);
+    t.read(hi);
+    t.read(lo);
+}
+
+// scenarios
+
+static void build_boot(sim_trace & t)
+{
+    // PIF reads the header and IPL3 a word at a time, IPL3 then DMAs 1MB of boot code
+    rom_read(t, 0x10000000, 0x40 / 2);
+    for (uint32_t a = 0x10000040; a < 0x10001000; a += 4) {
+        rom_read(t, a, 2);
+    }
+    for (uint32_t a = 0x10001000; a < 0x10101000; a += 0x80) {
+        rom_read(t, a, 0x80 / 2);
+    }
+}
+
+static void build_rom_random(sim_trace & t)
+{
+    uint32_t seed = 0x1234;
+    for (int i = 0; i < 8192; i++) {
+        seed = seed * 1103515245 + 12345;
+        rom_read(t, 0x10000000 | ((seed >> 4) & 0x7ffffc), 2);
+    }
+}
+
+static void build_rom_high(sim_trace & t)
+{
+    // past 64 MB, starting where the old mask aliased onto the pinned pages
+    rom_read(t, 0x14000000, 0x200 / 2);
+    uint32_t seed = 0x4321;
+    for (int i = 0; i < 4096; i++) {
+        seed = seed * 1103515245 + 12345;
+        rom_read(t, 0x14000000 | ((seed >> 4) & 0x3fffffc), 2);
+    }
+}
+
+static void build_rom_dma(sim_trace & t)
+{
+    // sequential DMA crossing page boundaries in the middle of a transfer
+    for (uint32_t a = 0x10200040; a < 0x10300040; a += 0x200) {
+        rom_read(t, a, 0x200 / 2);
+    }
+}
+
+static void build_rom_end(sim_trace & t)
+{
+    // sequential DMA running off the end of the file, then reads past it
+    for (uint32_t a = 0x10000000 + (SIM_ROM_PAGES << 12) - 0x1000; a < 0x10000000 + (SIM_ROM_PAGES << 12) + 0x1000; a += 0x200) {
+        rom_read(t, a, 0x200 / 2);
+    }
+    uint32_t seed = 0x5678;
+    for (int i = 0; i < 256; i++) {
+        seed = seed * 1103515245 + 12345;
+        rom_read(t, 0x10000000 + (SIM_ROM_PAGES << 12) + ((seed >> 4) & 0x3fffc), 2);
+    }
+}
+
+static void build_sram(sim_trace & t)
+{
+    for (uint32_t off = 0; off < 0x8000; off += 0x80) {
+        t.addr(0x08000000 + off);
+        for (uint32_t i = 0; i < 0x80; i += 2) {
+            t.write((off + i) ^ 0x5a5a);
+        }
+    }
+    for (uint32_t off = 0; off < 0x8000; off += 0x80) {
+        t.addr(0x08000000 + off);
+        for (uint32_t i = 0; i < 0x80; i += 2) {
+            t.read(((off + i) ^ 0x5a5a) & 0xffff);
+        }
+    }
+}
+
+static void build_flashram(sim_trace & t)
+{
+    static const uint16_t flash_id[4] = { 0x1111, 0x8001, 0x00c2, 0x001e };
+
+    reg_write(t, 0x1fd0100c, sys64_ctrl_reg | 0x200);
+
+    reg_write(t, 0x08010000, 0xe1000000);
+    t.addr(0x08000000);
+    for (int i = 0; i < 4; i++) {
+        t.read(flash_id[i]);
+    }
+
+    reg_write(t, 0x08010000, 0xb4000000);
+    t.addr(0x08000000);
+    for (int i = 0; i < 64; i++) {
+        t.write(0xf000 | i);
+    }
+    reg_write(t, 0x08010000, 0xa5000003);
+
+    reg_write(t, 0x08010000, 0xd2000000);
+    reg_read(t, 0x08000000, 0x0000, 0x0004);
+
+    // read array addresses are in halfwords
+    reg_write(t, 0x08010000, 0xf0000000);
+    t.addr(0x08000000 + 3 * 128 / 2);
+    for (int i = 0; i < 64; i++) {
+        t.read(0xf000 | i);
+    }
+
+    // chip erase clears one 4K page per status read after the first,
+    // the trace ends halfway through it
+    reg_write(t, 0x08010000, 0x3c000000);
+    reg_write(t, 0x08010000, 0x78000000);
+    for (int i = 0; i < 15; i++) {
+        reg_read(t, 0x08000000, 0x0000, 0x0002);
+    }
+
+    reg_write(t, 0x1fd0100c, sys64_ctrl_reg);
+}
+
+static bool check_flashram(void)
+{
+    // a page is dirty from the moment it is erased, a flush may run in between
+    for (uint32_t page = 0; page < SRAM_1MBIT_SIZE / ROMFS_FLASH_SECTOR; page++) {
+        if (pi_save_dirty[page] != (page <= 15)) {
+            printf("flashram: save page %u is %s during chip erase\n", page, pi_save_dirty[page] ? "dirty" : "clean");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void build_regs(sim_trace & t)
+{
+    uint32_t fw_size = (uintptr_t) & __flash_binary_end - XIP_BASE;
+
+    for (int i = 0; i < 256; i++) {
+        reg_read(t, 0x1fd01018, (fw_size >> 16) & 0xffff, fw_size & 0xffff);
+        reg_read(t, 0x1fd01000, 0, 0x00f2);
+        reg_read(t, 0x1fd0101c, 0, PI_FW_CAPS_ROM_EXTENTS);
+        reg_write(t, 0x1fd01008, i & 1);
+        reg_read(t, 0x1fd01008, 0, i & 1);
+        reg_read(t, 0x1fd01100, 0xdead, 0xbeef);
+    }
+}
+
+static void build_stats(sim_trace & t)
+{
+    reg_write(t, 0x1fd01040, 0);
+    for (int i = 0; i < 4; i++) {
+        rom_read(t, 0x10400000 + i * 0x100, 2);
+    }
+    reg_read(t, 0x08000000, -1, -1);
+    reg_read(t, 0x1fd01100, 0xdead, 0xbeef);
+#if PI_STATS
+    reg_read(t, 0x1fd01040, 0, 8);
+    reg_read(t, 0x1fd01044, 0, 1);
+    reg_read(t, 0x1fd01048, 0, 0);
+    reg_read(t, 0x1fd0104c, 0, 1);
+#endif
+}
+
+static bool load_trace(const char *path, sim_trace & t)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    char line[512];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *p = line;
+        char op = *p++;
+        if (op == '#' || op == '\n' || op == '\0') {
+            continue;
+        }
+
+        char *end;
+        do {
+            unsigned long v = strtoul(p, &end, 16);
+            if (end == p) {
+                break;
+            }
+            p = end;
+            if (op == 'A') {
+                t.addr(v);
+            } else if (op == 'R') {
+                for (unsigned long i = 0; i < v; i++) {
+                    t.read();
+                }
+            } else if (op == 'E') {
+                t.read(v & 0xffff);
+            } else if (op == 'W') {
+                t.write(v);
+            } else {
+                fprintf(stderr, "%s:%d: unknown op '%c'\n", path, lineno, op);
+                fclose(f);
+                return false;
+            }
+        } while (true);
+    }
+
+    fclose(f);
+    return true;
+}
+
+static bool run(const char *name, const sim_trace & t)
+{
+    memset(&sim, 0, sizeof(sim));
+    sim.trace = &t;
+    ssi_state.rx.clear();
+    ssi_state.have_addr = false;
+    sim_ssi.ctrlr1 = 0;
+    memset((void *)pi_save_dirty, 0, sizeof(pi_save_dirty));
+
+    try {
+        n64_pi();
+    } catch(const sim_done &) {
+    }
+
+    if (sim.read_pending) {
+        sim_error("read at %08X was never answered", sim.read_addr);
+    }
+
+    double hw = sim.served ? sim.served : 1;
+    printf("%-12s %7u %9u %9u %10.2f %9.2f %8u %6u\n", name, t.txns, sim.served, sim.ssi_cmds, sim.ssi_ops / hw, sim.polls / hw, sim.ssi_dropped, sim.errors);
+
+    return sim.errors == 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n] [trace file]\n", prog);
+    fprintf(stderr, "  -n  don't pin the first ROM pages in RAM\n");
+    fprintf(stderr, "Trace lines: A <addr> | R <count> | E <data>... | W <data>... (hex)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool hot_pages = true;
+    const char *trace_file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n")) {
+            hot_pages = false;
+        } else if (argv[i][0] == '-' || trace_file) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            trace_file = argv[i];
+        }
+    }
+
+    uint32_t seed = 0xcafe;
+    for (int i = 0; i < SIM_FLASH_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        flash_image[i] = seed >> 16;
+    }
+
+    // UART idle: nothing received, room to transmit
+    sim_uart.fr = UART_UARTFR_RXFE_BITS;
+
+    // scatter the ROM over flash in runs of 8 sectors, the way romfs would
+    for (int page = 0; page < SIM_ROM_PAGES; page++) {
+        sim_rom_pages[page] = (((page >> 3) * 37 + 11) * 8 + (page & 7)) % (SIM_FLASH_SIZE / ROMFS_FLASH_SECTOR);
+    }
+    pi_rom_map_reset();
+    if (!pi_rom_map_append(0, sim_rom_pages, SIM_ROM_PAGES) || !pi_rom_map_end(SIM_ROM_PAGES)) {
+        fprintf(stderr, "ROM map does not fit\n");
+        return 1;
+    }
+    if (hot_pages) {
+        load_rom_hot_pages();
+    }
+
+    printf("%-12s %7s %9s %9s %10s %9s %8s %6s\n", "scenario", "txns", "halfwords", "ssi-cmds", "ssi-ops/hw", "polls/hw", "dropped", "errors");
+
+    bool ok = true;
+    if (trace_file) {
+        sim_trace t;
+        if (!load_trace(trace_file, t)) {
+            return 1;
+        }
+        ok = run(trace_file, t);
+    } else {
+        static const struct {
+            const char *name;
+            void (*build)(sim_trace &);
+            bool (*check)(void);
+        } scenarios[] = {
+            { "boot", build_boot, NULL },
+            { "rom-random", build_rom_random, NULL },
+            { "rom-high", build_rom_high, NULL },
+            { "rom-dma", build_rom_dma, NULL },
+            { "rom-end", build_rom_end, NULL },
+            { "sram", build_sram, NULL },
+            { "flashram", build_flashram, check_flashram },
+            { "registers", build_regs, NULL },
+            { "stats", build_stats, NULL },
+        };
+
+        for (const auto &s : scenarios) {
+            sim_trace t;
+            s.build(t);
+            ok = run(s.name, t) && ok;
+            if (s.check) {
+                ok = s.check() && ok;
+            }
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,871 @@
+/**
+ * Copyright (c) 2022-2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+//
+// Host simulator for the SI EEPROM command path.
+//
+// The si program is assembled from n64_si.pio when sisim starts and run by
+// a small PIO interpreter with 4 deep RX and TX FIFOs, autopush at 8 and
+// autopull at 32 as si_program_init() sets them. si_tick is stood in for by
+// one IRQ 4 per sample slot. The C side follows si_pio_callback(): it drains
+// the RX FIFO into si_frame_push(), queues the reply from si_encode_reply()
+// and tops the TX FIFO up while the cells go out. Every reply is compared
+// with the sample patterns the old GPIO IRQ handler produced.
+//
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "n64_si_cmd.h"
+
+#define SIM_EEPROM_SIZE 2048
+#define SIM_MAX_ERRORS 8
+
+// PIO FIFO depth with the RX and TX FIFOs kept apart
+#define SIM_FIFO_DEPTH 4
+// instructions one sample slot may run before the program counts as stuck
+#define SIM_STEPS_MAX 64
+// idle slots after a console frame, room for the longest reply
+#define SIM_REPLY_SLOTS (4 * (SI_REPLY_MAX * 8 + 1) + 64)
+// sample slots a TX refill is held off in read-late, well inside the 48 cells queued words cover
+#define SIM_TX_LATENCY 128
+
+static uint8_t eeprom[SIM_EEPROM_SIZE];
+
+static struct {
+    uint32_t frames;
+    uint32_t replies;
+    uint32_t cells;
+    uint32_t words;
+    uint32_t refills;
+    uint32_t errors;
+} sim;
+
+static void sim_error(const char *fmt, ...)
+{
+    if (sim.errors++ < SIM_MAX_ERRORS) {
+        va_list ap;
+        va_start(ap, fmt);
+        printf("  error: ");
+        vprintf(fmt, ap);
+        printf("\n");
+        va_end(ap);
+    }
+}
+
+// the subset of pioasm the si program needs, encoded as the hardware sees it
+
+struct pio_program {
+    std::vector<uint16_t> code;
+    std::map<std::string, uint32_t> labels;
+    uint32_t wrap_bottom;
+    uint32_t wrap_top;
+};
+
+static bool pio_lookup(const std::map<std::string, uint32_t> &names, const std::string &name, uint32_t *value)
+{
+    auto it = names.find(name);
+    if (it == names.end()) {
+        return false;
+    }
+    *value = it->second;
+    return true;
+}
+
+static bool pio_number(const std::string &s, uint32_t *value)
+{
+    char *end;
+
+    *value = strtoul(s.c_str(), &end, 0);
+    return !s.empty() && *end == '\0';
+}
+
+static bool pio_encode(const std::vector<std::string> &t, const pio_program &prog, uint16_t *op)
+{
+    static const std::map<std::string, uint32_t> jmp_cond = {
+        { "!x", 1 }, { "x--", 2 }, { "!y", 3 }, { "y--", 4 }, { "x!=y", 5 }, { "pin", 6 }, { "!osre", 7 },
+    };
+    static const std::map<std::string, uint32_t> wait_src = { { "gpio", 0 }, { "pin", 1 }, { "irq", 2 } };
+    static const std::map<std::string, uint32_t> in_src = {
+        { "pins", 0 }, { "x", 1 }, { "y", 2 }, { "null", 3 }, { "isr", 6 }, { "osr", 7 },
+    };
+    static const std::map<std::string, uint32_t> out_dest = {
+        { "pins", 0 }, { "x", 1 }, { "y", 2 }, { "null", 3 }, { "pindirs", 4 }, { "pc", 5 }, { "isr", 6 }, { "exec", 7 },
+    };
+    static const std::map<std::string, uint32_t> mov_dest = {
+        { "pins", 0 }, { "x", 1 }, { "y", 2 }, { "exec", 4 }, { "pc", 5 }, { "isr", 6 }, { "osr", 7 },
+    };
+    static const std::map<std::string, uint32_t> mov_src = {
+        { "pins", 0 }, { "x", 1 }, { "y", 2 }, { "null", 3 }, { "status", 5 }, { "isr", 6 }, { "osr", 7 },
+    };
+    static const std::map<std::string, uint32_t> set_dest = { { "pins", 0 }, { "x", 1 }, { "y", 2 }, { "pindirs", 4 } };
+
+    uint32_t a, b, c;
+    const std::string &name = t[0];
+
+    if (name == "jmp" && (t.size() == 2 || t.size() == 3)) {
+        a = 0;
+        if (t.size() == 3 && !pio_lookup(jmp_cond, t[1], &a)) {
+            return false;
+        }
+        if (!pio_lookup(prog.labels, t.back(), &b) && !pio_number(t.back(), &b)) {
+            return false;
+        }
+        *op = 0x0000 | a << 5 | b;
+    } else if (name == "wait" && t.size() == 4 && pio_number(t[1], &a) && pio_lookup(wait_src, t[2], &b) && pio_number(t[3], &c)) {
+        *op = 0x2000 | a << 7 | b << 5 | c;
+    } else if (name == "in" && t.size() == 3 && pio_lookup(in_src, t[1], &a) && pio_number(t[2], &b)) {
+        *op = 0x4000 | a << 5 | (b & 31);
+    } else if (name == "out" && t.size() == 3 && pio_lookup(out_dest, t[1], &a) && pio_number(t[2], &b)) {
+        *op = 0x6000 | a << 5 | (b & 31);
+    } else if ((name == "push" || name == "pull") && t.size() <= 3) {
+        *op = (name == "push") ? 0x8000 : 0x8080;
+        bool block = true;
+        for (size_t i = 1; i < t.size(); i++) {
+            if (t[i] == "iffull" || t[i] == "ifempty") {
+                *op |= 0x40;
+            } else if (t[i] == "noblock") {
+                block = false;
+            } else if (t[i] != "block") {
+                return false;
+            }
+        }
+        *op |= block ? 0x20 : 0;
+    } else if (name == "mov" && t.size() == 3 && pio_lookup(mov_dest, t[1], &a)) {
+        std::string src = t[2];
+        b = 0;
+        if (src[0] == '~' || src[0] == '!') {
+            b = 1;
+            src = src.substr(1);
+        } else if (src.compare(0, 2, "::") == 0) {
+            b = 2;
+            src = src.substr(2);
+        }
+        if (!pio_lookup(mov_src, src, &c)) {
+            return false;
+        }
+        *op = 0xa000 | a << 5 | b << 3 | c;
+    } else if (name == "irq" && (t.size() == 2 || t.size() == 3) && pio_number(t.back(), &a)) {
+        *op = 0xc000 | a;
+        if (t.size() == 3) {
+            if (t[1] == "clear") {
+                *op |= 0x40;
+            } else if (t[1] == "wait") {
+                *op |= 0x20;
+            } else if (t[1] != "set" && t[1] != "nowait") {
+                return false;
+            }
+        }
+    } else if (name == "set" && t.size() == 3 && pio_lookup(set_dest, t[1], &a) && pio_number(t[2], &b)) {
+        *op = 0xe000 | a << 5 | b;
+    } else if (name == "nop" && t.size() == 1) {
+        *op = 0xa042;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static bool pio_assemble(const char *path, const char *program, pio_program &prog)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("can't open %s\n", path);
+        return false;
+    }
+
+    std::vector<std::vector<std::string> > lines;
+    std::vector<int> line_numbers;
+    bool in_program = false;
+    bool in_block = false;
+    char buf[256];
+    int line_number = 0;
+
+    prog.code.clear();
+    prog.labels.clear();
+    prog.wrap_bottom = 0;
+    prog.wrap_top = ~0u;
+
+    while (fgets(buf, sizeof(buf), f)) {
+        line_number++;
+
+        // % c-sdk { ... %} blocks are C for the SDK build
+        if (buf[0] == '%') {
+            in_block = strncmp(buf, "%}", 2) != 0;
+            continue;
+        }
+        char *comment = strchr(buf, ';');
+        if (in_block) {
+            continue;
+        }
+        if (comment) {
+            *comment = '\0';
+        }
+
+        std::vector<std::string> t;
+        for (char *s = strtok(buf, " \t\r\n,"); s; s = strtok(NULL, " \t\r\n,")) {
+            t.push_back(s);
+        }
+        if (t.empty()) {
+            continue;
+        }
+
+        if (t[0] == ".program") {
+            in_program = t.size() == 2 && t[1] == program;
+            continue;
+        }
+        if (!in_program) {
+            continue;
+        }
+
+        if (t[0] == ".wrap_target") {
+            prog.wrap_bottom = lines.size();
+        } else if (t[0] == ".wrap") {
+            prog.wrap_top = lines.size() - 1;
+        } else if (t[0][0] == '.') {
+            printf("%s:%d: %s is not supported\n", path, line_number, t[0].c_str());
+            fclose(f);
+            return false;
+        } else {
+            if (t[0] == "public") {
+                t.erase(t.begin());
+            }
+            if (!t.empty() && t[0].back() == ':') {
+                prog.labels[t[0].substr(0, t[0].size() - 1)] = lines.size();
+                t.erase(t.begin());
+            }
+            if (!t.empty()) {
+                lines.push_back(t);
+                line_numbers.push_back(line_number);
+            }
+        }
+    }
+    fclose(f);
+
+    if (lines.empty() || lines.size() > 32) {
+        printf("%s: program %s has %u instructions\n", path, program, (uint32_t) lines.size());
+        return false;
+    }
+    if (prog.wrap_top == ~0u) {
+        prog.wrap_top = lines.size() - 1;
+    }
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        uint16_t op;
+        if (!pio_encode(lines[i], prog, &op)) {
+            printf("%s:%d: can't assemble %s\n", path, line_numbers[i], lines[i][0].c_str());
+            return false;
+        }
+        prog.code.push_back(op);
+    }
+
+    return true;
+}
+
+// one state machine on the SI data pin, which is pin 0 for in, out, set and jmp
+
+static pio_program si_prog;
+
+static struct {
+    uint32_t pc;
+    uint32_t x;
+    uint32_t y;
+    uint32_t isr;
+    uint32_t isr_count;
+    uint32_t osr;
+    uint32_t osr_count;
+    bool pindir;
+    uint8_t irq;
+    std::deque<uint32_t> rx;
+    std::deque<uint32_t> tx;
+} sm;
+
+static void sm_reset(void)
+{
+    sm.pc = si_prog.labels["rx_wait"];
+    sm.x = 0;
+    sm.y = 0;
+    sm.isr = 0;
+    sm.isr_count = 0;
+    sm.osr = 0;
+    sm.osr_count = 32;
+    sm.pindir = false;
+    sm.irq = 0;
+    sm.rx.clear();
+    sm.tx.clear();
+}
+
+static bool sm_pull(void)
+{
+    if (sm.tx.empty()) {
+        return false;
+    }
+    sm.osr = sm.tx.front();
+    sm.osr_count = 0;
+    sm.tx.pop_front();
+    return true;
+}
+
+static uint32_t sm_source(uint32_t src, bool pin)
+{
+    switch (src) {
+    case 0:
+        return pin;
+    case 1:
+        return sm.x;
+    case 2:
+        return sm.y;
+    case 6:
+        return sm.isr;
+    case 7:
+        return sm.osr;
+    default:
+        return 0;
+    }
+}
+
+// executes one instruction, false when it stalls
+static bool sm_step(bool level)
+{
+    uint16_t op = si_prog.code[sm.pc];
+    uint32_t next = (sm.pc == si_prog.wrap_top) ? si_prog.wrap_bottom : sm.pc + 1;
+    uint32_t n = (op & 31) ? (op & 31) : 32;
+    uint32_t mask = (n == 32) ? ~0u : ((1u << n) - 1);
+    // open drain: the pin is low whenever the state machine drives it
+    bool pin = level && !sm.pindir;
+
+    if (op & 0x1f00) {
+        sim_error("%04X at %u: delay and side-set are not modelled", op, sm.pc);
+        return false;
+    }
+
+    switch (op >> 13) {
+    case 0:                    // jmp
+        {
+            bool take;
+            switch ((op >> 5) & 7) {
+            case 0:
+                take = true;
+                break;
+            case 1:
+                take = !sm.x;
+                break;
+            case 2:
+                take = sm.x--;
+                break;
+            case 3:
+                take = !sm.y;
+                break;
+            case 4:
+                take = sm.y--;
+                break;
+            case 5:
+                take = sm.x != sm.y;
+                break;
+            case 6:
+                take = pin;
+                break;
+            default:
+                take = sm.osr_count < 32;
+                break;
+            }
+            sm.pc = take ? (op & 31) : next;
+            return true;
+        }
+    case 1:                    // wait
+        if (((op >> 5) & 3) == 1) {
+            if (((op & 31) ? false : pin) != (bool)(op & 0x80)) {
+                return false;
+            }
+        } else if (((op >> 5) & 3) == 2) {
+            uint8_t bit = 1 << (op & 7);
+            if (op & 0x80) {
+                if (!(sm.irq & bit)) {
+                    return false;
+                }
+                sm.irq &= ~bit;
+            } else if (sm.irq & bit) {
+                return false;
+            }
+        } else {
+            sim_error("%04X at %u: wait gpio is not modelled", op, sm.pc);
+            return false;
+        }
+        break;
+    case 2:                    // in, autopush at 8
+        if (sm.isr_count + n >= 8 && sm.rx.size() == SIM_FIFO_DEPTH) {
+            return false;
+        }
+        sm.isr = (n == 32) ? sm_source((op >> 5) & 7, pin) : (sm.isr << n) | (sm_source((op >> 5) & 7, pin) & mask);
+        sm.isr_count = (sm.isr_count + n > 32) ? 32 : sm.isr_count + n;
+        if (sm.isr_count >= 8) {
+            sm.rx.push_back(sm.isr);
+            sm.isr = 0;
+            sm.isr_count = 0;
+        }
+        break;
+    case 3:                    // out, autopull at 32
+        {
+            if (sm.osr_count >= 32 && !sm_pull()) {
+                return false;
+            }
+            uint32_t data = (n == 32) ? sm.osr : sm.osr >> (32 - n);
+            sm.osr = (n == 32) ? 0 : sm.osr << n;
+            sm.osr_count = (sm.osr_count + n > 32) ? 32 : sm.osr_count + n;
+            switch ((op >> 5) & 7) {
+            case 1:
+                sm.x = data;
+                break;
+            case 2:
+                sm.y = data;
+                break;
+            case 3:
+                break;
+            case 4:
+                sm.pindir = data & 1;
+                break;
+            default:
+                sim_error("%04X at %u: out destination is not modelled", op, sm.pc);
+                return false;
+            }
+            // the OSR is refilled as soon as it runs empty
+            if (sm.osr_count >= 32) {
+                sm_pull();
+            }
+        }
+        break;
+    case 4:                    // push, pull
+        if (op & 0x80) {
+            if (!(op & 0x40) || sm.osr_count >= 32) {
+                if (!sm_pull()) {
+                    if (op & 0x20) {
+                        return false;
+                    }
+                    sm.osr = sm.x;
+                }
+            }
+        } else if (!(op & 0x40) || sm.isr_count >= 8) {
+            if (sm.rx.size() == SIM_FIFO_DEPTH) {
+                if (op & 0x20) {
+                    return false;
+                }
+            } else {
+                sm.rx.push_back(sm.isr);
+            }
+            sm.isr = 0;
+            sm.isr_count = 0;
+        }
+        break;
+    case 5:                    // mov
+        {
+            uint32_t data = ((op & 7) == 3) ? 0 : sm_source(op & 7, pin);
+            if (((op >> 3) & 3) == 1) {
+                data = ~data;
+            } else if (((op >> 3) & 3) == 2) {
+                uint32_t rev = 0;
+                for (int i = 0; i < 32; i++) {
+                    rev |= ((data >> i) & 1) << (31 - i);
+                }
+                data = rev;
+            }
+            switch ((op >> 5) & 7) {
+            case 1:
+                sm.x = data;
+                break;
+            case 2:
+                sm.y = data;
+                break;
+            case 5:
+                sm.pc = data & 31;
+                return true;
+            case 6:
+                sm.isr = data;
+                sm.isr_count = 0;
+                break;
+            case 7:
+                sm.osr = data;
+                sm.osr_count = 0;
+                break;
+            default:
+                sim_error("%04X at %u: mov destination is not modelled", op, sm.pc);
+                return false;
+            }
+        }
+        break;
+    case 6:                    // irq
+        if (op & 0x20) {
+            sim_error("%04X at %u: irq wait is not modelled", op, sm.pc);
+            return false;
+        }
+        if (op & 0x40) {
+            sm.irq &= ~(1 << (op & 7));
+        } else {
+            sm.irq |= 1 << (op & 7);
+        }
+        break;
+    default:                   // set
+        switch ((op >> 5) & 7) {
+        case 1:
+            sm.x = op & 31;
+            break;
+        case 2:
+            sm.y = op & 31;
+            break;
+        case 4:
+            sm.pindir = op & 1;
+            break;
+        default:
+            sim_error("%04X at %u: set destination is not modelled", op, sm.pc);
+            return false;
+        }
+        break;
+    }
+
+    sm.pc = next;
+    return true;
+}
+
+// runs until the program waits, it is far faster than a sample slot
+static void sm_run(bool level)
+{
+    for (int i = 0; i < SIM_STEPS_MAX; i++) {
+        if (!sm_step(level)) {
+            return;
+        }
+    }
+    sim_error("si program runs away at %u", sm.pc);
+}
+
+// the C side, as si_pio_callback() does it
+
+static struct {
+    struct si_frame frame;
+    struct si_frame last_frame;
+    bool eeprom_16k;
+    bool complete;
+    uint8_t reply[SI_REPLY_MAX];
+    uint32_t len;
+    int write_offset;
+    uint32_t words[SI_REPLY_WORDS];
+    uint32_t count;
+    uint32_t pos;
+    bool tx_irq;
+    uint32_t refills;
+    // sample slots the TX not full interrupt is held off, and how long it has been pending
+    uint32_t tx_latency;
+    uint32_t tx_wait;
+} cpu;
+
+static uint32_t cpu_fill(void)
+{
+    uint32_t queued = 0;
+
+    while (cpu.pos < cpu.count && sm.tx.size() < SIM_FIFO_DEPTH) {
+        sm.tx.push_back(cpu.words[cpu.pos++]);
+        queued++;
+    }
+    cpu.tx_irq = cpu.pos < cpu.count;
+    cpu.tx_wait = 0;
+
+    return queued;
+}
+
+static void cpu_service(void)
+{
+    bool tx_due = cpu.tx_irq && sm.tx.size() < SIM_FIFO_DEPTH && cpu.tx_wait >= cpu.tx_latency;
+
+    if (!tx_due && sm.rx.empty()) {
+        return;
+    }
+
+    cpu.refills += cpu_fill();
+
+    while (!sm.rx.empty()) {
+        uint32_t word = sm.rx.front();
+        sm.rx.pop_front();
+        if (cpu.complete) {
+            sim_error("RX FIFO word %08X after the end of the frame", word);
+        }
+        if (!si_frame_push(&cpu.frame, word)) {
+            continue;
+        }
+
+        cpu.complete = true;
+        cpu.last_frame = cpu.frame;
+        cpu.len = si_eeprom_command(&cpu.frame, eeprom, cpu.eeprom_16k, cpu.reply, &cpu.write_offset);
+        cpu.count = si_encode_reply(cpu.reply, cpu.len, cpu.words);
+        if (cpu.count > SI_REPLY_WORDS) {
+            sim_error("reply takes %u words", cpu.count);
+            cpu.count = 0;
+        }
+        cpu.pos = 0;
+        cpu_fill();
+
+        cpu.frame.len = 0;
+        cpu.frame.overflow = false;
+    }
+}
+
+// line samples of a console frame up to its stop bit: 0 is 0001, 1 is 0111, the stop bit is 0111
+static std::vector<uint8_t> console_samples(const std::vector<uint8_t> &bytes)
+{
+    std::vector<uint8_t> line(5, 1);
+
+    for (uint8_t b : bytes) {
+        for (int i = 7; i >= 0; i--) {
+            uint8_t bit = (b >> i) & 1;
+            line.insert(line.end(), { 0, bit, bit, 1 });
+        }
+    }
+    line.insert(line.end(), { 0, 1, 1, 1 });
+
+    return line;
+}
+
+// what the GPIO IRQ handler sent: 0 is 0001, 1 is 0111 and the stop bit is 0011
+static std::vector<uint8_t> legacy_samples(const uint8_t *reply, uint32_t len)
+{
+    std::vector<uint8_t> line;
+
+    for (uint32_t i = 0; i < len; i++) {
+        for (int j = 7; j >= 0; j--) {
+            uint8_t bit = (reply[i] >> j) & 1;
+            line.insert(line.end(), { 0, bit, bit, 1 });
+        }
+    }
+    if (len) {
+        line.insert(line.end(), { 0, 0, 1, 1 });
+    }
+
+    return line;
+}
+
+// one console frame and the reply, the cart's side of the line is returned per sample slot
+static uint32_t transact(const std::vector<uint8_t> &cmd, bool eeprom_16k, uint8_t *reply, int *write_offset)
+{
+    std::vector<uint8_t> line = console_samples(cmd);
+    size_t frame_slots = line.size();
+    std::vector<uint8_t> cart;
+
+    line.insert(line.end(), SIM_REPLY_SLOTS, 1);
+
+    cpu.eeprom_16k = eeprom_16k;
+    cpu.complete = false;
+    cpu.refills = 0;
+    cpu.len = 0;
+    cpu.write_offset = -1;
+
+    for (uint8_t level : line) {
+        // the line moves between SI_CLK edges, the sample slot starts after it
+        sm_run(level);
+        cpu_service();
+        sm.irq |= 1 << 4;
+        sm_run(level);
+        cpu_service();
+        if (cpu.tx_irq && sm.tx.size() < SIM_FIFO_DEPTH) {
+            cpu.tx_wait++;
+        }
+        cart.push_back(!sm.pindir);
+    }
+
+    sim.frames++;
+    if (!cpu.complete) {
+        sim_error("frame %02X was not completed", cmd.empty() ? 0 : cmd[0]);
+        return 0;
+    }
+    if (sm.pc != si_prog.labels["rx_wait"] || !sm.tx.empty() || cpu.tx_irq) {
+        sim_error("frame %02X left the program at %u with %u TX words", cmd[0], sm.pc, (uint32_t) sm.tx.size());
+    }
+
+    const struct si_frame &frame = cpu.last_frame;
+    if (!frame.overflow && (frame.len != cmd.size() || memcmp(frame.data, cmd.data(), frame.len))) {
+        sim_error("frame %02X came in as %u bytes", cmd[0], frame.len);
+    }
+
+    uint32_t len = cpu.len;
+    memcpy(reply, cpu.reply, len);
+    *write_offset = cpu.write_offset;
+
+    // silent during the frame, then the reply and nothing after it
+    std::vector<uint8_t> expect = legacy_samples(reply, len);
+    size_t start = frame_slots;
+    while (start < cart.size() && cart[start]) {
+        start++;
+    }
+    for (size_t i = 0; i < frame_slots; i++) {
+        if (!cart[i]) {
+            sim_error("frame %02X: the cart drove the line while the console sent", cmd[0]);
+            break;
+        }
+    }
+    if (start + expect.size() > cart.size() || !std::equal(expect.begin(), expect.end(), cart.begin() + start)) {
+        sim_error("reply to %02X does not match the GPIO handler", cmd[0]);
+    } else if (std::find(cart.begin() + start + expect.size(), cart.end(), 0) != cart.end()) {
+        sim_error("reply to %02X runs past its stop bit", cmd[0]);
+    }
+
+    sim.replies += len ? 1 : 0;
+    sim.cells += cpu.words[0];
+    sim.words += cpu.count;
+    sim.refills += cpu.refills;
+
+    return len;
+}
+
+static void check_status(void)
+{
+    uint8_t reply[SI_REPLY_MAX];
+    int write_offset;
+
+    for (uint8_t cmd : { 0x00, 0xff }) {
+        for (bool eeprom_16k : { false, true }) {
+            uint32_t len = transact({ cmd }, eeprom_16k, reply, &write_offset);
+            if (len != 3 || reply[0] != 0x00 || reply[1] != (eeprom_16k ? 0xc0 : 0x80) || reply[2] != 0x00) {
+                sim_error("status %02X (%s) answered %u bytes", cmd, eeprom_16k ? "16K" : "4K", len);
+            }
+            if (write_offset != -1) {
+                sim_error("status %02X wrote the EEPROM", cmd);
+            }
+        }
+    }
+}
+
+static void check_read(void)
+{
+    uint8_t reply[SI_REPLY_MAX];
+    int write_offset;
+
+    for (uint32_t block = 0; block < 256; block++) {
+        uint32_t len = transact({ 0x04, (uint8_t) block }, true, reply, &write_offset);
+        if (len != 8 || memcmp(reply, &eeprom[block * 8], 8)) {
+            sim_error("read of block %u returned wrong data", block);
+        }
+        // SI_REPLY_WORDS is more than the TX FIFO holds
+        if (!cpu.refills) {
+            sim_error("read of block %u went out without a TX refill", block);
+        }
+    }
+}
+
+static void check_read_late(void)
+{
+    // the USB and flash job interrupts share the priority, a refill may wait its turn
+    cpu.tx_latency = SIM_TX_LATENCY;
+    check_read();
+    cpu.tx_latency = 0;
+}
+
+static void check_write(void)
+{
+    uint8_t reply[SI_REPLY_MAX];
+    int write_offset;
+
+    for (uint32_t block = 0; block < 256; block += 17) {
+        std::vector<uint8_t> cmd = { 0x05, (uint8_t) block };
+        for (int i = 0; i < 8; i++) {
+            cmd.push_back(block * 3 + i * 29);
+        }
+
+        uint32_t len = transact(cmd, true, reply, &write_offset);
+        if (len != 1 || reply[0] != 0x00) {
+            sim_error("write of block %u answered %u bytes", block, len);
+        }
+        if (write_offset != (int)block * 8 || memcmp(&eeprom[block * 8], &cmd[2], 8)) {
+            sim_error("write of block %u landed at %d", block, write_offset);
+        }
+
+        len = transact({ 0x04, (uint8_t) block }, true, reply, &write_offset);
+        if (len != 8 || memcmp(reply, &cmd[2], 8)) {
+            sim_error("block %u did not read back", block);
+        }
+    }
+}
+
+static void check_bad_frames(void)
+{
+    uint8_t reply[SI_REPLY_MAX];
+    int write_offset;
+    uint8_t before[SIM_EEPROM_SIZE];
+
+    memcpy(before, eeprom, sizeof(before));
+
+    const std::vector<uint8_t> frames[] = {
+        { 0x01 },
+        { 0x04 },
+        { 0x05, 0x10, 1, 2, 3 },
+        { 0x05, 0x10, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    };
+
+    for (const auto &cmd : frames) {
+        if (transact(cmd, true, reply, &write_offset) != 0 || write_offset != -1) {
+            sim_error("frame %02X of %u bytes was answered", cmd[0], (uint32_t) cmd.size());
+        }
+    }
+
+    if (memcmp(before, eeprom, sizeof(before))) {
+        sim_error("a bad frame changed the EEPROM");
+    }
+}
+
+static bool run(const char *name, void (*check)(void))
+{
+    memset(&sim, 0, sizeof(sim));
+    memset(&cpu, 0, sizeof(cpu));
+    sm_reset();
+
+    check();
+
+    printf("%-12s %7u %8u %8u %8u %8u %6u\n", name, sim.frames, sim.replies, sim.cells, sim.words, sim.refills, sim.errors);
+
+    return sim.errors == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *pio_file = (argc > 1) ? argv[1] : "../n64_si.pio";
+
+    if (argc > 2) {
+        printf("usage: %s [n64_si.pio]\n", argv[0]);
+        return 1;
+    }
+    if (!pio_assemble(pio_file, "si", si_prog) || !si_prog.labels.count("rx_wait")) {
+        return 1;
+    }
+
+    uint32_t seed = 0xcafe;
+    for (int i = 0; i < SIM_EEPROM_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        eeprom[i] = seed >> 16;
+    }
+
+    printf("%-12s %7s %8s %8s %8s %8s %6s\n", "scenario", "frames", "replies", "cells", "words", "refills", "errors");
+
+    static const struct {
+        const char *name;
+        void (*check)(void);
+    } scenarios[] = {
+        { "status", check_status },
+        { "read", check_read },
+        { "read-late", check_read_late },
+        { "write", check_write },
+        { "bad-frames", check_bad_frames },
+    };
+
+    bool ok = true;
+    for (const auto &s : scenarios) {
+        ok = run(s.name, s.check) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
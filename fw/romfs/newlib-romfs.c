@@ -416,6 +416,33 @@ static int romfs_fs_findnext(dir_t *dir)
     return -1;
 }
 
+int newlib_romfs_dir_entry(const dir_t *dir, romfs_entry *entry)
+{
+    if (!dir || !entry) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    romfs_dir_cookie_t *cookie = get_cookie(dir->d_cookie);
+    if (!cookie) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *entry = cookie->iter.entry;
+    return 0;
+}
+
+void newlib_romfs_dir_close(dir_t *dir)
+{
+    if (!dir) {
+        return;
+    }
+
+    release_cookie(dir->d_cookie);
+    dir->d_cookie = 0;
+}
+
 int newlib_romfs_init(void)
 {
     memset(romfs_dir_cookies, 0, sizeof(romfs_dir_cookies));
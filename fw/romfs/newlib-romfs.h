@@ -2,6 +2,9 @@
 #define __NEWLIB_ROMFS_H__
 
 #include <sys/types.h>
+#include <dir.h>
+
+#include "romfs.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -9,6 +12,11 @@ extern "C" {
 
 int newlib_romfs_init(void);
 
+/* Full ROMFS entry for the item last returned by dir_findfirst/dir_findnext */
+int newlib_romfs_dir_entry(const dir_t *dir, romfs_entry *entry);
+/* Release the iterator when a listing is abandoned before the end */
+void newlib_romfs_dir_close(dir_t *dir);
+
 #ifdef __cplusplus
 }
 #endif
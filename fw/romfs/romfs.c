@@ -46,6 +46,20 @@ static uint32_t flash_list_size = 0;
 static uint16_t *flash_map_int;
 static uint8_t *flash_list_int;
 
+#define ROMFS_MAP_PAGE_ENTRIES (ROMFS_FLASH_SECTOR / sizeof(uint16_t))
+#define ROMFS_MAP_PAGES_MAX    (32)
+
+static bool flash_map_lazy;
+static uint32_t flash_map_loaded;
+static uint32_t flash_map_dirty;
+
+static bool romfs_free_valid;
+static uint32_t romfs_free_cached;
+
+static romfs_sector_copy_fn romfs_sector_copy;
+
+static romfs_write_stats write_stats;
+
 static bool romfs_garbage_collect(void);
 #define ROMFS_DIR_FILTER_ANY 0xff
 #define ROMFS_LIST_INCLUDE_FILES 0x01
@@ -54,7 +68,25 @@ static bool romfs_garbage_collect(void);
 static uint16_t romfs_dir_entry_index[ROMFS_MAX_DIRS];
 static uint16_t romfs_dir_used_mask = (1u << ROMFS_ROOT_DIR_ID);
 
+#ifndef ROMFS_DENTRY_CACHE_SIZE
+#define ROMFS_DENTRY_CACHE_SIZE (16)
+#endif
+
+#define ROMFS_DENTRY_UNUSED   (0xff)
+#define ROMFS_DENTRY_NEGATIVE (0xff)
+
+typedef struct {
+    uint8_t parent;
+    uint8_t id;
+    uint16_t entry_index;
+    char name[ROMFS_MAX_NAME_LEN];
+} romfs_dentry;
+
+static romfs_dentry romfs_dentry_cache[ROMFS_DENTRY_CACHE_SIZE];
+static uint32_t romfs_dentry_next;
+
 static void romfs_dir_index_reset(void);
+static void romfs_dentry_invalidate(bool negative_only);
 static void romfs_dir_index_rebuild(void);
 static int romfs_dir_alloc_id(void);
 static void romfs_dir_release_id(uint8_t id);
@@ -71,12 +103,78 @@ static void romfs_request_flush(void);
 static uint32_t romfs_flush_depth;
 static bool romfs_flush_pending;
 
+static void romfs_map_load_page(uint32_t page)
+{
+    if (flash_map_loaded & (1u << page)) {
+        return;
+    }
+    uint32_t offset = page * ROMFS_FLASH_SECTOR;
+    romfs_flash_sector_read(flash_start + flash_list_size + offset, &((uint8_t *) flash_map_int)[offset], ROMFS_FLASH_SECTOR);
+    flash_map_loaded |= (1u << page);
+}
+
+static inline uint16_t romfs_map_get(uint32_t sector)
+{
+    if (flash_map_lazy) {
+        romfs_map_load_page(sector / ROMFS_MAP_PAGE_ENTRIES);
+    }
+    return flash_map_int[sector];
+}
+
+static inline void romfs_map_set(uint32_t sector, uint16_t value)
+{
+    uint32_t page = sector / ROMFS_MAP_PAGE_ENTRIES;
+    if (flash_map_lazy) {
+        romfs_map_load_page(page);
+    }
+    flash_map_int[sector] = value;
+    if (page < ROMFS_MAP_PAGES_MAX) {
+        flash_map_dirty |= (1u << page);
+    }
+    romfs_free_valid = false;
+}
+
+static void romfs_dentry_invalidate(bool negative_only)
+{
+    for (uint32_t i = 0; i < ROMFS_DENTRY_CACHE_SIZE; i++) {
+        if (!negative_only || romfs_dentry_cache[i].id == ROMFS_DENTRY_NEGATIVE) {
+            romfs_dentry_cache[i].parent = ROMFS_DENTRY_UNUSED;
+        }
+    }
+}
+
+static romfs_dentry *romfs_dentry_lookup(uint8_t parent, const char *name)
+{
+    for (uint32_t i = 0; i < ROMFS_DENTRY_CACHE_SIZE; i++) {
+        romfs_dentry *d = &romfs_dentry_cache[i];
+        if (d->parent == parent && !strncmp(d->name, name, ROMFS_MAX_NAME_LEN)) {
+            return d;
+        }
+    }
+    return NULL;
+}
+
+static void romfs_dentry_insert(uint8_t parent, const char *name, uint8_t id, uint16_t entry_index)
+{
+    romfs_dentry *d = romfs_dentry_lookup(parent, name);
+    if (!d) {
+        d = &romfs_dentry_cache[romfs_dentry_next];
+        romfs_dentry_next = (romfs_dentry_next + 1) % ROMFS_DENTRY_CACHE_SIZE;
+    }
+    d->parent = parent;
+    d->id = id;
+    d->entry_index = entry_index;
+    strncpy(d->name, name, ROMFS_MAX_NAME_LEN - 1);
+    d->name[ROMFS_MAX_NAME_LEN - 1] = '\0';
+}
+
 static void romfs_dir_index_reset(void)
 {
     for (uint32_t i = 0; i < ROMFS_MAX_DIRS; i++) {
         romfs_dir_entry_index[i] = ROMFS_INVALID_ENTRY_ID;
     }
     romfs_dir_used_mask = (1u << ROMFS_ROOT_DIR_ID);
+    romfs_dentry_invalidate(false);
 }
 
 static void romfs_dir_index_rebuild(void)
@@ -176,6 +274,7 @@ static void romfs_operation_leave(void)
 
 static void romfs_request_flush(void)
 {
+    romfs_free_valid = false;
     if (romfs_flush_depth == 0) {
         romfs_flush();
     } else {
@@ -222,7 +321,7 @@ void romfs_get_buffers_sizes(uint32_t rom_size, uint32_t *map_size, uint32_t *li
     }
 }
 
-bool romfs_start(uint32_t start, uint32_t rom_size, uint16_t *flash_map, uint8_t *flash_list)
+static bool romfs_start_internal(uint32_t start, uint32_t rom_size, uint16_t *flash_map, uint8_t *flash_list, bool lazy)
 {
     flash_start = (start + 0x7fff) & ~0x7fff;
     mem_size = rom_size;
@@ -236,12 +335,22 @@ bool romfs_start(uint32_t start, uint32_t rom_size, uint16_t *flash_map, uint8_t
 
     romfs_dir_index_reset();
 
+    flash_map_lazy = false;
+    flash_map_loaded = 0;
+    flash_map_dirty = 0;
+    romfs_free_valid = false;
+
     if (flash_map_size && flash_list_size) {
         for (uint32_t i = 0; i < flash_list_size; i += ROMFS_FLASH_SECTOR) {
             romfs_flash_sector_read(flash_start + i, &flash_list_int[i], ROMFS_FLASH_SECTOR);
         }
-        for (uint32_t i = 0; i < flash_map_size; i += ROMFS_FLASH_SECTOR) {
-            romfs_flash_sector_read(flash_start + flash_list_size + i, &((uint8_t *) flash_map_int)[i], ROMFS_FLASH_SECTOR);
+        if (lazy && flash_map_size / ROMFS_FLASH_SECTOR <= ROMFS_MAP_PAGES_MAX) {
+            flash_map_lazy = true;
+        } else {
+            for (uint32_t i = 0; i < flash_map_size; i += ROMFS_FLASH_SECTOR) {
+                romfs_flash_sector_read(flash_start + flash_list_size + i, &((uint8_t *) flash_map_int)[i], ROMFS_FLASH_SECTOR);
+            }
+            flash_map_loaded = ~0u;
         }
         romfs_dir_index_rebuild();
         return true;
@@ -250,17 +359,73 @@ bool romfs_start(uint32_t start, uint32_t rom_size, uint16_t *flash_map, uint8_t
     return false;
 }
 
+bool romfs_start(uint32_t start, uint32_t rom_size, uint16_t *flash_map, uint8_t *flash_list)
+{
+    return romfs_start_internal(start, rom_size, flash_map, flash_list, false);
+}
+
+bool romfs_start_lazy(uint32_t start, uint32_t rom_size, uint16_t *flash_map, uint8_t *flash_list)
+{
+    return romfs_start_internal(start, rom_size, flash_map, flash_list, true);
+}
+
+//
+// Read the sector back before erasing it. Unchanged data is not rewritten
+// and a sector of 0xff only needs the erase.
+//
+static bool romfs_flash_sector_update(uint32_t offset, uint8_t *buffer)
+{
+    static uint8_t compare[ROMFS_COMPARE_CHUNK];
+    bool same = true;
+
+    for (uint32_t pos = 0; pos < ROMFS_FLASH_SECTOR && same; pos += ROMFS_COMPARE_CHUNK) {
+        same = romfs_flash_sector_read(offset + pos, compare, ROMFS_COMPARE_CHUNK) && !memcmp(compare, &buffer[pos], ROMFS_COMPARE_CHUNK);
+    }
+
+    if (same) {
+        write_stats.unchanged++;
+        return true;
+    }
+
+    if (!romfs_flash_sector_erase(offset)) {
+        return false;
+    }
+
+    for (uint32_t pos = 0; pos < ROMFS_FLASH_SECTOR; pos++) {
+        if (buffer[pos] != 0xff) {
+            write_stats.written++;
+            return romfs_flash_sector_write(offset, buffer);
+        }
+    }
+
+    write_stats.blank++;
+    return true;
+}
+
+void romfs_get_write_stats(romfs_write_stats *stats)
+{
+    *stats = write_stats;
+}
+
+void romfs_reset_write_stats(void)
+{
+    memset(&write_stats, 0, sizeof(write_stats));
+}
+
 static void romfs_flush(void)
 {
     for (uint32_t i = 0; i < flash_list_size; i += ROMFS_FLASH_SECTOR) {
-        romfs_flash_sector_erase(flash_start + i);
-        romfs_flash_sector_write(flash_start + i, &flash_list_int[i]);
+        romfs_flash_sector_update(flash_start + i, &flash_list_int[i]);
     }
 
     for (uint32_t i = 0; i < flash_map_size; i += ROMFS_FLASH_SECTOR) {
-        romfs_flash_sector_erase(flash_start + flash_list_size + i);
-        romfs_flash_sector_write(flash_start + flash_list_size + i, &((uint8_t *) flash_map_int)[i]);
+        uint32_t page = i / ROMFS_FLASH_SECTOR;
+        if (page < ROMFS_MAP_PAGES_MAX && !(flash_map_dirty & (1u << page))) {
+            continue;
+        }
+        romfs_flash_sector_update(flash_start + flash_list_size + i, &((uint8_t *) flash_map_int)[i]);
     }
+    flash_map_dirty = 0;
 }
 
 bool romfs_format(void)
@@ -301,9 +466,11 @@ bool romfs_format(void)
     entry[2].size = to_lsb32(flash_map_size);
 
     memset((uint8_t *) flash_map_int, 0xff, flash_map_size);
+    flash_map_loaded = ~0u;
+    flash_map_dirty = ~0u;
 
     for (uint32_t i = 0; i < (flash_start + flash_list_size + flash_map_size) / ROMFS_FLASH_SECTOR; i++) {
-        flash_map_int[i] = to_lsb16(i + 1);
+        romfs_map_set(i, to_lsb16(i + 1));
     }
 
     romfs_request_flush();
@@ -315,22 +482,45 @@ bool romfs_format(void)
 
 uint32_t romfs_free(void)
 {
-    uint32_t free_sectors = 0;
-    for (uint32_t i = 0; i < flash_map_size / sizeof(uint16_t); i++) {
-        if (flash_map_int[i] == 0xffff) {
-            free_sectors++;
-        }
+    if (romfs_free_valid) {
+        return romfs_free_cached;
     }
 
+    uint32_t free_sectors = 0;
     romfs_entry *entries = (romfs_entry *) flash_list_int;
-    for (uint32_t i = 0; i < flash_list_size / sizeof(romfs_entry); i++) {
-        if (entries[i].name[0] == ROMFS_DELETED_ENTRY) {
+
+    if (flash_map_lazy) {
+        /* Count from the list so that a lazy mount never pages the map in */
+        uint32_t used_sectors = 0;
+        for (uint32_t i = 0; i < flash_list_size / sizeof(romfs_entry); i++) {
+            if (entries[i].name[0] == ROMFS_EMPTY_ENTRY ||
+                    entries[i].name[0] == ROMFS_DELETED_ENTRY) {
+                continue;
+            }
             uint32_t file_size = from_lsb32(entries[i].size);
-            free_sectors += (file_size + (ROMFS_FLASH_SECTOR - 1)) / ROMFS_FLASH_SECTOR;
+            used_sectors += (file_size + (ROMFS_FLASH_SECTOR - 1)) / ROMFS_FLASH_SECTOR;
+        }
+        uint32_t total_sectors = flash_map_size / sizeof(uint16_t);
+        free_sectors = (used_sectors < total_sectors) ? (total_sectors - used_sectors) : 0;
+    } else {
+        for (uint32_t i = 0; i < flash_map_size / sizeof(uint16_t); i++) {
+            if (flash_map_int[i] == 0xffff) {
+                free_sectors++;
+            }
+        }
+
+        for (uint32_t i = 0; i < flash_list_size / sizeof(romfs_entry); i++) {
+            if (entries[i].name[0] == ROMFS_DELETED_ENTRY) {
+                uint32_t file_size = from_lsb32(entries[i].size);
+                free_sectors += (file_size + (ROMFS_FLASH_SECTOR - 1)) / ROMFS_FLASH_SECTOR;
+            }
         }
     }
 
-    return free_sectors * ROMFS_FLASH_SECTOR;
+    romfs_free_cached = free_sectors * ROMFS_FLASH_SECTOR;
+    romfs_free_valid = true;
+
+    return romfs_free_cached;
 }
 
 static uint32_t romfs_list_internal(romfs_file *file, bool first, bool with_deleted, uint8_t parent_filter, uint8_t include_mask)
@@ -438,7 +628,7 @@ static uint32_t romfs_last_sector(uint32_t start)
 
     uint32_t sector = start;
     while (true) {
-        uint32_t next = from_lsb16(flash_map_int[sector]);
+        uint32_t next = from_lsb16(romfs_map_get(sector));
         if (next == sector) {
             break;
         }
@@ -462,8 +652,8 @@ static void romfs_unallocate_sectors_chain(romfs_file *file)
 
     uint32_t sector = file->entry.start;
     for (uint32_t i = 0; i < sectors; i++) {
-        uint32_t next = from_lsb16(flash_map_int[sector]);
-        flash_map_int[sector] = 0xffff;
+        uint32_t next = from_lsb16(romfs_map_get(sector));
+        romfs_map_set(sector, 0xffff);
         sector = next;
     }
 }
@@ -509,13 +699,13 @@ static bool romfs_garbage_collect(void)
 static uint32_t romfs_find_free_sector(uint32_t start, bool reclaim)
 {
     for (uint32_t i = start; i < flash_map_size / sizeof(uint16_t); i++) {
-        if (flash_map_int[i] == 0xffff) {
+        if (romfs_map_get(i) == 0xffff) {
             return i;
         }
     }
 
     for (uint32_t i = 0; i < start; i++) {
-        if (flash_map_int[i] == 0xffff) {
+        if (romfs_map_get(i) == 0xffff) {
             return i;
         }
     }
@@ -534,7 +724,7 @@ uint32_t romfs_create_file(const char *name, romfs_file *file, uint16_t mode, ui
     return romfs_create_file_in_dir(&root, name, file, mode, type, io_buffer);
 }
 
-static uint32_t romfs_allocate_and_write_sector_internal(const void *buffer, romfs_file *file)
+static uint32_t romfs_allocate_sector_internal(romfs_file *file)
 {
     if (file->entry.start == 0xffff) {
         file->entry.start = romfs_find_free_sector(0, true);
@@ -542,7 +732,7 @@ static uint32_t romfs_allocate_and_write_sector_internal(const void *buffer, rom
             return (file->err = ROMFS_ERR_NO_SPACE);
         }
         file->pos = file->entry.start;
-        flash_map_int[file->pos] = to_lsb16(file->pos);
+        romfs_map_set(file->pos, to_lsb16(file->pos));
     } else {
         uint32_t pos = romfs_find_free_sector(file->pos, true);
         if (pos == 0xffff) {
@@ -552,13 +742,21 @@ static uint32_t romfs_allocate_and_write_sector_internal(const void *buffer, rom
             file->pos = 0xffff;
             return (file->err = ROMFS_ERR_NO_SPACE);
         }
-        flash_map_int[file->pos] = to_lsb16(pos);
-        flash_map_int[pos] = to_lsb16(pos);
+        romfs_map_set(file->pos, to_lsb16(pos));
+        romfs_map_set(pos, to_lsb16(pos));
         file->pos = pos;
     }
 
-    romfs_flash_sector_erase(file->pos * ROMFS_FLASH_SECTOR);
-    romfs_flash_sector_write(file->pos * ROMFS_FLASH_SECTOR, (uint8_t *) buffer);
+    return (file->err = ROMFS_NOERR);
+}
+
+static uint32_t romfs_allocate_and_write_sector_internal(const void *buffer, romfs_file *file)
+{
+    if (romfs_allocate_sector_internal(file) != ROMFS_NOERR) {
+        return file->err;
+    }
+
+    romfs_flash_sector_update(file->pos * ROMFS_FLASH_SECTOR, (uint8_t *) buffer);
 
     return (file->err = ROMFS_NOERR);
 }
@@ -606,8 +804,7 @@ uint32_t romfs_write_file(const void *buffer, uint32_t size, romfs_file *file)
             if (prev_buffer_from_flash) {
                 uint32_t new_bytes = ROMFS_FLASH_SECTOR - file->buffer_base;
                 uint32_t sector = file->pos;
-                romfs_flash_sector_erase(sector * ROMFS_FLASH_SECTOR);
-                romfs_flash_sector_write(sector * ROMFS_FLASH_SECTOR, file->io_buffer);
+                romfs_flash_sector_update(sector * ROMFS_FLASH_SECTOR, file->io_buffer);
                 file->entry.size += new_bytes;
                 file->buffer_from_flash = false;
                 file->buffer_base = 0;
@@ -643,8 +840,7 @@ uint32_t romfs_close_file(romfs_file *file)
             uint32_t pending = file->offset - file->buffer_base;
             if (file->buffer_from_flash) {
                 uint32_t sector = file->pos;
-                romfs_flash_sector_erase(sector * ROMFS_FLASH_SECTOR);
-                romfs_flash_sector_write(sector * ROMFS_FLASH_SECTOR, file->io_buffer);
+                romfs_flash_sector_update(sector * ROMFS_FLASH_SECTOR, file->io_buffer);
                 file->buffer_from_flash = false;
             } else {
                 if (romfs_allocate_and_write_sector_internal(file->io_buffer, file) != ROMFS_NOERR) {
@@ -659,6 +855,9 @@ uint32_t romfs_close_file(romfs_file *file)
         }
 
         romfs_entry *_entry = &((romfs_entry *) flash_list_int)[file->nentry];
+        if (_entry->name[0] == ROMFS_EMPTY_ENTRY) {
+            romfs_dentry_invalidate(true);
+        }
         memmove(_entry->name, file->entry.name, ROMFS_MAX_NAME_LEN);
         _entry->attr.raw = to_lsb16(file->entry.attr.raw);
         _entry->start = to_lsb32(file->entry.start);
@@ -704,7 +903,7 @@ uint32_t romfs_read_map_table(uint16_t *map_buffer, uint32_t map_size, romfs_fil
         return 0;
     }
     for (uint32_t i = 0; i < num_sectors; i++) {
-        uint32_t next = from_lsb16(flash_map_int[sector]);
+        uint32_t next = from_lsb16(romfs_map_get(sector));
         map_buffer[i] = sector;
         sector = next;
     }
@@ -712,6 +911,32 @@ uint32_t romfs_read_map_table(uint16_t *map_buffer, uint32_t map_size, romfs_fil
     return num_sectors;
 }
 
+uint32_t romfs_map_iter_next(romfs_file *file, uint16_t *map_buffer, uint32_t n)
+{
+    if (file->op == ROMFS_OP_WRITE) {
+        file->err = ROMFS_ERR_OPERATION;
+        return 0;
+    }
+
+    uint32_t num_sectors = (file->entry.size + (ROMFS_FLASH_SECTOR - 1)) / ROMFS_FLASH_SECTOR;
+    uint32_t index = (file->read_offset >= file->entry.size) ? num_sectors : file->read_offset / ROMFS_FLASH_SECTOR;
+    uint32_t count = 0;
+
+    while (count < n && index < num_sectors) {
+        map_buffer[count++] = file->pos;
+        index++;
+        if (index < num_sectors) {
+            file->pos = from_lsb16(romfs_map_get(file->pos));
+        }
+    }
+
+    file->offset = 0;
+    file->read_offset = (index * ROMFS_FLASH_SECTOR < file->entry.size) ? index * ROMFS_FLASH_SECTOR : file->entry.size;
+    file->err = (index < num_sectors) ? ROMFS_NOERR : ROMFS_ERR_EOF;
+
+    return count;
+}
+
 uint32_t romfs_read_file(void *buffer, uint32_t size, romfs_file *file)
 {
     if (file->op == ROMFS_OP_WRITE) {
@@ -739,10 +964,25 @@ uint32_t romfs_read_file(void *buffer, uint32_t size, romfs_file *file)
     while (readable > 0) {
         uint32_t space = ROMFS_FLASH_SECTOR - file->offset;
         uint32_t chunk = readable < space ? readable : space;
+        uint32_t last = file->pos;
 
-        romfs_flash_sector_read(file->pos * ROMFS_FLASH_SECTOR + file->offset, &dst[total_read], chunk);
+        // physically consecutive sectors go to the backend as one read
+        while (chunk < readable && !((file->offset + chunk) & (ROMFS_FLASH_SECTOR - 1))) {
+            uint32_t next = from_lsb16(romfs_map_get(last));
+            if (next != last + 1) {
+                break;
+            }
+            last = next;
+            chunk += (readable - chunk < ROMFS_FLASH_SECTOR) ? readable - chunk : ROMFS_FLASH_SECTOR;
+        }
 
-        file->offset += chunk;
+        if (!romfs_flash_sector_read(file->pos * ROMFS_FLASH_SECTOR + file->offset, &dst[total_read], chunk)) {
+            file->err = ROMFS_ERR_OPERATION;
+            return total_read;
+        }
+
+        file->offset += chunk - (last - file->pos) * ROMFS_FLASH_SECTOR;
+        file->pos = last;
         file->read_offset += chunk;
         total_read += chunk;
         readable -= chunk;
@@ -751,7 +991,7 @@ uint32_t romfs_read_file(void *buffer, uint32_t size, romfs_file *file)
             uint32_t current = file->pos;
             file->offset = 0;
             if (file->read_offset < file->entry.size) {
-                file->pos = from_lsb16(flash_map_int[current]);
+                file->pos = from_lsb16(romfs_map_get(current));
             }
         }
     }
@@ -847,7 +1087,7 @@ uint32_t romfs_seek_file(romfs_file *file, int32_t offset, int whence)
     }
 
     for (uint32_t i = 0; i < sector_index; i++) {
-        uint32_t next = from_lsb16(flash_map_int[sector]);
+        uint32_t next = from_lsb16(romfs_map_get(sector));
         if (next == sector) {
             return (file->err = ROMFS_ERR_OPERATION);
         }
@@ -963,9 +1203,22 @@ uint32_t romfs_dir_open(const romfs_dir *parent, const char *name, romfs_dir *ou
         return ROMFS_ERR_FILE_DATA_TOO_BIG;
     }
 
+    romfs_dentry *cached = romfs_dentry_lookup(parent->id, name);
+    if (cached) {
+        if (cached->id == ROMFS_DENTRY_NEGATIVE) {
+            return ROMFS_ERR_NO_ENTRY;
+        }
+        out->id = cached->id;
+        out->entry_index = cached->entry_index;
+        return ROMFS_NOERR;
+    }
+
     romfs_file file = {0};
     uint32_t res = romfs_find_file_internal(&file, name, parent->id, true);
     if (res != ROMFS_NOERR) {
+        if (res == ROMFS_ERR_NO_ENTRY) {
+            romfs_dentry_insert(parent->id, name, ROMFS_DENTRY_NEGATIVE, ROMFS_INVALID_ENTRY_ID);
+        }
         return res;
     }
 
@@ -978,6 +1231,7 @@ uint32_t romfs_dir_open(const romfs_dir *parent, const char *name, romfs_dir *ou
     if (out->id < ROMFS_MAX_DIRS) {
         romfs_dir_entry_index[out->id] = file.nentry;
         romfs_dir_used_mask |= (1u << out->id);
+        romfs_dentry_insert(parent->id, name, out->id, file.nentry);
     }
 
     return ROMFS_NOERR;
@@ -1046,6 +1300,7 @@ uint32_t romfs_dir_create(const romfs_dir *parent, const char *name, romfs_dir *
     slot->size = to_lsb32(0);
 
     romfs_dir_entry_index[new_id] = entry_index;
+    romfs_dentry_invalidate(true);
     romfs_request_flush();
     romfs_operation_leave();
 
@@ -1081,6 +1336,7 @@ uint32_t romfs_dir_remove(const romfs_dir *dir)
     entries[entry_index].name[0] = ROMFS_DELETED_ENTRY;
 
     romfs_dir_release_id(dir->id);
+    romfs_dentry_invalidate(false);
 
     romfs_request_flush();
     romfs_operation_leave();
@@ -1281,6 +1537,7 @@ uint32_t romfs_delete_in_dir(const romfs_dir *dir, const char *name)
             return ROMFS_ERR_DIR_NOT_EMPTY;
         }
         romfs_dir_release_id(file.entry.attr.names.current);
+        romfs_dentry_invalidate(false);
     }
 
     romfs_operation_enter();
@@ -1367,6 +1624,8 @@ uint32_t romfs_rename_in_dir(const romfs_dir *src_dir, const char *src_name,
     attr_union.names.parent = dst_dir->id;
     entry->attr.raw = to_lsb16(attr_union.raw);
 
+    romfs_dentry_invalidate(!is_dir);
+
     romfs_request_flush();
     romfs_operation_leave();
 
@@ -1451,6 +1710,57 @@ uint32_t romfs_create_path(const char *path, romfs_file *file, uint16_t mode, ui
     return romfs_create_file_in_dir(&parent, leaf, file, mode, type, io_buffer);
 }
 
+void romfs_set_sector_copy(romfs_sector_copy_fn fn)
+{
+    romfs_sector_copy = fn;
+}
+
+uint32_t romfs_copy_path(const char *src_path, const char *dst_path, uint8_t *io_buffer, bool create_dirs)
+{
+    if (!src_path || !dst_path) {
+        return ROMFS_ERR_DIR_INVALID;
+    }
+
+    if (!io_buffer) {
+        return ROMFS_ERR_NO_IO_BUFFER;
+    }
+
+    romfs_file src = {0};
+    uint32_t err = romfs_open_path(src_path, &src, io_buffer);
+    if (err != ROMFS_NOERR) {
+        return err;
+    }
+
+    romfs_file dst = {0};
+    err = romfs_create_path(dst_path, &dst, src.entry.attr.names.mode & ~ROMFS_MODE_SYSTEM, src.entry.attr.names.type, io_buffer, create_dirs);
+    if (err != ROMFS_NOERR) {
+        return err;
+    }
+
+    uint32_t num_sectors = (src.entry.size + (ROMFS_FLASH_SECTOR - 1)) / ROMFS_FLASH_SECTOR;
+    uint32_t sector = src.entry.start;
+
+    for (uint32_t i = 0; i < num_sectors; i++) {
+        if (romfs_allocate_sector_internal(&dst) != ROMFS_NOERR) {
+            return dst.err;
+        }
+
+        uint32_t src_offset = sector * ROMFS_FLASH_SECTOR;
+        uint32_t dst_offset = dst.pos * ROMFS_FLASH_SECTOR;
+        if (!romfs_sector_copy || !romfs_sector_copy(dst_offset, src_offset)) {
+            romfs_flash_sector_read(src_offset, io_buffer, ROMFS_FLASH_SECTOR);
+            romfs_flash_sector_update(dst_offset, io_buffer);
+        }
+        dst.entry.size += ROMFS_FLASH_SECTOR;
+
+        sector = from_lsb16(romfs_map_get(sector));
+    }
+
+    dst.entry.size = src.entry.size;
+
+    return romfs_close_file(&dst);
+}
+
 uint32_t romfs_get_entry_in_dir(const romfs_dir *dir, const char *name, romfs_entry *out_entry)
 {
     if (!dir || !name || !out_entry) {
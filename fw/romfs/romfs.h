@@ -20,6 +20,10 @@ extern "C" {
 
 #define ROMFS_FLASH_SECTOR (4096) /* Flash sector size in bytes */
 
+#ifndef ROMFS_COMPARE_CHUNK
+#define ROMFS_COMPARE_CHUNK ROMFS_FLASH_SECTOR /* Read back size when comparing a sector */
+#endif
+
 #define ROMFS_MAX_NAME_LEN (54) /* Maximum length of file name */
 
 #define ROMFS_EMPTY_ENTRY   '\xff' /* Marker for empty entry */
@@ -117,8 +121,23 @@ bool romfs_flash_sector_erase(uint32_t offset);
 bool romfs_flash_sector_write(uint32_t offset, uint8_t * buffer);
 bool romfs_flash_sector_read(uint32_t offset, uint8_t * buffer, uint32_t need);
 
+typedef bool (*romfs_sector_copy_fn)(uint32_t dst_offset, uint32_t src_offset);
+
+void romfs_set_sector_copy(romfs_sector_copy_fn fn);
+
+/* Sector updates skipped by comparing with flash before erasing */
+typedef struct {
+    uint32_t written;   /* erased and programmed */
+    uint32_t unchanged; /* flash already held the data, left alone */
+    uint32_t blank;     /* data was all 0xff, erased only */
+} romfs_write_stats;
+
+void romfs_get_write_stats(romfs_write_stats * stats);
+void romfs_reset_write_stats(void);
+
 void romfs_get_buffers_sizes(uint32_t rom_size, uint32_t * map_size, uint32_t * list_size);
 bool romfs_start(uint32_t start, uint32_t rom_size, uint16_t * flash_map, uint8_t * flash_list);
+bool romfs_start_lazy(uint32_t start, uint32_t rom_size, uint16_t * flash_map, uint8_t * flash_list);
 bool romfs_format(void);
 uint32_t romfs_free(void);
 uint32_t romfs_list(romfs_file * entry, bool first);
@@ -128,6 +147,7 @@ uint32_t romfs_write_file(const void *buffer, uint32_t size, romfs_file * file);
 uint32_t romfs_close_file(romfs_file * file);
 uint32_t romfs_open_file(const char *name, romfs_file * file, uint8_t * io_buffer);
 uint32_t romfs_read_map_table(uint16_t * map_buffer, uint32_t map_size, romfs_file * file);
+uint32_t romfs_map_iter_next(romfs_file * file, uint16_t * map_buffer, uint32_t n);
 uint32_t romfs_read_file(void *buffer, uint32_t size, romfs_file * file);
 uint32_t romfs_tell_file(romfs_file *file, uint32_t *position);
 uint32_t romfs_seek_file(romfs_file *file, int32_t offset, int whence);
@@ -155,6 +175,7 @@ uint32_t romfs_mkdir_path(const char *path, bool create_parents, romfs_dir *out_
 uint32_t romfs_rmdir_path(const char *path);
 uint32_t romfs_dir_open_path(const char *path, romfs_dir *out_dir);
 uint32_t romfs_delete_path(const char *path);
+uint32_t romfs_copy_path(const char *src_path, const char *dst_path, uint8_t * io_buffer, bool create_dirs);
 
 const char *romfs_strerror(uint32_t err);
 
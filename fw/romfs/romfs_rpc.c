@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include "romfs.h"
+#include "romfs_rpc.h"
+#include "../../utils/utils2.h"
+
+#define RPC_PATH_MAX 256
+
+static bool rpc_path(char *path, const uint8_t *payload, uint32_t length)
+{
+    if (length >= RPC_PATH_MAX) {
+        return false;
+    }
+
+    memmove(path, payload, length);
+    path[length] = '\0';
+
+    return true;
+}
+
+static void rpc_put_le32(uint8_t *dst, uint32_t val)
+{
+    dst[0] = val;
+    dst[1] = val >> 8;
+    dst[2] = val >> 16;
+    dst[3] = val >> 24;
+}
+
+static uint32_t rpc_entry(uint8_t *dst, const romfs_entry *entry)
+{
+    memset(dst, 0, sizeof(struct file_entry));
+    memmove(&dst[offsetof(struct file_entry, name)], entry->name, ROMFS_MAX_NAME_LEN);
+    dst[offsetof(struct file_entry, name) + ROMFS_MAX_NAME_LEN - 1] = '\0';
+    dst[offsetof(struct file_entry, mode)] = entry->attr.names.mode;
+    dst[offsetof(struct file_entry, type)] = entry->attr.names.type;
+    rpc_put_le32(&dst[offsetof(struct file_entry, size)], entry->size);
+
+    return sizeof(struct file_entry);
+}
+
+static uint32_t rpc_list(uint32_t cursor, const char *path, uint8_t *reply, uint32_t *reply_len, uint32_t *result)
+{
+    romfs_dir dir;
+    uint32_t err = path[0] ? romfs_dir_open_path(path, &dir) : romfs_dir_root(&dir);
+    if (err != ROMFS_NOERR) {
+        return err;
+    }
+
+    // the cursor is the list slot to continue from, so nothing is kept between calls
+    romfs_file file = { 0 };
+    file.nentry = cursor;
+    while (*reply_len + sizeof(struct file_entry) <= CART_FILE_IO_MAX) {
+        err = romfs_list_dir(&file, false, &dir, true);
+        if (err == ROMFS_ERR_NO_FREE_ENTRIES) {
+            return ROMFS_NOERR;
+        } else if (err != ROMFS_NOERR) {
+            return err;
+        }
+        *reply_len += rpc_entry(&reply[*reply_len], &file.entry);
+    }
+
+    *result = file.nentry;
+
+    return ROMFS_NOERR;
+}
+
+uint32_t romfs_rpc_call(uint32_t op, uint32_t arg, const uint8_t *payload, uint32_t length, uint8_t *reply, uint32_t *reply_len, uint32_t *result)
+{
+    char path[RPC_PATH_MAX];
+    uint32_t err = ROMFS_NOERR;
+
+    *reply_len = 0;
+    *result = 0;
+
+    // all requests but FREE carry a path
+    if (op != FILE_RPC_FREE && !rpc_path(path, payload, length)) {
+        return ROMFS_ERR_FILE_DATA_TOO_BIG;
+    }
+
+    switch (op) {
+    case FILE_RPC_FREE:
+        *result = romfs_free();
+        break;
+    case FILE_RPC_LIST:
+        err = rpc_list(arg, path, reply, reply_len, result);
+        break;
+    case FILE_RPC_RENAME:
+        if (strlen(path) >= length) {
+            err = ROMFS_ERR_OPERATION;
+        } else {
+            err = romfs_rename_path(path, &path[strlen(path) + 1], arg & FILE_RPC_CREATE_DIRS);
+        }
+        break;
+    case FILE_RPC_DELETE:
+        err = romfs_delete_path(path);
+        break;
+    case FILE_RPC_MKDIR:
+        err = romfs_mkdir_path(path, true, NULL);
+        break;
+    case FILE_RPC_RMDIR:
+        err = romfs_rmdir_path(path);
+        break;
+    default:
+        err = ROMFS_ERR_OPERATION;
+    }
+
+    return err;
+}
@@ -0,0 +1,27 @@
+/**
+ * Copyright (c) 2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __ROMFS_RPC_H__
+#define __ROMFS_RPC_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * File level requests (CART_FILE_RPC in utils/utils2.h) served from a
+ * mounted romfs. The transport collects the payload, runs the request
+ * and streams back reply_len bytes of reply (up to CART_FILE_IO_MAX).
+ */
+uint32_t romfs_rpc_call(uint32_t op, uint32_t arg, const uint8_t * payload, uint32_t length, uint8_t * reply, uint32_t * reply_len, uint32_t * result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -11,6 +11,8 @@
 #include <time.h>
 #include <inttypes.h>
 #include "romfs.h"
+#include "romfs_rpc.h"
+#include "../../utils/utils2.h"
 
 #if defined(__linux__) || defined(__APPLE__)
 #define ANSI_COLOR_RED     "\x1b[31m"
@@ -30,6 +32,9 @@
 
 static uint8_t *memory = NULL;
 static uint8_t *flash_base = NULL;
+static uint32_t flash_read_calls = 0;
+static uint32_t flash_erase_calls = 0;
+static uint32_t flash_write_calls = 0;
 
 const int NORMAL_CHUNK_SIZE = 256;
 const int NORMAL_CHUNKS_PER_FILE = 20; // Creates 5KB files (256 * 20)
@@ -43,18 +48,21 @@ typedef struct {
 
 bool romfs_flash_sector_erase(uint32_t offset)
 {
+    flash_erase_calls++;
     memset(&flash_base[offset], 0xff, ROMFS_FLASH_SECTOR);
     return true;
 }
 
 bool romfs_flash_sector_write(uint32_t offset, uint8_t *buffer)
 {
+    flash_write_calls++;
     memmove(&flash_base[offset], buffer, ROMFS_FLASH_SECTOR);
     return true;
 }
 
 bool romfs_flash_sector_read(uint32_t offset, uint8_t *buffer, uint32_t need)
 {
+    flash_read_calls++;
     memmove(buffer, &flash_base[offset], need);
     return true;
 }
@@ -1428,6 +1436,716 @@ static bool test_interleaved_delete_write(void)
 }
 
 
+static bool test_map_iterator(void)
+{
+    printf(ANSI_COLOR_YELLOW "\n--- Running Map Iterator Test ---\n" ANSI_COLOR_RESET);
+
+    if (!romfs_format()) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to format filesystem for map iterator test\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    const uint32_t sectors = 11;
+    const uint32_t file_size = ROMFS_FLASH_SECTOR * (sectors - 1) + 17;
+    uint8_t *io_buffer = malloc(ROMFS_FLASH_SECTOR);
+    uint8_t *data = malloc(file_size);
+    uint16_t table[16];
+    uint16_t streamed[16];
+    if (!io_buffer || !data) {
+        fprintf(stderr, ANSI_COLOR_RED "Allocation failure in map iterator test\n" ANSI_COLOR_RESET);
+        free(io_buffer);
+        free(data);
+        return false;
+    }
+
+    bool success = true;
+    romfs_file file;
+    create_test_data(data, file_size, 3, 0);
+
+    if (romfs_create_file("chain.bin", &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer) != ROMFS_NOERR ||
+        romfs_write_file(data, file_size, &file) != file_size ||
+        romfs_close_file(&file) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to create chain.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    if (romfs_open_file("chain.bin", &file, io_buffer) != ROMFS_NOERR ||
+        romfs_read_map_table(table, 16, &file) != sectors) {
+        fprintf(stderr, ANSI_COLOR_RED "romfs_read_map_table failed for chain.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    uint32_t total = 0;
+    uint32_t count;
+    do {
+        count = romfs_map_iter_next(&file, &streamed[total], 3);
+        total += count;
+    } while (count == 3 && total < 16);
+
+    if (total != sectors || file.err != ROMFS_ERR_EOF ||
+        memcmp(table, streamed, sectors * sizeof(uint16_t)) != 0 ||
+        romfs_map_iter_next(&file, streamed, 3) != 0) {
+        fprintf(stderr, ANSI_COLOR_RED "Streamed map differs from map table (%u of %u sectors)\n" ANSI_COLOR_RESET, total, sectors);
+        success = false;
+        goto cleanup;
+    }
+
+    printf(ANSI_COLOR_GREEN "Map iterator test passed.\n" ANSI_COLOR_RESET);
+
+cleanup:
+    free(io_buffer);
+    free(data);
+    return success;
+}
+
+static bool test_coalesced_read(void)
+{
+    printf(ANSI_COLOR_YELLOW "\n--- Running Coalesced Read Test ---\n" ANSI_COLOR_RESET);
+
+    if (!romfs_format()) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to format filesystem for coalesced read test\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    const uint32_t file_size = ROMFS_FLASH_SECTOR * 6 + 100;
+    uint8_t *io_buffer = malloc(ROMFS_FLASH_SECTOR);
+    uint8_t *data = malloc(file_size);
+    uint8_t *readback = malloc(file_size);
+    if (!io_buffer || !data || !readback) {
+        fprintf(stderr, ANSI_COLOR_RED "Allocation failure in coalesced read test\n" ANSI_COLOR_RESET);
+        free(io_buffer);
+        free(data);
+        free(readback);
+        return false;
+    }
+
+    bool success = true;
+    romfs_file file;
+
+    // keep.bin lands between the two halves of split.bin
+    create_test_data(data, file_size, 5, 0);
+    if (romfs_create_file("split.bin", &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer) != ROMFS_NOERR ||
+        romfs_write_file(data, ROMFS_FLASH_SECTOR * 3, &file) != ROMFS_FLASH_SECTOR * 3 ||
+        romfs_close_file(&file) != ROMFS_NOERR ||
+        romfs_create_file("keep.bin", &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer) != ROMFS_NOERR ||
+        romfs_write_file(data, ROMFS_FLASH_SECTOR, &file) != ROMFS_FLASH_SECTOR ||
+        romfs_close_file(&file) != ROMFS_NOERR ||
+        romfs_open_append("split.bin", &file, ROMFS_TYPE_MISC, io_buffer) != ROMFS_NOERR ||
+        romfs_write_file(&data[ROMFS_FLASH_SECTOR * 3], file_size - ROMFS_FLASH_SECTOR * 3, &file) != file_size - ROMFS_FLASH_SECTOR * 3 ||
+        romfs_close_file(&file) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to create split.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    uint16_t table[8];
+    uint32_t runs = 1;
+    if (romfs_open_file("split.bin", &file, io_buffer) != ROMFS_NOERR ||
+        romfs_read_map_table(table, 8, &file) != 7) {
+        fprintf(stderr, ANSI_COLOR_RED "romfs_read_map_table failed for split.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+    for (int i = 1; i < 7; i++) {
+        if (table[i] != table[i - 1] + 1) {
+            runs++;
+        }
+    }
+    if (runs < 2) {
+        fprintf(stderr, ANSI_COLOR_RED "split.bin was not fragmented\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    memset(readback, 0, file_size);
+    if (romfs_open_file("split.bin", &file, io_buffer) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to open split.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+    flash_read_calls = 0;
+    if (romfs_read_file(readback, file_size, &file) != file_size ||
+        memcmp(readback, data, file_size) != 0 ||
+        flash_read_calls != runs) {
+        fprintf(stderr, ANSI_COLOR_RED "Whole file read failed (%u reads for %u runs)\n" ANSI_COLOR_RESET, flash_read_calls, runs);
+        success = false;
+        goto cleanup;
+    }
+
+    // unaligned start and odd chunk sizes
+    memset(readback, 0, file_size);
+    if (romfs_open_file("split.bin", &file, io_buffer) != ROMFS_NOERR ||
+        romfs_seek_file(&file, 1000, SEEK_SET) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to seek split.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+    uint32_t pos = 1000;
+    uint32_t ret;
+    while ((ret = romfs_read_file(&readback[pos], 5000, &file)) > 0) {
+        pos += ret;
+    }
+    if (pos != file_size || file.err != ROMFS_ERR_EOF || memcmp(&readback[1000], &data[1000], file_size - 1000) != 0) {
+        fprintf(stderr, ANSI_COLOR_RED "Chunked read of split.bin differs\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    printf(ANSI_COLOR_GREEN "Coalesced read test passed (%u runs).\n" ANSI_COLOR_RESET, runs);
+
+cleanup:
+    free(io_buffer);
+    free(data);
+    free(readback);
+    return success;
+}
+
+static uint32_t sector_copy_calls = 0;
+
+static bool test_sector_copy(uint32_t dst_offset, uint32_t src_offset)
+{
+    memmove(&flash_base[dst_offset], &flash_base[src_offset], ROMFS_FLASH_SECTOR);
+    sector_copy_calls++;
+    return true;
+}
+
+static bool verify_file_contents(const char *path, const uint8_t *expected, uint32_t size, uint8_t *io_buffer)
+{
+    romfs_file file;
+    uint8_t *readback = malloc(size + 1);
+    if (!readback) {
+        return false;
+    }
+
+    bool ok = romfs_open_path(path, &file, io_buffer) == ROMFS_NOERR &&
+              file.entry.size == size &&
+              romfs_read_file(readback, size, &file) == size &&
+              memcmp(readback, expected, size) == 0;
+    free(readback);
+    return ok;
+}
+
+static bool test_copy_path(void)
+{
+    printf(ANSI_COLOR_YELLOW "\n--- Running Copy Path Test ---\n" ANSI_COLOR_RESET);
+
+    if (!romfs_format()) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to format filesystem for copy test\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    const uint32_t payload_size = ROMFS_FLASH_SECTOR * 5 + 321;
+    uint8_t *io_buffer = malloc(ROMFS_FLASH_SECTOR);
+    uint8_t *payload = malloc(payload_size);
+    if (!io_buffer || !payload) {
+        fprintf(stderr, ANSI_COLOR_RED "Allocation failure in copy test\n" ANSI_COLOR_RESET);
+        free(io_buffer);
+        free(payload);
+        return false;
+    }
+
+    bool success = true;
+    romfs_file file;
+    create_test_data(payload, payload_size, 5, 1);
+
+    if (romfs_create_path("/roms/game.z64", &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer, true) != ROMFS_NOERR ||
+        romfs_write_file(payload, payload_size, &file) != payload_size ||
+        romfs_close_file(&file) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to create /roms/game.z64\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    uint32_t free_before = romfs_free();
+
+    if (romfs_copy_path("/roms/game.z64", "/backup/game.z64", io_buffer, true) != ROMFS_NOERR ||
+        !verify_file_contents("/backup/game.z64", payload, payload_size, io_buffer) ||
+        !verify_file_contents("/roms/game.z64", payload, payload_size, io_buffer)) {
+        fprintf(stderr, ANSI_COLOR_RED "Copy through read/erase/write hooks failed\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    if (free_before - romfs_free() != 6 * ROMFS_FLASH_SECTOR) {
+        fprintf(stderr, ANSI_COLOR_RED "Copy consumed unexpected space (%u bytes)\n" ANSI_COLOR_RESET, free_before - romfs_free());
+        success = false;
+        goto cleanup;
+    }
+
+    sector_copy_calls = 0;
+    romfs_set_sector_copy(test_sector_copy);
+    uint32_t err = romfs_copy_path("/roms/game.z64", "/roms/game2.z64", io_buffer, false);
+    romfs_set_sector_copy(NULL);
+    if (err != ROMFS_NOERR || sector_copy_calls != 6 ||
+        !verify_file_contents("/roms/game2.z64", payload, payload_size, io_buffer)) {
+        fprintf(stderr, ANSI_COLOR_RED "Copy through sector copy hook failed (%u calls)\n" ANSI_COLOR_RESET, sector_copy_calls);
+        success = false;
+        goto cleanup;
+    }
+
+    if (romfs_copy_path("/roms/game.z64", "/roms/game2.z64", io_buffer, false) != ROMFS_ERR_FILE_EXISTS ||
+        romfs_copy_path("/roms/missing.z64", "/roms/other.z64", io_buffer, false) != ROMFS_ERR_NO_ENTRY) {
+        fprintf(stderr, ANSI_COLOR_RED "Copy error handling failed\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    if (romfs_create_path("/fill.bin", &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer, false) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to create /fill.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+    while (romfs_free() > 3 * ROMFS_FLASH_SECTOR) {
+        if (romfs_write_file(payload, ROMFS_FLASH_SECTOR, &file) != ROMFS_FLASH_SECTOR) {
+            break;
+        }
+    }
+    if (romfs_close_file(&file) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to fill filesystem for copy test\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    free_before = romfs_free();
+    err = romfs_copy_path("/roms/game.z64", "/roms/game3.z64", io_buffer, false);
+    if (err != ROMFS_ERR_NO_SPACE || romfs_free() != free_before) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed copy leaked sectors (err %u, %u -> %u bytes free)\n" ANSI_COLOR_RESET,
+                err, free_before, romfs_free());
+        success = false;
+        goto cleanup;
+    }
+
+    printf(ANSI_COLOR_GREEN "Copy path test passed.\n" ANSI_COLOR_RESET);
+
+cleanup:
+    free(io_buffer);
+    free(payload);
+    return success;
+}
+
+static bool write_skip_file(const char *name, const uint8_t *data, uint32_t size, uint8_t *io_buffer)
+{
+    romfs_file file;
+
+    return romfs_create_file(name, &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer) == ROMFS_NOERR &&
+           romfs_write_file(data, size, &file) == size &&
+           romfs_close_file(&file) == ROMFS_NOERR;
+}
+
+static bool test_write_skip(void)
+{
+    printf(ANSI_COLOR_YELLOW "\n--- Running Write Skip Test ---\n" ANSI_COLOR_RESET);
+
+    if (!romfs_format()) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to format filesystem for write skip test\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    const uint32_t payload_size = ROMFS_FLASH_SECTOR * 3;
+    uint8_t *io_buffer = malloc(ROMFS_FLASH_SECTOR);
+    uint8_t *payload = malloc(payload_size);
+    if (!io_buffer || !payload) {
+        fprintf(stderr, ANSI_COLOR_RED "Allocation failure in write skip test\n" ANSI_COLOR_RESET);
+        free(io_buffer);
+        free(payload);
+        return false;
+    }
+
+    bool success = true;
+    romfs_write_stats stats;
+
+    // the middle sector is padding, like the tail of a padded ROM
+    create_test_data(payload, payload_size, 9, 0);
+    memset(&payload[ROMFS_FLASH_SECTOR], 0xff, ROMFS_FLASH_SECTOR);
+
+    if (!write_skip_file("skip.bin", payload, payload_size, io_buffer) || !romfs_format()) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to prepare skip.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    // a fresh filesystem allocates the same sectors again, so every data sector is unchanged
+    romfs_reset_write_stats();
+    flash_erase_calls = 0;
+    flash_write_calls = 0;
+    if (!write_skip_file("skip.bin", payload, payload_size, io_buffer) ||
+        !verify_file_contents("skip.bin", payload, payload_size, io_buffer)) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to rewrite skip.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    romfs_get_write_stats(&stats);
+    if (stats.unchanged < 3 || flash_write_calls != stats.written || flash_erase_calls != stats.written + stats.blank) {
+        fprintf(stderr, ANSI_COLOR_RED "Unchanged sectors were rewritten (%u written, %u unchanged, %u blank)\n" ANSI_COLOR_RESET,
+                stats.written, stats.unchanged, stats.blank);
+        success = false;
+        goto cleanup;
+    }
+
+    // overwrite the data sectors with padding, they need the erase but no program
+    if (!romfs_format()) {
+        success = false;
+        goto cleanup;
+    }
+    memset(payload, 0xff, payload_size);
+    romfs_reset_write_stats();
+    flash_erase_calls = 0;
+    flash_write_calls = 0;
+    if (!write_skip_file("pad.bin", payload, payload_size, io_buffer) ||
+        !verify_file_contents("pad.bin", payload, payload_size, io_buffer)) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to write pad.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    romfs_get_write_stats(&stats);
+    if (stats.blank != 2 || stats.unchanged < 1 || flash_write_calls != stats.written) {
+        fprintf(stderr, ANSI_COLOR_RED "Blank sectors were programmed (%u written, %u unchanged, %u blank)\n" ANSI_COLOR_RESET,
+                stats.written, stats.unchanged, stats.blank);
+        success = false;
+        goto cleanup;
+    }
+
+    printf(ANSI_COLOR_GREEN "Write skip test passed.\n" ANSI_COLOR_RESET);
+
+cleanup:
+    free(io_buffer);
+    free(payload);
+    return success;
+}
+
+static uint32_t file_rpc(uint32_t op, uint32_t arg, const void *payload, uint32_t length, uint8_t *reply, uint32_t *reply_len, uint32_t *result)
+{
+    return romfs_rpc_call(op, arg, payload, length, reply, reply_len, result);
+}
+
+static uint32_t file_rpc_path(uint32_t op, uint32_t arg, const char *path, uint8_t *reply, uint32_t *reply_len, uint32_t *result)
+{
+    return file_rpc(op, arg, path, strlen(path), reply, reply_len, result);
+}
+
+static bool file_rpc_create(const char *path, const uint8_t *data, uint32_t size, uint8_t *io_buffer)
+{
+    romfs_file file;
+
+    if (romfs_create_path(path, &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer, false) != ROMFS_NOERR) {
+        return false;
+    }
+
+    return romfs_write_file(data, size, &file) == size && romfs_close_file(&file) == ROMFS_NOERR;
+}
+
+// Runs the CART_FILE_RPC requests the way the firmware serves them
+static bool test_file_rpc(void)
+{
+    printf(ANSI_COLOR_YELLOW "\n--- Running File RPC Test ---\n" ANSI_COLOR_RESET);
+
+    if (!romfs_format()) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to format filesystem for file RPC test\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    const uint32_t data_size = ROMFS_FLASH_SECTOR * 2 + 1808;
+    uint8_t *io_buffer = malloc(ROMFS_FLASH_SECTOR);
+    uint8_t *reply = malloc(CART_FILE_IO_MAX);
+    uint8_t *data = malloc(data_size);
+    if (!io_buffer || !reply || !data) {
+        fprintf(stderr, ANSI_COLOR_RED "Allocation failure in file RPC test\n" ANSI_COLOR_RESET);
+        free(io_buffer);
+        free(reply);
+        free(data);
+        return false;
+    }
+
+    bool success = false;
+    uint32_t reply_len, result;
+    uint32_t free_before;
+    struct file_entry entry;
+    const char rename_req[] = "roms/game.z64\0roms/hack.z64";
+
+    create_test_data(data, data_size, 5, 1);
+
+    // the root of a fresh filesystem lists its system files
+    if (file_rpc_path(FILE_RPC_LIST, 0, "", reply, &reply_len, &result) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Cannot list the root directory\n" ANSI_COLOR_RESET);
+        goto cleanup;
+    }
+    uint32_t system_entries = reply_len;
+
+    if (file_rpc(FILE_RPC_FREE, 0, NULL, 0, reply, &reply_len, &free_before) != ROMFS_NOERR || reply_len) {
+        fprintf(stderr, ANSI_COLOR_RED "Free space request failed\n" ANSI_COLOR_RESET);
+        goto cleanup;
+    }
+
+    if (file_rpc_path(FILE_RPC_MKDIR, 0, "roms", reply, &reply_len, &result) != ROMFS_NOERR ||
+        !file_rpc_create("roms/game.z64", data, data_size, io_buffer)) {
+        fprintf(stderr, ANSI_COLOR_RED "Cannot create roms/game.z64\n" ANSI_COLOR_RESET);
+        goto cleanup;
+    }
+
+    if (file_rpc_path(FILE_RPC_LIST, 0, "roms", reply, &reply_len, &result) != ROMFS_NOERR || reply_len != sizeof(entry)) {
+        fprintf(stderr, ANSI_COLOR_RED "Cannot list roms\n" ANSI_COLOR_RESET);
+        goto cleanup;
+    }
+    memmove(&entry, reply, sizeof(entry));
+    if (strcmp(entry.name, "game.z64") || entry.type != ROMFS_TYPE_MISC || entry.size != data_size) {
+        fprintf(stderr, ANSI_COLOR_RED "List returned %s type %u size %u\n" ANSI_COLOR_RESET, entry.name, entry.type, entry.size);
+        goto cleanup;
+    }
+
+    if (file_rpc(FILE_RPC_RENAME, 0, rename_req, sizeof(rename_req) - 1, reply, &reply_len, &result) != ROMFS_NOERR ||
+        file_rpc_path(FILE_RPC_LIST, 0, "roms", reply, &reply_len, &result) != ROMFS_NOERR ||
+        reply_len != sizeof(entry) || result || strcmp((const char *)reply, "hack.z64")) {
+        fprintf(stderr, ANSI_COLOR_RED "Rename did not show up in the listing\n" ANSI_COLOR_RESET);
+        goto cleanup;
+    }
+
+    if (file_rpc_path(FILE_RPC_DELETE, 0, "roms/hack.z64", reply, &reply_len, &result) != ROMFS_NOERR ||
+        file_rpc_path(FILE_RPC_RMDIR, 0, "roms", reply, &reply_len, &result) != ROMFS_NOERR ||
+        file_rpc_path(FILE_RPC_LIST, 0, "", reply, &reply_len, &result) != ROMFS_NOERR || reply_len != system_entries ||
+        file_rpc(FILE_RPC_FREE, 0, NULL, 0, reply, &reply_len, &result) != ROMFS_NOERR || result != free_before) {
+        fprintf(stderr, ANSI_COLOR_RED "Delete left entries behind\n" ANSI_COLOR_RESET);
+        goto cleanup;
+    }
+
+    // more files than one reply holds come back in pages
+    uint32_t files, listed = 0;
+    system_entries /= sizeof(entry);
+    for (files = 0; files < CART_FILE_IO_MAX / sizeof(entry) + 6; files++) {
+        char name[16];
+        snprintf(name, sizeof(name), "f%u", files);
+        if (!file_rpc_create(name, data, 1, io_buffer)) {
+            break;
+        }
+    }
+    result = 0;
+    do {
+        if (file_rpc_path(FILE_RPC_LIST, result, "", reply, &reply_len, &result) != ROMFS_NOERR) {
+            break;
+        }
+        listed += reply_len / sizeof(entry);
+    } while (result);
+    if (listed != system_entries + files) {
+        fprintf(stderr, ANSI_COLOR_RED "Listed %u of %u files\n" ANSI_COLOR_RESET, listed, system_entries + files);
+        goto cleanup;
+    }
+
+    // requests without a handler are refused
+    if (file_rpc(FILE_RPC_LIST + 1, 0, "f0", 2, reply, &reply_len, &result) != ROMFS_ERR_OPERATION) {
+        fprintf(stderr, ANSI_COLOR_RED "Unknown request was accepted\n" ANSI_COLOR_RESET);
+        goto cleanup;
+    }
+
+    printf("%u files listed\n", listed);
+    printf(ANSI_COLOR_GREEN "File RPC test passed.\n" ANSI_COLOR_RESET);
+    success = true;
+
+cleanup:
+    free(io_buffer);
+    free(reply);
+    free(data);
+    return success;
+}
+
+static bool test_dentry_cache(void)
+{
+    printf(ANSI_COLOR_YELLOW "\n--- Running Path Cache Test ---\n" ANSI_COLOR_RESET);
+
+    if (!romfs_format()) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to format filesystem for path cache test\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    uint8_t *io_buffer = malloc(ROMFS_FLASH_SECTOR);
+    if (!io_buffer) {
+        fprintf(stderr, ANSI_COLOR_RED "Allocation failure in path cache test\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    bool success = true;
+    romfs_dir dir;
+    romfs_file file;
+    romfs_entry entry;
+
+    // Negative lookup must not survive creation of the directory
+    if (romfs_dir_open_path("/a/b", &dir) != ROMFS_ERR_NO_ENTRY ||
+        romfs_mkdir_path("/a/b", true, NULL) != ROMFS_NOERR ||
+        romfs_dir_open_path("/a/b", &dir) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Negative path cache entry not invalidated by mkdir\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    if (romfs_create_path("/a/b/save.eep", &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer, false) != ROMFS_NOERR ||
+        romfs_close_file(&file) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to create /a/b/save.eep\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (romfs_get_entry_path("/a/b/save.eep", &entry) != ROMFS_NOERR) {
+            fprintf(stderr, ANSI_COLOR_RED "Repeated lookup of /a/b/save.eep failed\n" ANSI_COLOR_RESET);
+            success = false;
+            goto cleanup;
+        }
+    }
+
+    // A file created under a cached-missing name must turn into "not a directory"
+    if (romfs_dir_open_path("/a/plain", &dir) != ROMFS_ERR_NO_ENTRY ||
+        romfs_create_path("/a/plain", &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer, false) != ROMFS_NOERR ||
+        romfs_close_file(&file) != ROMFS_NOERR ||
+        romfs_dir_open_path("/a/plain", &dir) != ROMFS_ERR_DIR_INVALID) {
+        fprintf(stderr, ANSI_COLOR_RED "Negative path cache entry not invalidated by file creation\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    if (romfs_rename_path("/a/b", "/a/c", false) != ROMFS_NOERR ||
+        romfs_get_entry_path("/a/b/save.eep", &entry) == ROMFS_NOERR ||
+        romfs_get_entry_path("/a/c/save.eep", &entry) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Path cache stale after directory rename\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    if (romfs_delete_path("/a/c/save.eep") != ROMFS_NOERR ||
+        romfs_rmdir_path("/a/c") != ROMFS_NOERR ||
+        romfs_dir_open_path("/a/c", &dir) != ROMFS_ERR_NO_ENTRY) {
+        fprintf(stderr, ANSI_COLOR_RED "Path cache stale after rmdir\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    printf(ANSI_COLOR_GREEN "Path cache test passed.\n" ANSI_COLOR_RESET);
+
+cleanup:
+    free(io_buffer);
+    return success;
+}
+
+static bool test_lazy_mount(uint32_t mem_size_bytes, uint16_t *flash_map, uint8_t *flash_list, uint32_t map_size, uint32_t list_size)
+{
+    printf(ANSI_COLOR_YELLOW "\n--- Running Lazy Mount Test ---\n" ANSI_COLOR_RESET);
+
+    if (!romfs_format()) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to format filesystem for lazy mount test\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    const uint32_t payload_size = ROMFS_FLASH_SECTOR * 3 + 123;
+    uint8_t *io_buffer = malloc(ROMFS_FLASH_SECTOR);
+    uint8_t *payload = malloc(payload_size);
+    uint8_t *readback = malloc(payload_size);
+    if (!io_buffer || !payload || !readback) {
+        fprintf(stderr, ANSI_COLOR_RED "Allocation failure in lazy mount test\n" ANSI_COLOR_RESET);
+        free(io_buffer);
+        free(payload);
+        free(readback);
+        return false;
+    }
+
+    bool success = true;
+    romfs_file file;
+
+    create_test_data(payload, payload_size, 7, 0);
+    if (romfs_create_path("lazy/first.bin", &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer, true) != ROMFS_NOERR ||
+        romfs_write_file(payload, payload_size, &file) != payload_size ||
+        romfs_close_file(&file) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to populate lazy/first.bin\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    uint32_t eager_free = romfs_free();
+
+    memset(flash_map, 0, map_size);
+    flash_read_calls = 0;
+    if (!romfs_start_lazy(0x10000, mem_size_bytes, flash_map, flash_list)) {
+        fprintf(stderr, ANSI_COLOR_RED "Lazy mount failed\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    if (flash_read_calls != list_size / ROMFS_FLASH_SECTOR) {
+        fprintf(stderr, ANSI_COLOR_RED "Lazy mount read %u sectors, expected %u\n" ANSI_COLOR_RESET,
+                flash_read_calls, list_size / ROMFS_FLASH_SECTOR);
+        success = false;
+        goto cleanup;
+    }
+
+    uint32_t lazy_free = romfs_free();
+    if (lazy_free != eager_free || flash_read_calls != list_size / ROMFS_FLASH_SECTOR) {
+        fprintf(stderr, ANSI_COLOR_RED "Lazy free space mismatch (%u vs %u) or map paged in\n" ANSI_COLOR_RESET,
+                lazy_free, eager_free);
+        success = false;
+        goto cleanup;
+    }
+
+    memset(readback, 0, payload_size);
+    if (romfs_open_path("lazy/first.bin", &file, io_buffer) != ROMFS_NOERR ||
+        romfs_read_file(readback, payload_size, &file) != payload_size ||
+        memcmp(readback, payload, payload_size) != 0) {
+        fprintf(stderr, ANSI_COLOR_RED "Readback through lazy map failed\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    create_test_data(payload, payload_size, 11, 0);
+    if (romfs_create_path("lazy/second.bin", &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, io_buffer, false) != ROMFS_NOERR ||
+        romfs_write_file(payload, payload_size, &file) != payload_size ||
+        romfs_close_file(&file) != ROMFS_NOERR) {
+        fprintf(stderr, ANSI_COLOR_RED "Failed to write lazy/second.bin on lazy mount\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    lazy_free = romfs_free();
+
+    if (!romfs_start(0x10000, mem_size_bytes, flash_map, flash_list)) {
+        fprintf(stderr, ANSI_COLOR_RED "Eager remount failed\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    if (romfs_free() != lazy_free) {
+        fprintf(stderr, ANSI_COLOR_RED "Free space differs after eager remount (%u vs %u)\n" ANSI_COLOR_RESET,
+                romfs_free(), lazy_free);
+        success = false;
+        goto cleanup;
+    }
+
+    memset(readback, 0, payload_size);
+    if (romfs_open_path("lazy/second.bin", &file, io_buffer) != ROMFS_NOERR ||
+        romfs_read_file(readback, payload_size, &file) != payload_size ||
+        memcmp(readback, payload, payload_size) != 0) {
+        fprintf(stderr, ANSI_COLOR_RED "File written on lazy mount is corrupted\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    create_test_data(payload, payload_size, 7, 0);
+    memset(readback, 0, payload_size);
+    if (romfs_open_path("lazy/first.bin", &file, io_buffer) != ROMFS_NOERR ||
+        romfs_read_file(readback, payload_size, &file) != payload_size ||
+        memcmp(readback, payload, payload_size) != 0) {
+        fprintf(stderr, ANSI_COLOR_RED "Existing file damaged by lazy mount flush\n" ANSI_COLOR_RESET);
+        success = false;
+        goto cleanup;
+    }
+
+    printf(ANSI_COLOR_GREEN "Lazy mount test passed.\n" ANSI_COLOR_RESET);
+
+cleanup:
+    free(io_buffer);
+    free(payload);
+    free(readback);
+    return success;
+}
+
 // Runs the entire test suite for a given flash size.
 static void run_test_suite(uint32_t flash_size_mb)
 {
@@ -1480,6 +2198,34 @@ static void run_test_suite(uint32_t flash_size_mb)
         goto cleanup;
     }
 
+    if (!test_dentry_cache()) {
+        goto cleanup;
+    }
+
+    if (!test_map_iterator()) {
+        goto cleanup;
+    }
+
+    if (!test_coalesced_read()) {
+        goto cleanup;
+    }
+
+    if (!test_copy_path()) {
+        goto cleanup;
+    }
+
+    if (!test_write_skip()) {
+        goto cleanup;
+    }
+
+    if (!test_file_rpc()) {
+        goto cleanup;
+    }
+
+    if (!test_lazy_mount(mem_size_bytes, flash_map, flash_list, map_size, list_size)) {
+        goto cleanup;
+    }
+
     // --- Test 1: Fixed Size Fill, Verify, Sequential Delete ---
     printf(ANSI_COLOR_YELLOW "\n--- Running Fill (Fixed Size) / Sequential Delete Test ---\n" ANSI_COLOR_RESET);
     romfs_format();
@@ -10,10 +10,15 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "../../utils/cart_lz.h"
 #include "../../utils/utils2.h"
 #include "../main.h"
 #include "../n64.h"
+#include "../n64_pi.h"
+#include "../n64_save.h"
 #include "../romfs/romfs.h"
+#include "../romfs/romfs_rpc.h"
+#include "flashjob.h"
 #include "flashrom.h"
 #include "hardware/flash.h"
 #include "hardware/irq.h"
@@ -665,10 +670,240 @@ static int sector_buffer_pos;
 static uint32_t rw_sector_offset;
 
 static struct ack_header ackn;
+static struct pi_stats_ack stats_ackn;
 
 static int current_req;
 static int flash_stage;
 
+// bytes left in a CART_WRITE_SECS / CART_WRITE_LZ / CART_READ_SECS / CART_READ_RANGE / CART_CRC_SECTORS / CART_FILE_RPC stream
+static uint32_t stream_left;
+static int sector_buffer_len;
+static struct range_ack range_ackn;
+
+//
+// CART_FILE_RPC mounts romfs on first use, the menu got the filesystem
+// mounted at boot but that memory is reused since. The request buffers, map
+// and list go in the part of the SRAM image past the save data of the game,
+// which the menu writes back to the save file on reset. Any other request
+// may change the flash, so it drops the mount.
+//
+static uint8_t *rpc_payload;
+static uint8_t *rpc_reply;
+static uint8_t *rpc_flash_map;
+static struct req_file_header rpc_req;
+static uint32_t rpc_payload_len;
+static struct file_ack file_ackn;
+static bool fs_mounted;
+
+static void stream_read_next(struct usb_endpoint_configuration *ep_in)
+{
+    if (!stream_left) {
+        flash_stage = 0;
+        if (current_req == CART_READ_RANGE || current_req == CART_CRC_SECTORS) {
+            current_req = 0;
+            range_ackn.type = ACK_NOERROR;
+            usb_start_transfer(ep_in, (uint8_t *) & range_ackn, sizeof(struct range_ack));
+            return;
+        }
+        if (current_req == CART_FILE_RPC) {
+            // the file_ack went out before the reply
+            current_req = 0;
+            usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+            return;
+        }
+        current_req = 0;
+        ackn.type = ACK_NOERROR;
+        usb_start_transfer(ep_in, (uint8_t *) & ackn, sizeof(struct ack_header));
+        return;
+    }
+
+    // sector hashes and file replies are already in the buffer
+    if (!sector_buffer_pos && current_req != CART_CRC_SECTORS && current_req != CART_FILE_RPC) {
+        sector_buffer_len = (stream_left < ROMFS_FLASH_SECTOR) ? stream_left : ROMFS_FLASH_SECTOR;
+        flash_jobs_read(rw_sector_offset, sector_buffer, sector_buffer_len);
+        rw_sector_offset += sector_buffer_len;
+        if (current_req == CART_READ_RANGE) {
+            range_ackn.crc = cart_crc32(range_ackn.crc, sector_buffer, sector_buffer_len);
+        }
+    }
+
+    // a short last packet ends the data part of a range read
+    int len = (sector_buffer_len - sector_buffer_pos < 64) ? sector_buffer_len - sector_buffer_pos : 64;
+    uint8_t *buffer = (current_req == CART_FILE_RPC) ? rpc_reply : sector_buffer;
+    usb_start_transfer(ep_in, &buffer[sector_buffer_pos], len);
+    sector_buffer_pos += len;
+    if (sector_buffer_pos == sector_buffer_len) {
+        sector_buffer_pos = 0;
+    }
+    stream_left -= len;
+}
+
+static uint32_t flash_range_crc32(uint32_t crc, uint32_t offset, uint32_t count, uint8_t *buffer, uint32_t size)
+{
+    for (uint32_t pos = 0; pos < count; pos += size) {
+        uint32_t n = (count - pos < size) ? count - pos : size;
+        flash_jobs_read(offset + pos, buffer, n);
+        crc = cart_crc32(crc, buffer, n);
+    }
+
+    return crc;
+}
+
+// CART_WRITE_LZ records are collected here, a partial record and the packet completing it
+#define LZ_BUFFER_SIZE (ROMFS_FLASH_SECTOR + 128)
+
+//
+// CART_WRITE_SECS fills one buffer while the flash job queue programs the
+// other. The buffers go past the save data of the game like the CART_FILE_RPC
+// ones. Without room there both are the static buffer, so each sector is
+// programmed before the next one is taken.
+//
+static uint8_t write_static[ROMFS_FLASH_SECTOR + LZ_BUFFER_SIZE];
+static uint8_t *write_buffers[2] = { write_static, write_static };
+static uint8_t *write_buffer = write_static;
+static uint8_t *lz_buffer = &write_static[ROMFS_FLASH_SECTOR];
+static bool write_error;
+
+static void write_buffer_wait(void)
+{
+    while (flash_job_uses_buffer(write_buffer)) {
+        flash_jobs_poll();
+    }
+}
+
+static void write_buffer_program(void)
+{
+    while (!flash_job_program(rw_sector_offset, write_buffer)) {
+        flash_jobs_poll();
+    }
+    // blocks only when the flash falls two sectors behind
+    write_buffer = (write_buffer == write_buffers[0]) ? write_buffers[1] : write_buffers[0];
+    write_buffer_wait();
+    rw_sector_offset += ROMFS_FLASH_SECTOR;
+}
+
+static void write_buffer_place(void)
+{
+    uint32_t base = (save_area_end() + ROMFS_FLASH_SECTOR - 1) & ~(ROMFS_FLASH_SECTOR - 1);
+
+    // the last stream may still be programming from the old place
+    while (flash_job_uses_buffer(write_buffers[0]) || flash_job_uses_buffer(write_buffers[1])) {
+        flash_jobs_poll();
+    }
+
+    if (base + ROMFS_FLASH_SECTOR * 2 + LZ_BUFFER_SIZE > SRAM_1MBIT_SIZE) {
+        write_buffers[0] = write_static;
+        write_buffers[1] = write_static;
+        lz_buffer = &write_static[ROMFS_FLASH_SECTOR];
+    } else {
+        write_buffers[0] = &pi_sram[base];
+        write_buffers[1] = &pi_sram[base + ROMFS_FLASH_SECTOR];
+        lz_buffer = &pi_sram[base + ROMFS_FLASH_SECTOR * 2];
+    }
+    write_buffer = write_buffers[0];
+}
+
+static uint32_t lz_buffer_len;
+static uint32_t lz_sectors_left;
+static bool lz_error;
+
+static void lz_stream_next(void)
+{
+    uint32_t pos = 0;
+
+    while (lz_sectors_left && lz_buffer_len - pos >= 2) {
+        uint32_t len = lz_buffer[pos] | (lz_buffer[pos + 1] << 8);
+        if (len > ROMFS_FLASH_SECTOR) {
+            lz_error = true;
+            break;
+        }
+        if (lz_buffer_len - pos - 2 < len) {
+            break;
+        }
+        if (!cart_lz_unpack(write_buffer, ROMFS_FLASH_SECTOR, &lz_buffer[pos + 2], len)) {
+            lz_error = true;
+            break;
+        }
+        write_buffer_program();
+        lz_sectors_left--;
+        pos += 2 + len;
+    }
+
+    // a bad record drops the rest of the stream, after the last sector only padding is left
+    if (lz_error || !lz_sectors_left) {
+        lz_sectors_left = 0;
+        lz_buffer_len = 0;
+        return;
+    }
+
+    memmove(lz_buffer, &lz_buffer[pos], lz_buffer_len - pos);
+    lz_buffer_len -= pos;
+}
+
+// false when the map and list don't fit next to the save data
+static bool file_rpc_place(void)
+{
+    uint32_t base = (save_area_end() + ROMFS_FLASH_SECTOR - 1) & ~(ROMFS_FLASH_SECTOR - 1);
+    uint32_t rom_size = get_flash_info()->rom_size * 1024 * 1024;
+    uint32_t flash_map_size, flash_list_size;
+
+    romfs_get_buffers_sizes(rom_size, &flash_map_size, &flash_list_size);
+    if (base + CART_FILE_IO_MAX * 2 + flash_map_size + flash_list_size > SRAM_1MBIT_SIZE) {
+        fs_mounted = false;
+        rpc_payload = NULL;
+        return false;
+    }
+
+    // a game started since the mount, its save may cover the old place
+    if (rpc_payload != &pi_sram[base]) {
+        fs_mounted = false;
+    }
+
+    rpc_payload = &pi_sram[base];
+    rpc_reply = &rpc_payload[CART_FILE_IO_MAX];
+    rpc_flash_map = &rpc_reply[CART_FILE_IO_MAX];
+
+    return true;
+}
+
+static void file_rpc_run(struct usb_endpoint_configuration *ep_in)
+{
+    uint32_t reply_len = 0;
+    uint32_t result = 0;
+    uint32_t err = ROMFS_ERR_BUFFER_TOO_SMALL;
+
+    if (rpc_payload && !fs_mounted) {
+        uintptr_t fw_binary_end = (uintptr_t) & __flash_binary_end;
+        uint32_t rom_size = get_flash_info()->rom_size * 1024 * 1024;
+        uint32_t flash_map_size;
+
+        // map pages are read as the request walks them
+        romfs_get_buffers_sizes(rom_size, &flash_map_size, NULL);
+        fs_mounted = romfs_start_lazy(fw_binary_end - XIP_BASE, rom_size, (uint16_t *) rpc_flash_map, &rpc_flash_map[flash_map_size]);
+        err = ROMFS_ERR_OPERATION;
+    }
+
+    if (rpc_payload && fs_mounted) {
+        err = romfs_rpc_call(rpc_req.op, rpc_req.arg, rpc_payload, rpc_payload_len, rpc_reply, &reply_len, &result);
+    }
+
+    file_ackn.type = ACK_NOERROR;
+    file_ackn.err = err;
+    file_ackn.result = result;
+    file_ackn.length = reply_len;
+
+    sector_buffer_len = reply_len;
+    sector_buffer_pos = 0;
+    stream_left = reply_len;
+    if (reply_len) {
+        flash_stage = 3;
+    } else {
+        flash_stage = 0;
+        current_req = 0;
+    }
+    usb_start_transfer(ep_in, (uint8_t *) & file_ackn, sizeof(struct file_ack));
+}
+
 // Device specific functions
 void ep1_out_handler(uint8_t *buf, uint16_t len)
 {
@@ -677,9 +912,21 @@ void ep1_out_handler(uint8_t *buf, uint16_t len)
     ackn.type = ACK_ERROR;
 
     struct req_header *req = (struct req_header *)buf;
-    if (current_req != CART_WRITE_SEC) {
-        if (len != sizeof(struct req_header)) {
-            printf("Wrong header size %d, must be %d\n", len, sizeof(struct req_header));
+    if (flash_stage == 0) {
+        int hdr_len = sizeof(struct req_header);
+        if (req->type == CART_COPY_SEC) {
+            hdr_len = sizeof(struct req_copy_header);
+        } else if (req->type == CART_WRITE_SECS || req->type == CART_READ_SECS || req->type == CART_READ_RANGE || req->type == CART_CRC_SECTORS) {
+            hdr_len = sizeof(struct req_range_header);
+        } else if (req->type == CART_CRC_RANGE) {
+            hdr_len = sizeof(struct req_crc_header);
+        } else if (req->type == CART_WRITE_LZ) {
+            hdr_len = sizeof(struct req_lz_header);
+        } else if (req->type == CART_FILE_RPC) {
+            hdr_len = sizeof(struct req_file_header);
+        }
+        if (len != hdr_len) {
+            printf("Wrong header size %d, must be %d\n", len, hdr_len);
             usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
             return;
         }
@@ -688,6 +935,9 @@ void ep1_out_handler(uint8_t *buf, uint16_t len)
 
     if (flash_stage == 0) {
         current_req = req->type;
+        if (req->type != CART_FILE_RPC) {
+            fs_mounted = false;
+        }
         if (req->type == CART_INFO) {
             uintptr_t fw_binary_end = (uintptr_t) & __flash_binary_end;
             const struct flash_chip *flash_chip = get_flash_info();
@@ -698,11 +948,16 @@ void ep1_out_handler(uint8_t *buf, uint16_t len)
             usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
             return;
         } else if (req->type == FLASH_SPI_MODE || req->type == FLASH_QUAD_MODE || req->type == BOOTLOADER_MODE || req->type == CART_REBOOT) {
+            flash_jobs_finish();
+            save_flush_hold(req->type == FLASH_SPI_MODE);
             if (req->type == FLASH_SPI_MODE) {
                 flash_quad_exit_cont_read_mode();
                 flash_spi_mode();
             } else if (req->type == FLASH_QUAD_MODE) {
                 flash_quad_cont_read_mode();
+#ifdef DEBUG_INFO
+                printf("flash: %u blank pages skipped\n", flash_blank_pages());
+#endif
             }
             ackn.type = ACK_NOERROR;
             usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
@@ -725,10 +980,11 @@ void ep1_out_handler(uint8_t *buf, uint16_t len)
                 rw_sector_offset = req->offset;
                 req->offset = 0;
             }
-            flash_read(rw_sector_offset + req->offset, tmp, 64);
+            flash_jobs_read(rw_sector_offset + req->offset, tmp, 64);
             usb_start_transfer(ep_out, tmp, sizeof(tmp));
             return;
         } else if (req->type == CART_WRITE_SEC) {
+            flash_jobs_finish();
             flash_stage = 1;
             sector_buffer_pos = 0;
             rw_sector_offset = req->offset;
@@ -736,10 +992,154 @@ void ep1_out_handler(uint8_t *buf, uint16_t len)
             usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
             return;
         } else if (req->type == CART_ERASE_SEC) {
-            romfs_flash_sector_erase(req->offset);
+            // older hosts expect the erase to be accepted, so wait for a free slot
+            while (!flash_job_erase(req->offset)) {
+                flash_jobs_poll();
+            }
             ackn.type = ACK_NOERROR;
             usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
             return;
+        } else if (req->type == CART_ERASE_BLOCK) {
+            if (req->offset & (ROMFS_FLASH_SECTOR * 16 - 1)) {
+                ackn.type = ACK_ERROR;
+            } else {
+                ackn.type = flash_job_block_erase(req->offset) ? ACK_NOERROR : ACK_BUSY;
+            }
+            usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
+            return;
+        } else if (req->type == CART_FLASH_STATUS) {
+            // a failed job is reported once the queue has run dry
+            if (!flash_jobs_poll()) {
+                ackn.type = ACK_BUSY;
+            } else {
+                ackn.type = flash_jobs_error() ? ACK_ERROR : ACK_NOERROR;
+            }
+            usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
+            return;
+        } else if (req->type == CART_PI_STATS) {
+            stats_ackn.type = ACK_NOERROR;
+            stats_ackn.rom_words = pi_stats.rom_words;
+            stats_ackn.sram_accesses = pi_stats.sram_accesses;
+            stats_ackn.fram_accesses = pi_stats.fram_accesses;
+            stats_ackn.unknown_hits = pi_stats.unknown_hits;
+            stats_ackn.max_wait = pi_stats.max_wait;
+            if (req->offset) {
+                pi_stats_reset();
+            }
+            usb_start_transfer(ep_out, (uint8_t *) & stats_ackn, sizeof(struct pi_stats_ack));
+            return;
+        } else if (req->type == CART_COPY_SEC) {
+            struct req_copy_header *copy = (struct req_copy_header *)buf;
+            // queued like CART_ERASE_SEC, the source is read when the program job runs
+            while (copy->offset != copy->src_offset && !flash_job_copy(copy->offset, copy->src_offset)) {
+                flash_jobs_poll();
+            }
+            ackn.type = ACK_NOERROR;
+            usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
+            return;
+        } else if (req->type == CART_WRITE_SECS || req->type == CART_READ_SECS) {
+            struct req_range_header *range = (struct req_range_header *)buf;
+            rw_sector_offset = range->offset;
+            stream_left = range->count * ROMFS_FLASH_SECTOR;
+            sector_buffer_pos = 0;
+            if (req->type == CART_READ_SECS) {
+                flash_stage = 3;
+                stream_read_next(ep_out);
+            } else if (stream_left) {
+                // data packets follow without replies, the status comes after the last sector
+                write_buffer_place();
+                write_error = false;
+                flash_stage = 2;
+                usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+            } else {
+                current_req = 0;
+                ackn.type = ACK_NOERROR;
+                usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
+            }
+            return;
+        } else if (req->type == CART_WRITE_LZ) {
+            struct req_lz_header *lz = (struct req_lz_header *)buf;
+            rw_sector_offset = lz->offset;
+            stream_left = lz->length;
+            lz_sectors_left = lz->count;
+            lz_buffer_len = 0;
+            lz_error = false;
+            if (stream_left && !(stream_left & 63)) {
+                write_buffer_place();
+                flash_stage = 4;
+                usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+                return;
+            }
+            current_req = 0;
+            ackn.type = (!stream_left && !lz_sectors_left) ? ACK_NOERROR : ACK_ERROR;
+            usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
+            return;
+        } else if (req->type == CART_CRC_RANGE) {
+            struct req_crc_header *crc = (struct req_crc_header *)buf;
+            range_ackn.type = ACK_ERROR;
+            range_ackn.length = crc->count;
+            range_ackn.crc = crc->crc;
+            if (crc->count <= CART_CRC_RANGE_MAX) {
+                range_ackn.crc = flash_range_crc32(crc->crc, crc->offset, crc->count, sector_buffer, ROMFS_FLASH_SECTOR);
+                range_ackn.type = ACK_NOERROR;
+            }
+            current_req = 0;
+            usb_start_transfer(ep_out, (uint8_t *) & range_ackn, sizeof(struct range_ack));
+            return;
+        } else if (req->type == CART_CRC_SECTORS) {
+            struct req_range_header *range = (struct req_range_header *)buf;
+            static uint8_t chunk[256];
+            if (range->count > CART_CRC_SECTORS_MAX) {
+                current_req = 0;
+                range_ackn.type = ACK_ERROR;
+                range_ackn.length = 0;
+                usb_start_transfer(ep_out, (uint8_t *) & range_ackn, sizeof(struct range_ack));
+                return;
+            }
+            // the hashes go out of sector_buffer, so flash is read through a small chunk
+            uint32_t *hashes = (uint32_t *)sector_buffer;
+            for (uint32_t i = 0; i < range->count; i++) {
+                hashes[i] = flash_range_crc32(0, range->offset + i * ROMFS_FLASH_SECTOR, ROMFS_FLASH_SECTOR, chunk, sizeof(chunk));
+            }
+            sector_buffer_len = range->count * sizeof(uint32_t);
+            sector_buffer_pos = 0;
+            stream_left = sector_buffer_len;
+            range_ackn.length = sector_buffer_len;
+            range_ackn.crc = cart_crc32(0, sector_buffer, sector_buffer_len);
+            flash_stage = 3;
+            stream_read_next(ep_out);
+            return;
+        } else if (req->type == CART_READ_RANGE) {
+            struct req_range_header *range = (struct req_range_header *)buf;
+            rw_sector_offset = range->offset;
+            stream_left = range->count;
+            sector_buffer_pos = 0;
+            range_ackn.length = range->count;
+            range_ackn.crc = 0;
+            flash_stage = 3;
+            stream_read_next(ep_out);
+            return;
+        } else if (req->type == CART_FILE_RPC) {
+            memmove(&rpc_req, buf, sizeof(rpc_req));
+            flash_jobs_finish();
+            if (rpc_req.length > CART_FILE_IO_MAX) {
+                current_req = 0;
+                file_ackn.type = ACK_ERROR;
+                file_ackn.err = ROMFS_ERR_BUFFER_TOO_SMALL;
+                file_ackn.result = 0;
+                file_ackn.length = 0;
+                usb_start_transfer(ep_out, (uint8_t *) & file_ackn, sizeof(struct file_ack));
+                return;
+            }
+            file_rpc_place();
+            rpc_payload_len = 0;
+            if (rpc_req.length) {
+                flash_stage = 5;
+                usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+                return;
+            }
+            file_rpc_run(ep_out);
+            return;
         }
         current_req = 0;
     } else if (flash_stage == 1) {
@@ -761,6 +1161,74 @@ void ep1_out_handler(uint8_t *buf, uint16_t len)
         }
         flash_stage = 0;
         current_req = 0;
+    } else if (flash_stage == 2) {
+        // after a short packet the rest of the range is drained, the error ack ends it
+        if (len != 64) {
+            printf("write stream packet size error %d\n", len);
+            write_error = true;
+        } else if (!write_error) {
+            memmove(&write_buffer[sector_buffer_pos], buf, 64);
+            sector_buffer_pos += 64;
+            if (sector_buffer_pos == ROMFS_FLASH_SECTOR) {
+                write_buffer_program();
+                sector_buffer_pos = 0;
+            }
+        }
+        stream_left -= (len < stream_left) ? len : stream_left;
+        if (stream_left) {
+            usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+            flash_jobs_poll();
+            return;
+        }
+        // sectors still queued are checked by the next CART_FLASH_STATUS
+        if (!write_error) {
+            ackn.type = flash_jobs_error() ? ACK_ERROR : ACK_NOERROR;
+        }
+        flash_stage = 0;
+        current_req = 0;
+    } else if (flash_stage == 4) {
+        if (len != 64) {
+            printf("write stream packet size error %d\n", len);
+            lz_error = true;
+        } else if (!lz_error) {
+            memmove(&lz_buffer[lz_buffer_len], buf, 64);
+            lz_buffer_len += 64;
+            lz_stream_next();
+        }
+        stream_left -= (len < stream_left) ? len : stream_left;
+        if (stream_left) {
+            usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+            flash_jobs_poll();
+            return;
+        }
+        if (!lz_error && !lz_sectors_left) {
+            ackn.type = flash_jobs_error() ? ACK_ERROR : ACK_NOERROR;
+        }
+        flash_stage = 0;
+        current_req = 0;
+    } else if (flash_stage == 5) {
+        if (len > rpc_req.length - rpc_payload_len) {
+            printf("file request payload size error %d\n", len);
+            file_ackn.type = ACK_ERROR;
+            file_ackn.err = ROMFS_ERR_OPERATION;
+            file_ackn.result = 0;
+            file_ackn.length = 0;
+            flash_stage = 0;
+            current_req = 0;
+            usb_start_transfer(ep_out, (uint8_t *) & file_ackn, sizeof(struct file_ack));
+            return;
+        }
+        // without room for the request the payload is only drained
+        if (rpc_payload) {
+            memmove(&rpc_payload[rpc_payload_len], buf, len);
+        }
+        rpc_payload_len += len;
+        if (rpc_payload_len < rpc_req.length) {
+            usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+            return;
+        }
+        file_rpc_run(ep_out);
+        return;
     }
 
     usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
@@ -769,6 +1237,10 @@ void ep1_out_handler(uint8_t *buf, uint16_t len)
 void ep2_in_handler(uint8_t *buf, uint16_t len)
 {
     //    printf("Sent %d bytes to host\n", len);
+    if (flash_stage == 3) {
+        stream_read_next(usb_get_endpoint_configuration(EP2_IN_ADDR));
+        return;
+    }
     // Get ready to rx again from host
     usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
 }
@@ -782,6 +1254,7 @@ void usbd_start(void)
 
     current_req = 0;
     flash_stage = 0;
+    fs_mounted = false;
 }
 
 void usbd_finish(void)
@@ -172,7 +172,7 @@ static bool get_rom_name(char *name, int size, bool *adv, uint8_t *opts)
     n64cart_sram_unlock();
     disable_interrupts();
     flash_mode(0);
-    flash_read(((pi_io_read(N64CART_ROM_LOOKUP) >> 16) << 12) + 0x3b, (void *)name, 5);
+    flash_read(((pi_io_read(N64CART_ROM_LOOKUP + 4) & 0xffff) << 12) + 0x3b, (void *)name, 5);
     flash_mode(1);
     enable_interrupts();
     n64cart_sram_lock();
@@ -517,31 +517,18 @@ static void refresh_file_list(void)
             char path_buf[ROMFS_PATH_MAX];
             build_entry_path(base_name, path_buf, sizeof(path_buf));
 
-            char api_path[ROMFS_PATH_MAX];
-            build_romfs_api_path(path_buf, api_path, sizeof(api_path));
-
-            romfs_entry entry_info;
-            bool have_entry = (romfs_get_entry_path(api_path, &entry_info) == ROMFS_NOERR);
-
             bool is_dir = (dir_entry.d_type == DT_DIR);
             bool is_system = false;
             size_t file_size = (dir_entry.d_size >= 0) ? (size_t)dir_entry.d_size : 0;
 
-            if (have_entry) {
+            romfs_entry entry_info;
+            if (newlib_romfs_dir_entry(&dir_entry, &entry_info) == 0) {
                 is_dir = (entry_info.attr.names.type == ROMFS_TYPE_DIR);
                 is_system = (entry_info.attr.names.mode & ROMFS_MODE_SYSTEM) != 0;
                 if (!is_dir && entry_info.attr.names.type <= ROMFS_TYPE_FLASHMAP) {
                     is_system = true;
                 }
                 file_size = entry_info.size;
-            } else if (!is_system) {
-                char posix_path[ROMFS_PATH_MAX + 8];
-                build_romfs_prefixed_path(path_buf, posix_path, sizeof(posix_path));
-                struct stat st;
-                if (stat(posix_path, &st) == 0) {
-                    is_dir = S_ISDIR(st.st_mode);
-                    file_size = (size_t)st.st_size;
-                }
             }
 
             if (!is_system) {
@@ -568,6 +555,10 @@ static void refresh_file_list(void)
         res = dir_findnext(dir_path, &dir_entry);
     }
 
+    if (res == 0) {
+        newlib_romfs_dir_close(&dir_entry);
+    }
+
     if (res < 0 && errno && errno != ENOENT) {
         syslog(LOG_ERR, "dir_findnext failed for %s (errno %d)", dir_path, errno);
     }
@@ -611,6 +602,154 @@ static void update_path_text(void)
         safe_append(txt_current_path, sizeof(txt_current_path), display);
     }
 }
+
+static uint16_t rom_pages[N64CART_ROM_PAGES];
+static uint32_t rom_pages_end;
+
+//
+// The firmware maps ROM pages through extents of consecutive flash sectors,
+// the full page table is only kept here and packed on every change.
+//
+static bool write_rom_map(void)
+{
+    uint32_t count = 0;
+
+    if (!(n64cart_fw_caps() & N64CART_FW_CAPS_ROM_EXTENTS)) {
+        // older firmware looks every page up in a flat table
+        if (rom_pages_end > N64CART_ROM_LOOKUP_PAGES) {
+            return false;
+        }
+        n64cart_sram_unlock();
+        for (uint32_t page = 0; page < rom_pages_end; page += 2) {
+            uint16_t next = (page + 1 < rom_pages_end) ? rom_pages[page + 1] : 0;
+            io_write(N64CART_ROM_LOOKUP + (page << 1), (rom_pages[page] << 16) | next);
+        }
+        n64cart_sram_lock();
+        return true;
+    }
+
+    for (uint32_t page = 0; page < rom_pages_end; page++) {
+        if (!page || rom_pages[page] != rom_pages[page - 1] + 1) {
+            count++;
+        }
+    }
+
+    syslog(LOG_INFO, "rom map: %lu pages, %lu extents", rom_pages_end, count);
+
+    // leave the current map alone, the menu still reads its files through it
+    if (count + 1 > N64CART_ROM_EXTENTS) {
+        return false;
+    }
+
+    n64cart_sram_unlock();
+    io_write(N64CART_ROM_LOOKUP, 0);
+    count = 0;
+    for (uint32_t page = 0; page < rom_pages_end; page++) {
+        if (!page || rom_pages[page] != rom_pages[page - 1] + 1) {
+            io_write(N64CART_ROM_LOOKUP + 4 + (count << 2), (page << 16) | rom_pages[page]);
+            count++;
+        }
+    }
+    // pages past the end of the file read a fixed flash sector
+    io_write(N64CART_ROM_LOOKUP + 4 + (count << 2), (rom_pages_end << 16) | N64CART_ROM_MAP_END);
+    count++;
+    io_write(N64CART_ROM_LOOKUP, count);
+    n64cart_sram_lock();
+
+    return true;
+}
+
+static bool load_rom_lookup(romfs_file *file, uint32_t offset)
+{
+    uint32_t mapped = 0;
+    uint32_t count;
+
+    if (!offset) {
+        rom_pages_end = 0;
+    }
+
+    do {
+        uint32_t room = (offset + mapped < N64CART_ROM_PAGES) ? N64CART_ROM_PAGES - offset - mapped : 0;
+        count = romfs_map_iter_next(file, &rom_pages[offset + mapped], room < 256 ? room : 256);
+        mapped += count;
+    } while (count == 256);
+
+    if (offset + mapped > rom_pages_end) {
+        rom_pages_end = offset + mapped;
+    }
+
+    return write_rom_map();
+}
+
+static void load_rom_hot_pages(const char *path, uint8_t *romfs_flash_buffer)
+{
+    static uint8_t page_buf[ROMFS_FLASH_SECTOR] __attribute__((aligned(8)));
+    romfs_file file;
+    uint32_t mask = 0;
+
+    if (romfs_open_path(path, &file, romfs_flash_buffer) != ROMFS_NOERR) {
+        return;
+    }
+
+    n64cart_sram_unlock();
+    for (int page = 0; page < N64CART_ROM_HOT_PAGES; page++) {
+        if (romfs_read_file(page_buf, sizeof(page_buf), &file) != sizeof(page_buf)) {
+            break;
+        }
+        for (int i = 0; i < sizeof(page_buf); i += 4) {
+            io_write(N64CART_ROM_HOT + page * sizeof(page_buf) + i, *((uint32_t *) & page_buf[i]));
+        }
+        mask |= 1 << page;
+    }
+    io_write(N64CART_ROM_HOT_MASK, mask);
+    n64cart_sram_lock();
+}
+
+// Hand the save file's flash sectors to the firmware so it can write the save back while the game runs
+static void load_save_map(const char *save_name, uint8_t *romfs_flash_buffer)
+{
+    uint16_t window[N64CART_SAVE_MAP_ENTRIES];
+    romfs_file file;
+    uint32_t count;
+
+    if (romfs_open_path(save_name, &file, romfs_flash_buffer) != ROMFS_NOERR) {
+        return;
+    }
+
+    memset(window, 0, sizeof(window));
+    count = romfs_map_iter_next(&file, window, N64CART_SAVE_MAP_ENTRIES);
+
+    n64cart_sram_unlock();
+    for (uint32_t i = 0; i < count; i += 2) {
+        io_write(N64CART_SAVE_MAP + (i << 1), (window[i] << 16) | window[i + 1]);
+    }
+    io_write(N64CART_SAVE_SECTORS, count);
+    n64cart_sram_lock();
+}
+
+static bool save_file_matches(const char *save_full_path, const uint8_t *data, int size)
+{
+    static uint8_t buf[4096];
+    bool match = true;
+    int offset = 0;
+
+    FILE *save_file = fopen(save_full_path, "rb");
+    if (!save_file) {
+        return false;
+    }
+
+    while (match && offset < size) {
+        size_t chunk = (size - offset > sizeof(buf)) ? sizeof(buf) : (size_t)(size - offset);
+        if (fread(buf, 1, chunk, save_file) != chunk || memcmp(buf, &data[offset], chunk)) {
+            match = false;
+        }
+        offset += chunk;
+    }
+    fclose(save_file);
+
+    return match;
+}
+
 static void run_rom(display_context_t disp, const char *path, const char *addon_path, const int addon_offset, int addon_save_type)
 {
     romfs_file file;
@@ -620,21 +759,17 @@ static void run_rom(display_context_t disp, const char *path, const char *addon_
     rom_name = rom_name ? (rom_name + 1) : path;
 
     if (romfs_open_path(path, &file, romfs_flash_buffer) == ROMFS_NOERR) {
-        uint16_t rom_lookup[ROMFS_FLASH_SECTOR * 4];
-
-        memset(rom_lookup, 0, sizeof(rom_lookup));
-        uint32_t map_size = romfs_read_map_table(rom_lookup, sizeof(rom_lookup) / 2, &file);
-
-        //syslog(LOG_INFO, "map size: %d (%08X)\n", map_size, map_size);
-
+        // the pinned pages still hold the menu, drop them before remapping
         n64cart_sram_unlock();
-        for (int i = 0; i < map_size; i += 2) {
-            uint32_t data = (rom_lookup[i] << 16) | rom_lookup[i + 1];
-            //syslog(LOG_INFO, "%08X: %08X", i, data);
-            io_write(N64CART_ROM_LOOKUP + (i << 1), data);
-        }
+        io_write(N64CART_ROM_HOT_MASK, 0);
         n64cart_sram_lock();
 
+        if (!load_rom_lookup(&file, 0)) {
+            syslog(LOG_ERR, "%s is too fragmented to map", path);
+            return;
+        }
+        load_rom_hot_pages(path, romfs_flash_buffer);
+
         static const char *saves_dir = "/saves/";
         char save_name[64];
         int cic_id = 2;
@@ -646,18 +781,10 @@ static void run_rom(display_context_t disp, const char *path, const char *addon_
             addon_name = addon_name ? (addon_name + 1) : addon_path;
 
             if (romfs_open_path(addon_path, &file, romfs_flash_buffer) == ROMFS_NOERR) {
-                memset(rom_lookup, 0, sizeof(rom_lookup));
-                uint32_t map_size = romfs_read_map_table(rom_lookup, sizeof(rom_lookup) / 2, &file);
-
-                uint32_t offset = addon_offset >> 12;
-
-                n64cart_sram_unlock();
-                for (int i = 0; i < map_size; i += 2) {
-                    uint32_t data = (rom_lookup[i] << 16) | rom_lookup[i + 1];
-                    //syslog(LOG_INFO, "%08X: %08X", i, data);
-                    io_write(N64CART_ROM_LOOKUP + ((i + offset) << 1), data);
+                if (!load_rom_lookup(&file, addon_offset >> 12)) {
+                    syslog(LOG_ERR, "%s is too fragmented to map", addon_path);
+                    return;
                 }
-                n64cart_sram_lock();
             } else {
                 syslog(LOG_ERR, "Can't open addon file %s!", addon_path);
                 return;
@@ -744,6 +871,7 @@ static void run_rom(display_context_t disp, const char *path, const char *addon_
                             n64cart_sram_unlock();
                             io_write(N64CART_RMRAM, pi_addr);
                             io_write(N64CART_RMRAM + 4, save_file_size);
+                            io_write(N64CART_SAVE_SECTORS, 0);
 
                             if (strlen(save_name) > 0) {
                             syslog(LOG_INFO, "save name: %s, pi_addr %08lX, size %d", save_name, pi_addr, save_file_size);
@@ -830,6 +958,23 @@ static void run_rom(display_context_t disp, const char *path, const char *addon_
                 for (int i = 0; i < save_file_size; i += 4) {
                     io_write(pi_addr + i, 0);
                 }
+                n64cart_sram_lock();
+
+                // the firmware can only write back into an existing file
+                if ((n64cart_fw_caps() & N64CART_FW_CAPS_SAVE_FLUSH) && ensure_parent_directory(save_name) == 0) {
+                    save_file = fopen(save_full_path, "wb");
+                    if (save_file) {
+                        memset(save_data, 0, save_file_size);
+                        if (fwrite(save_data, 1, save_file_size, save_file) != save_file_size) {
+                            syslog(LOG_ERR, "unable to create %s", save_full_path);
+                        }
+                        fclose(save_file);
+                    }
+                }
+            }
+
+            if (n64cart_fw_caps() & N64CART_FW_CAPS_SAVE_FLUSH) {
+                load_save_map(save_name, romfs_flash_buffer);
             }
         }
         n64cart_sram_lock();
@@ -1084,7 +1229,6 @@ int main(void)
                     char save_full_path[ROMFS_PATH_MAX + 8];
                     build_romfs_prefixed_path(save_name, save_full_path, sizeof(save_full_path));
 
-                    remove(save_full_path);
                     if (save_size <= 2048) {
                         // eeprom byte swap
                         for (int i = 0; i < save_size; i += 2) {
@@ -1104,39 +1248,45 @@ int main(void)
                         }
                     }
 
-                    if (ensure_parent_directory(save_name) == 0) {
-                        FILE *save_file = fopen(save_full_path, "wb");
-                        if (save_file) {
-                            size_t remaining = (size_t)save_size;
-                            size_t offset = 0;
-                            bool error = false;
-
-                            while (remaining > 0) {
-                                size_t chunk = remaining > 4096 ? 4096 : remaining;
-                                size_t wrote = fwrite(&save_data[offset], 1, chunk, save_file);
-                                if (wrote != chunk) {
-                                    error = true;
-                                    break;
+                    // the firmware may have written it back already
+                    if (save_file_matches(save_full_path, save_data, save_size)) {
+                        syslog(LOG_INFO, "save file is up to date");
+                    } else {
+                        remove(save_full_path);
+                        if (ensure_parent_directory(save_name) == 0) {
+                            FILE *save_file = fopen(save_full_path, "wb");
+                            if (save_file) {
+                                size_t remaining = (size_t)save_size;
+                                size_t offset = 0;
+                                bool error = false;
+
+                                while (remaining > 0) {
+                                    size_t chunk = remaining > 4096 ? 4096 : remaining;
+                                    size_t wrote = fwrite(&save_data[offset], 1, chunk, save_file);
+                                    if (wrote != chunk) {
+                                        error = true;
+                                        break;
+                                    }
+                                    remaining -= wrote;
+                                    offset += wrote;
                                 }
-                                remaining -= wrote;
-                                offset += wrote;
-                            }
 
-                            if (fflush(save_file) != 0) {
-                                error = true;
-                            }
+                                if (fflush(save_file) != 0) {
+                                    error = true;
+                                }
 
-                            fclose(save_file);
+                                fclose(save_file);
 
-                            if (error) {
-                                syslog(LOG_ERR, "error write save file, delete");
-                                remove(save_full_path);
+                                if (error) {
+                                    syslog(LOG_ERR, "error write save file, delete");
+                                    remove(save_full_path);
+                                }
+                            } else {
+                                syslog(LOG_ERR, "unable to open %s for writing (errno %d)", save_full_path, errno);
                             }
                         } else {
-                            syslog(LOG_ERR, "unable to open %s for writing (errno %d)", save_full_path, errno);
+                            syslog(LOG_ERR, "unable to create parent directories for %s", save_name);
                         }
-                    } else {
-                        syslog(LOG_ERR, "unable to create parent directories for %s", save_name);
                     }
                     syslog(LOG_INFO, "save file created");
 
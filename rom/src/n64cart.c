@@ -218,6 +218,14 @@ uint32_t n64cart_fw_size(void)
     return io_read(N64CART_FW_SIZE);
 }
 
+uint32_t n64cart_fw_caps(void)
+{
+    uint32_t caps = io_read(N64CART_FW_CAPS);
+
+    // firmware without the register reads it as 0xdeadbeef
+    return (caps == 0xdeadbeef) ? 0 : caps;
+}
+
 void n64cart_sram_lock(void)
 {
     uint32_t ctrl = io_read(N64CART_SYS_CTRL);
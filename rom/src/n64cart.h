@@ -30,9 +30,18 @@
 #define N64CART_SSI_SR_RFNE_BITS	0x02
 
 #define N64CART_FW_SIZE		0x1fd01018
+#define N64CART_FW_CAPS		0x1fd0101c
+#define N64CART_FW_CAPS_SAVE_FLUSH	0x01
+#define N64CART_FW_CAPS_ROM_EXTENTS	0x02
 
 #define N64CART_USBCFG		0x1fd01020
 
+#define N64CART_PI_STAT_ROM	0x1fd01040
+#define N64CART_PI_STAT_SRAM	0x1fd01044
+#define N64CART_PI_STAT_FRAM	0x1fd01048
+#define N64CART_PI_STAT_UNKNOWN	0x1fd0104c
+#define N64CART_PI_STAT_WAIT	0x1fd01050
+
 #define N64CART_USB_IRQ		0x8000
 #define N64CART_USB_BSWAP32 0x0080
 #define N64CART_USB_IRQ_ENABLE	0x0010
@@ -43,8 +52,19 @@
 
 #define N64CART_SRAM		0x08000000
 #define N64CART_ROM_LOOKUP	0x08020000
+#define N64CART_ROM_PAGES	32768
+#define N64CART_ROM_EXTENTS	16383
+#define N64CART_ROM_MAP_END	0xffff
+// pages in the flat lookup table of firmware without ROM_EXTENTS
+#define N64CART_ROM_LOOKUP_PAGES	16384
 #define N64CART_EEPROM		(0x08020000 + 4096 * 4 * 2 * 2)
 #define N64CART_RMRAM		(0x08020000 + 4096 * 4 * 2 * 2 + 2048)
+#define N64CART_ROM_HOT		(N64CART_RMRAM + 512)
+#define N64CART_ROM_HOT_PAGES	2
+#define N64CART_ROM_HOT_MASK	(N64CART_ROM_HOT + N64CART_ROM_HOT_PAGES * 4096)
+#define N64CART_SAVE_SECTORS	(N64CART_RMRAM + 96)
+#define N64CART_SAVE_MAP	(N64CART_RMRAM + 128)
+#define N64CART_SAVE_MAP_ENTRIES	32
 
 inline void pi_io_write(uint32_t pi_address, uint32_t val)
 {
@@ -80,6 +100,7 @@ uint16_t flash_read16(uint32_t addr);
 uint32_t flash_read32(uint32_t addr);
 
 uint32_t n64cart_fw_size(void);
+uint32_t n64cart_fw_caps(void);
 
 void n64cart_sram_lock(void);
 void n64cart_sram_unlock(void);
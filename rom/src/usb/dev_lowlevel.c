@@ -12,6 +12,7 @@
 #include <string.h>
 
 #include "../../../fw/romfs/romfs.h"
+#include "../../../utils/cart_lz.h"
 #include "../../../utils/utils2.h"
 #include "../main.h"
 #include "../n64cart.h"
@@ -720,10 +721,109 @@ static int sector_buffer_pos;
 static uint32_t rw_sector_offset;
 
 static struct ack_header ackn;
+static struct pi_stats_ack stats_ackn;
 
 static int current_req;
 static int flash_stage;
 
+// bytes left in a CART_WRITE_SECS / CART_WRITE_LZ / CART_READ_SECS / CART_READ_RANGE / CART_CRC_SECTORS / CART_FILE_RPC stream
+static uint32_t stream_left;
+static int sector_buffer_len;
+static uint32_t stream_crc;
+static struct range_ack range_ackn;
+static struct file_ack file_ackn;
+
+static void stream_read_next(struct usb_endpoint_configuration *ep_in)
+{
+    if (!stream_left) {
+        flash_stage = 0;
+        if (current_req == CART_READ_RANGE || current_req == CART_CRC_SECTORS) {
+            current_req = 0;
+            range_ackn.type = reverser16(ACK_NOERROR);
+            range_ackn.crc = reverser32(stream_crc);
+            usb_start_transfer(ep_in, (uint8_t *) & range_ackn, sizeof(struct range_ack));
+            return;
+        }
+        current_req = 0;
+        ackn.type = reverser16(ACK_NOERROR);
+        usb_start_transfer(ep_in, (uint8_t *) & ackn, sizeof(struct ack_header));
+        return;
+    }
+
+    // sector hashes are already in the buffer
+    if (!sector_buffer_pos && current_req != CART_CRC_SECTORS) {
+        sector_buffer_len = (stream_left < ROMFS_FLASH_SECTOR) ? stream_left : ROMFS_FLASH_SECTOR;
+        flash_read(rw_sector_offset, sector_buffer, sector_buffer_len);
+        rw_sector_offset += sector_buffer_len;
+        if (current_req == CART_READ_RANGE) {
+            stream_crc = cart_crc32(stream_crc, sector_buffer, sector_buffer_len);
+        }
+    }
+
+    // a short last packet ends the data part of a range read
+    int len = (sector_buffer_len - sector_buffer_pos < 64) ? sector_buffer_len - sector_buffer_pos : 64;
+    usb_start_transfer(ep_in, &sector_buffer[sector_buffer_pos], len);
+    sector_buffer_pos += len;
+    if (sector_buffer_pos == sector_buffer_len) {
+        sector_buffer_pos = 0;
+    }
+    stream_left -= len;
+}
+
+static uint32_t flash_range_crc32(uint32_t crc, uint32_t offset, uint32_t count, uint8_t *buffer, uint32_t size)
+{
+    for (uint32_t pos = 0; pos < count; pos += size) {
+        uint32_t n = (count - pos < size) ? count - pos : size;
+        flash_read(offset + pos, buffer, n);
+        crc = cart_crc32(crc, buffer, n);
+    }
+
+    return crc;
+}
+
+// a short CART_WRITE_SECS packet fails the whole range
+static bool write_error;
+
+// CART_WRITE_LZ records are collected here and unpacked into sector_buffer
+static uint8_t lz_buffer[2 + ROMFS_FLASH_SECTOR + 64];
+static uint32_t lz_buffer_len;
+static uint32_t lz_sectors_left;
+static bool lz_error;
+
+static void lz_stream_next(void)
+{
+    uint32_t pos = 0;
+
+    while (lz_sectors_left && lz_buffer_len - pos >= 2) {
+        uint32_t len = lz_buffer[pos] | (lz_buffer[pos + 1] << 8);
+        if (len > ROMFS_FLASH_SECTOR) {
+            lz_error = true;
+            break;
+        }
+        if (lz_buffer_len - pos - 2 < len) {
+            break;
+        }
+        if (!cart_lz_unpack(sector_buffer, ROMFS_FLASH_SECTOR, &lz_buffer[pos + 2], len)) {
+            lz_error = true;
+            break;
+        }
+        romfs_flash_sector_write(rw_sector_offset, sector_buffer);
+        rw_sector_offset += ROMFS_FLASH_SECTOR;
+        lz_sectors_left--;
+        pos += 2 + len;
+    }
+
+    // a bad record drops the rest of the stream, after the last sector only padding is left
+    if (lz_error || !lz_sectors_left) {
+        lz_sectors_left = 0;
+        lz_buffer_len = 0;
+        return;
+    }
+
+    memmove(lz_buffer, &lz_buffer[pos], lz_buffer_len - pos);
+    lz_buffer_len -= pos;
+}
+
 // Device specific functions
 static void ep1_out_handler(uint8_t *buf, uint16_t len)
 {
@@ -732,9 +832,22 @@ static void ep1_out_handler(uint8_t *buf, uint16_t len)
     ackn.type = ACK_ERROR;
 
     struct req_header *req = (struct req_header *)buf;
-    if (current_req != CART_WRITE_SEC) {
-        if (len != sizeof(struct req_header)) {
-            syslog(LOG_ERR, "Wrong header size %d, must be %d", len, sizeof(struct req_header));
+    if (flash_stage == 0) {
+        int type = reverser16(req->type);
+        int hdr_len = sizeof(struct req_header);
+        if (type == CART_COPY_SEC) {
+            hdr_len = sizeof(struct req_copy_header);
+        } else if (type == CART_WRITE_SECS || type == CART_READ_SECS || type == CART_READ_RANGE || type == CART_CRC_SECTORS) {
+            hdr_len = sizeof(struct req_range_header);
+        } else if (type == CART_CRC_RANGE) {
+            hdr_len = sizeof(struct req_crc_header);
+        } else if (type == CART_WRITE_LZ) {
+            hdr_len = sizeof(struct req_lz_header);
+        } else if (type == CART_FILE_RPC) {
+            hdr_len = sizeof(struct req_file_header);
+        }
+        if (len != hdr_len) {
+            syslog(LOG_ERR, "Wrong header size %d, must be %d", len, hdr_len);
             usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
             return;
         }
@@ -790,6 +903,147 @@ static void ep1_out_handler(uint8_t *buf, uint16_t len)
             ackn.type = reverser16(ACK_NOERROR);
             usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
             return;
+        } else if (current_req == CART_ERASE_BLOCK) {
+            // the menu erases synchronously, so there is never anything to poll
+            uint32_t offset = reverser32(req->offset);
+            if (!(offset & (ROMFS_FLASH_SECTOR * 16 - 1))) {
+                for (int i = 0; i < 16; i++) {
+                    romfs_flash_sector_erase(offset + i * ROMFS_FLASH_SECTOR);
+                }
+                ackn.type = reverser16(ACK_NOERROR);
+            } else {
+                ackn.type = reverser16(ACK_ERROR);
+            }
+            usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
+            return;
+        } else if (current_req == CART_FLASH_STATUS) {
+            ackn.type = reverser16(ACK_NOERROR);
+            usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
+            return;
+        } else if (current_req == CART_PI_STATS) {
+            stats_ackn.type = reverser16(ACK_NOERROR);
+            stats_ackn.rom_words = reverser32(pi_io_read(N64CART_PI_STAT_ROM));
+            stats_ackn.sram_accesses = reverser32(pi_io_read(N64CART_PI_STAT_SRAM));
+            stats_ackn.fram_accesses = reverser32(pi_io_read(N64CART_PI_STAT_FRAM));
+            stats_ackn.unknown_hits = reverser32(pi_io_read(N64CART_PI_STAT_UNKNOWN));
+            stats_ackn.max_wait = reverser32(pi_io_read(N64CART_PI_STAT_WAIT));
+            if (req->offset) {
+                pi_io_write(N64CART_PI_STAT_ROM, 0);
+            }
+            usb_start_transfer(ep_out, (uint8_t *) & stats_ackn, sizeof(struct pi_stats_ack));
+            return;
+        } else if (current_req == CART_COPY_SEC) {
+            struct req_copy_header *copy = (struct req_copy_header *)buf;
+            flash_read(reverser32(copy->src_offset), sector_buffer, ROMFS_FLASH_SECTOR);
+            romfs_flash_sector_erase(reverser32(copy->offset));
+            romfs_flash_sector_write(reverser32(copy->offset), sector_buffer);
+            ackn.type = reverser16(ACK_NOERROR);
+            usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
+            return;
+        } else if (current_req == CART_WRITE_SECS || current_req == CART_READ_SECS) {
+            struct req_range_header *range = (struct req_range_header *)buf;
+            rw_sector_offset = reverser32(range->offset);
+            stream_left = reverser32(range->count) * ROMFS_FLASH_SECTOR;
+            sector_buffer_pos = 0;
+            if (current_req == CART_READ_SECS) {
+                flash_stage = 3;
+                stream_read_next(ep_out);
+            } else if (stream_left) {
+                // data packets follow without replies, the status comes after the last sector
+                write_error = false;
+                flash_stage = 2;
+                usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+            } else {
+                current_req = 0;
+                ackn.type = reverser16(ACK_NOERROR);
+                usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
+            }
+            return;
+        } else if (current_req == CART_WRITE_LZ) {
+            struct req_lz_header *lz = (struct req_lz_header *)buf;
+            rw_sector_offset = reverser32(lz->offset);
+            stream_left = reverser32(lz->length);
+            lz_sectors_left = reverser32(lz->count);
+            lz_buffer_len = 0;
+            lz_error = false;
+            if (stream_left && !(stream_left & 63)) {
+                flash_stage = 4;
+                usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+                return;
+            }
+            current_req = 0;
+            ackn.type = reverser16((!stream_left && !lz_sectors_left) ? ACK_NOERROR : ACK_ERROR);
+            usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
+            return;
+        } else if (current_req == CART_CRC_RANGE) {
+            struct req_crc_header *crc = (struct req_crc_header *)buf;
+            uint32_t offset = reverser32(crc->offset);
+            uint32_t count = reverser32(crc->count);
+            stream_crc = reverser32(crc->crc);
+            range_ackn.type = reverser16(ACK_ERROR);
+            range_ackn.length = crc->count;
+            if (count <= CART_CRC_RANGE_MAX) {
+                stream_crc = flash_range_crc32(stream_crc, offset, count, sector_buffer, ROMFS_FLASH_SECTOR);
+                range_ackn.type = reverser16(ACK_NOERROR);
+            }
+            range_ackn.crc = reverser32(stream_crc);
+            current_req = 0;
+            usb_start_transfer(ep_out, (uint8_t *) & range_ackn, sizeof(struct range_ack));
+            return;
+        } else if (current_req == CART_CRC_SECTORS) {
+            struct req_range_header *range = (struct req_range_header *)buf;
+            static uint8_t chunk[256];
+            uint32_t offset = reverser32(range->offset);
+            uint32_t count = reverser32(range->count);
+            if (count > CART_CRC_SECTORS_MAX) {
+                current_req = 0;
+                range_ackn.type = reverser16(ACK_ERROR);
+                range_ackn.length = 0;
+                usb_start_transfer(ep_out, (uint8_t *) & range_ackn, sizeof(struct range_ack));
+                return;
+            }
+            // the hashes go out of sector_buffer little-endian, flash is read through a small chunk
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t crc = flash_range_crc32(0, offset + i * ROMFS_FLASH_SECTOR, ROMFS_FLASH_SECTOR, chunk, sizeof(chunk));
+                sector_buffer[i * 4] = crc;
+                sector_buffer[i * 4 + 1] = crc >> 8;
+                sector_buffer[i * 4 + 2] = crc >> 16;
+                sector_buffer[i * 4 + 3] = crc >> 24;
+            }
+            sector_buffer_len = count * sizeof(uint32_t);
+            sector_buffer_pos = 0;
+            stream_left = sector_buffer_len;
+            stream_crc = cart_crc32(0, sector_buffer, sector_buffer_len);
+            range_ackn.length = reverser32(sector_buffer_len);
+            flash_stage = 3;
+            stream_read_next(ep_out);
+            return;
+        } else if (current_req == CART_READ_RANGE) {
+            struct req_range_header *range = (struct req_range_header *)buf;
+            rw_sector_offset = reverser32(range->offset);
+            stream_left = reverser32(range->count);
+            sector_buffer_pos = 0;
+            stream_crc = 0;
+            range_ackn.length = range->count;
+            flash_stage = 3;
+            stream_read_next(ep_out);
+            return;
+        } else if (current_req == CART_FILE_RPC) {
+            // romfs is not safe to call from the USB interrupt, the payload is dropped
+            struct req_file_header *file = (struct req_file_header *)buf;
+            stream_left = reverser32(file->length);
+            if (stream_left && stream_left <= CART_FILE_IO_MAX) {
+                flash_stage = 5;
+                usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+                return;
+            }
+            current_req = 0;
+            file_ackn.type = reverser16(ACK_ERROR);
+            file_ackn.err = reverser32(ROMFS_ERR_OPERATION);
+            file_ackn.result = 0;
+            file_ackn.length = 0;
+            usb_start_transfer(ep_out, (uint8_t *) & file_ackn, sizeof(struct file_ack));
+            return;
         }
         current_req = 0;
     } else if (flash_stage == 1) {
@@ -811,6 +1065,63 @@ static void ep1_out_handler(uint8_t *buf, uint16_t len)
         }
         flash_stage = 0;
         current_req = 0;
+    } else if (flash_stage == 2) {
+        // after a short packet the rest of the range is drained, the error ack ends it
+        if (len != 64) {
+            syslog(LOG_ERR, "write stream packet size error %d", len);
+            write_error = true;
+        } else if (!write_error) {
+            memmove(&sector_buffer[sector_buffer_pos], buf, 64);
+            sector_buffer_pos += 64;
+            if (sector_buffer_pos == ROMFS_FLASH_SECTOR) {
+                romfs_flash_sector_write(rw_sector_offset, sector_buffer);
+                rw_sector_offset += ROMFS_FLASH_SECTOR;
+                sector_buffer_pos = 0;
+            }
+        }
+        stream_left -= (len < stream_left) ? len : stream_left;
+        if (stream_left) {
+            usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+            return;
+        }
+        if (!write_error) {
+            ackn.type = reverser16(ACK_NOERROR);
+        }
+        flash_stage = 0;
+        current_req = 0;
+    } else if (flash_stage == 4) {
+        if (len != 64) {
+            syslog(LOG_ERR, "write stream packet size error %d", len);
+            lz_error = true;
+        } else if (!lz_error) {
+            memmove(&lz_buffer[lz_buffer_len], buf, 64);
+            lz_buffer_len += 64;
+            lz_stream_next();
+        }
+        stream_left -= (len < stream_left) ? len : stream_left;
+        if (stream_left) {
+            usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+            return;
+        }
+        if (!lz_error && !lz_sectors_left) {
+            ackn.type = reverser16(ACK_NOERROR);
+        }
+        flash_stage = 0;
+        current_req = 0;
+    } else if (flash_stage == 5) {
+        stream_left -= (len < stream_left) ? len : stream_left;
+        if (stream_left) {
+            usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
+            return;
+        }
+        flash_stage = 0;
+        current_req = 0;
+        file_ackn.type = reverser16(ACK_ERROR);
+        file_ackn.err = reverser32(ROMFS_ERR_OPERATION);
+        file_ackn.result = 0;
+        file_ackn.length = 0;
+        usb_start_transfer(ep_out, (uint8_t *) & file_ackn, sizeof(struct file_ack));
+        return;
     }
 
     usb_start_transfer(ep_out, (uint8_t *) & ackn, sizeof(struct ack_header));
@@ -819,6 +1130,10 @@ static void ep1_out_handler(uint8_t *buf, uint16_t len)
 static void ep2_in_handler(uint8_t *buf, uint16_t len)
 {
     // syslog(LOG_DEBUG, "Sent %d bytes to host", len);
+    if (flash_stage == 3) {
+        stream_read_next(usb_get_endpoint_configuration(EP2_IN_ADDR));
+        return;
+    }
     // Get ready to rx again from host
     usb_start_transfer(usb_get_endpoint_configuration(EP1_OUT_ADDR), NULL, 64);
 }
@@ -0,0 +1,197 @@
+/**
+ * Copyright (c) 2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * LZ4 block format, one block per flash sector. The decoder uses its output
+ * as the match window, so the cart needs no RAM besides the sector buffer.
+ * The encoder is a plain greedy matcher for the host side, blocks stay below
+ * 64K so the hash table can hold 16-bit positions.
+ */
+#define CART_LZ_HASH_BITS 12
+#define CART_LZ_MIN_MATCH 4
+/* the last match starts 12 bytes before the end, the last 5 are always literals */
+#define CART_LZ_MF_LIMIT 12
+#define CART_LZ_LAST_LITERALS 5
+
+/* worst case block size for size bytes of incompressible data */
+#define CART_LZ_BOUND(size) ((size) + (size) / 255 + 16)
+
+static inline uint32_t cart_lz_put_length(uint8_t *dst, uint32_t op, uint32_t len)
+{
+    for (len -= 15; len >= 255; len -= 255) {
+        dst[op++] = 255;
+    }
+    dst[op++] = len;
+
+    return op;
+}
+
+static inline uint32_t cart_lz_put_sequence(uint8_t *dst, uint32_t op, const uint8_t *lit, uint32_t lit_len, uint32_t dist, uint32_t match_len)
+{
+    uint32_t token = op++;
+
+    dst[token] = ((lit_len < 15) ? lit_len : 15) << 4;
+    if (lit_len >= 15) {
+        op = cart_lz_put_length(dst, op, lit_len);
+    }
+    for (uint32_t i = 0; i < lit_len; i++) {
+        dst[op++] = lit[i];
+    }
+
+    if (!match_len) {
+        return op;
+    }
+
+    dst[op++] = dist;
+    dst[op++] = dist >> 8;
+    match_len -= CART_LZ_MIN_MATCH;
+    dst[token] |= (match_len < 15) ? match_len : 15;
+    if (match_len >= 15) {
+        op = cart_lz_put_length(dst, op, match_len);
+    }
+
+    return op;
+}
+
+/* Encodes size bytes (below 64K) into dst, which must hold CART_LZ_BOUND(size) */
+static inline uint32_t cart_lz_encode(uint8_t *dst, const uint8_t *src, uint32_t size)
+{
+    uint16_t table[1 << CART_LZ_HASH_BITS];
+    uint32_t anchor = 0;
+    uint32_t ip = 0;
+    uint32_t op = 0;
+
+    for (uint32_t i = 0; i < (1 << CART_LZ_HASH_BITS); i++) {
+        table[i] = 0xffff;
+    }
+
+    while (size > CART_LZ_MF_LIMIT && ip < size - CART_LZ_MF_LIMIT) {
+        uint32_t seq = src[ip] | (src[ip + 1] << 8) | (src[ip + 2] << 16) | ((uint32_t)src[ip + 3] << 24);
+        uint32_t hash = (seq * 2654435761u) >> (32 - CART_LZ_HASH_BITS);
+        uint32_t ref = table[hash];
+
+        table[hash] = ip;
+        if (ref == 0xffff || src[ref] != src[ip] || src[ref + 1] != src[ip + 1] || src[ref + 2] != src[ip + 2] || src[ref + 3] != src[ip + 3]) {
+            ip++;
+            continue;
+        }
+
+        uint32_t len = CART_LZ_MIN_MATCH;
+        while (ip + len < size - CART_LZ_LAST_LITERALS && src[ref + len] == src[ip + len]) {
+            len++;
+        }
+
+        op = cart_lz_put_sequence(dst, op, &src[anchor], ip - anchor, ip - ref, len);
+        ip += len;
+        anchor = ip;
+    }
+
+    return cart_lz_put_sequence(dst, op, &src[anchor], size - anchor, 0, 0);
+}
+
+/* Decodes a block into at most dst_size bytes, returns the decoded size or -1 on a broken block */
+static inline int cart_lz_decode(uint8_t *dst, uint32_t dst_size, const uint8_t *src, uint32_t src_size)
+{
+    uint32_t ip = 0;
+    uint32_t op = 0;
+
+    while (ip < src_size) {
+        uint32_t token = src[ip++];
+        uint32_t len = token >> 4;
+        uint8_t b;
+
+        if (len == 15) {
+            do {
+                if (ip == src_size) {
+                    return -1;
+                }
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        if (len > src_size - ip || len > dst_size - op) {
+            return -1;
+        }
+        while (len--) {
+            dst[op++] = src[ip++];
+        }
+
+        // the last sequence has no match part
+        if (ip == src_size) {
+            break;
+        }
+
+        if (src_size - ip < 2) {
+            return -1;
+        }
+        uint32_t dist = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (!dist || dist > op) {
+            return -1;
+        }
+
+        len = token & 0x0f;
+        if (len == 15) {
+            do {
+                if (ip == src_size) {
+                    return -1;
+                }
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        len += CART_LZ_MIN_MATCH;
+        if (len > dst_size - op) {
+            return -1;
+        }
+        // byte by byte, matches may overlap their own output
+        while (len--) {
+            dst[op] = dst[op - dist];
+            op++;
+        }
+    }
+
+    return op;
+}
+
+/*
+ * A CART_WRITE_LZ record: 16-bit little-endian block size and the block,
+ * or the raw data when it does not compress (block size == size).
+ * dst must hold 2 + CART_LZ_BOUND(size), returns the record length.
+ */
+static inline uint32_t cart_lz_record(uint8_t *dst, const uint8_t *src, uint32_t size)
+{
+    uint32_t len = cart_lz_encode(&dst[2], src, size);
+
+    if (len >= size) {
+        for (uint32_t i = 0; i < size; i++) {
+            dst[2 + i] = src[i];
+        }
+        len = size;
+    }
+    dst[0] = len;
+    dst[1] = len >> 8;
+
+    return 2 + len;
+}
+
+/* Unpacks the data of a record with block size len, true when exactly size bytes came out */
+static inline bool cart_lz_unpack(uint8_t *dst, uint32_t size, const uint8_t *src, uint32_t len)
+{
+    if (len == size) {
+        for (uint32_t i = 0; i < size; i++) {
+            dst[i] = src[i];
+        }
+        return true;
+    }
+
+    return len < size && cart_lz_decode(dst, size, src, len) == (int)size;
+}
@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2024 sashz /pdaXrom.org/
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+//
+// Host check for cart_lz.h: sectors are packed into a CART_WRITE_LZ stream
+// and unpacked record by record the way the cart does, then damaged blocks
+// are fed to the decoder, which must refuse them.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cart_lz.h"
+
+#define SECTOR_SIZE 4096
+#define SECTOR_COUNT 5
+#define NOISE_SECTOR 3
+
+static uint8_t sectors[SECTOR_COUNT * SECTOR_SIZE];
+static uint8_t stream[SECTOR_COUNT * (2 + CART_LZ_BOUND(SECTOR_SIZE)) + 64];
+static uint8_t sector[SECTOR_SIZE];
+
+static bool fail(const char *what, uint32_t index, uint32_t value)
+{
+    printf("  error: %s (%u, %u)\n", what, index, value);
+    return false;
+}
+
+// test pattern, zeros, padding, noise and a directory-like table
+static void fill_sectors(void)
+{
+    uint32_t seed = 0xcafe;
+
+    for (uint32_t i = 0; i < SECTOR_SIZE; i++) {
+        sectors[i] = (3 + i) & 0xff;
+    }
+    memset(&sectors[SECTOR_SIZE], 0, SECTOR_SIZE);
+    memset(&sectors[SECTOR_SIZE * 2], 0xff, SECTOR_SIZE);
+    for (uint32_t i = 0; i < SECTOR_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        sectors[SECTOR_SIZE * NOISE_SECTOR + i] = seed >> 16;
+    }
+
+    uint8_t *table = &sectors[SECTOR_SIZE * 4];
+    memset(table, 0xff, SECTOR_SIZE);
+    for (uint32_t i = 0; i < SECTOR_SIZE / 64; i += 3) {
+        snprintf((char *)&table[i * 64], 56, "game%02u.z64", i);
+        table[i * 64 + 60] = i;
+        table[i * 64 + 62] = 0x10;
+    }
+}
+
+static bool check_round_trip(uint32_t *length)
+{
+    uint32_t pos = 0;
+
+    *length = 0;
+    for (uint32_t i = 0; i < SECTOR_COUNT; i++) {
+        *length += cart_lz_record(&stream[*length], &sectors[i * SECTOR_SIZE], SECTOR_SIZE);
+    }
+    while (*length & 63) {
+        stream[(*length)++] = 0;
+    }
+
+    for (uint32_t i = 0; i < SECTOR_COUNT; i++) {
+        uint32_t len = stream[pos] | (stream[pos + 1] << 8);
+        if (pos + 2 + len > *length || !cart_lz_unpack(sector, SECTOR_SIZE, &stream[pos + 2], len) ||
+            memcmp(sector, &sectors[i * SECTOR_SIZE], SECTOR_SIZE)) {
+            return fail("sector did not survive the round trip", i, len);
+        }
+        // noise must fall back to a raw record, the rest must shrink
+        if ((i == NOISE_SECTOR) != (len == SECTOR_SIZE)) {
+            return fail("unexpected record size", i, len);
+        }
+        pos += 2 + len;
+    }
+
+    return true;
+}
+
+static bool check_damaged(void)
+{
+    uint32_t len = stream[0] | (stream[1] << 8);
+
+    if (cart_lz_unpack(sector, SECTOR_SIZE, &stream[2], len - 1) ||
+        cart_lz_decode(sector, SECTOR_SIZE / 2, &stream[2], len) != -1) {
+        return fail("truncated block was accepted", 0, len);
+    }
+
+    // one literal, then a match two bytes back
+    static const uint8_t bad_match[] = { 0x10, 'A', 0x02, 0x00 };
+    if (cart_lz_decode(sector, SECTOR_SIZE, bad_match, sizeof(bad_match)) != -1) {
+        return fail("match before the start of the sector was accepted", 0, sizeof(bad_match));
+    }
+
+    return true;
+}
+
+int main(void)
+{
+    uint32_t length;
+
+    fill_sectors();
+
+    bool ok = check_round_trip(&length);
+    if (ok) {
+        printf("%u sectors packed into %u bytes\n", SECTOR_COUNT, length);
+        ok = check_damaged();
+    }
+
+    printf("cart_lz: %s\n", ok ? "ok" : "FAILED");
+
+    return ok ? 0 : 1;
+}
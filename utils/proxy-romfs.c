@@ -16,6 +16,7 @@
 #include <alloca.h>
 #endif
 
+#include "cart_lz.h"
 #include "romfs.h"
 #include "utils2.h"
 #include "proxy-romfs.h"
@@ -44,6 +45,120 @@ static int bulk_transfer(struct libusb_device_handle *devh, unsigned char endpoi
     return ret;
 }
 
+// firmware version seen in the last relayed CART_INFO, selects the v2 transfers
+static uint32_t cart_version;
+
+static bool usb_stream_sectors(uint16_t type, uint32_t offset, uint8_t *buffer, uint32_t count)
+{
+    int actual;
+    struct req_range_header romfs_req;
+    struct ack_header romfs_ack;
+    int length = count * ROMFS_FLASH_SECTOR;
+
+    romfs_req.type = type;
+    romfs_req.offset = offset;
+    romfs_req.count = count;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "Stream request error transfer\n");
+        return false;
+    }
+
+    bulk_transfer(dev_handle, (type == CART_WRITE_SECS) ? 0x01 : 0x82, buffer, length, &actual, 5000 + count * 100);
+    if (actual != length) {
+        fprintf(stderr, "Stream data error transfer\n");
+        return false;
+    }
+
+    bulk_transfer(dev_handle, 0x82, (void *)&romfs_ack, sizeof(romfs_ack), &actual, 5000);
+    if (actual != sizeof(romfs_ack)) {
+        fprintf(stderr, "Stream reply error transfer\n");
+        return false;
+    }
+
+    return romfs_ack.type == ACK_NOERROR;
+}
+
+// one CART_WRITE_LZ record, record holds room for the packet padding
+static bool usb_write_lz(uint32_t offset, uint8_t *record, uint32_t length)
+{
+    int actual;
+    struct req_lz_header romfs_req;
+    struct ack_header romfs_ack;
+
+    while (length & 63) {
+        record[length++] = 0;
+    }
+
+    romfs_req.type = CART_WRITE_LZ;
+    romfs_req.offset = offset;
+    romfs_req.count = 1;
+    romfs_req.length = length;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "Compressed write request error transfer\n");
+        return false;
+    }
+
+    bulk_transfer(dev_handle, 0x01, record, length, &actual, 5100);
+    if (actual != length) {
+        fprintf(stderr, "Compressed write data error transfer\n");
+        return false;
+    }
+
+    bulk_transfer(dev_handle, 0x82, (void *)&romfs_ack, sizeof(romfs_ack), &actual, 5000);
+    if (actual != sizeof(romfs_ack)) {
+        fprintf(stderr, "Compressed write reply error transfer\n");
+        return false;
+    }
+
+    return romfs_ack.type == ACK_NOERROR;
+}
+
+static bool usb_read_range(uint32_t offset, uint8_t *buffer, uint32_t length)
+{
+    int actual;
+    struct req_range_header romfs_req;
+    struct range_ack romfs_ack;
+
+    romfs_req.type = CART_READ_RANGE;
+    romfs_req.offset = offset;
+    romfs_req.count = length;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "Range request error transfer\n");
+        return false;
+    }
+
+    if (length) {
+        bulk_transfer(dev_handle, 0x82, buffer, length, &actual, 5000 + length / ROMFS_FLASH_SECTOR * 100);
+        if (actual != length) {
+            fprintf(stderr, "Range data error transfer\n");
+            return false;
+        }
+    }
+
+    bulk_transfer(dev_handle, 0x82, (void *)&romfs_ack, sizeof(romfs_ack), &actual, 5000);
+    if (actual != sizeof(romfs_ack)) {
+        fprintf(stderr, "Range reply error transfer\n");
+        return false;
+    }
+
+    if (romfs_ack.type != ACK_NOERROR || romfs_ack.length != length) {
+        return false;
+    }
+
+    if (romfs_ack.crc != cart_crc32(0, buffer, length)) {
+        fprintf(stderr, "Range read CRC error at %08X\n", offset);
+        return false;
+    }
+
+    return true;
+}
+
 bool romfs_flash_sector_erase(uint32_t offset)
 {
 #ifdef DEBUG
@@ -82,6 +197,15 @@ bool romfs_flash_sector_write(uint32_t offset, uint8_t *buffer)
     printf("flash write %08X (%p)\n", offset, (void *)buffer);
 #endif
 
+    if (cart_version >= CART_WRITE_LZ_VERSION) {
+        uint8_t record[2 + CART_LZ_BOUND(ROMFS_FLASH_SECTOR) + 64];
+        return usb_write_lz(offset, record, cart_lz_record(record, buffer, ROMFS_FLASH_SECTOR));
+    }
+
+    if (cart_version >= CART_V2_VERSION) {
+        return usb_stream_sectors(CART_WRITE_SECS, offset, buffer, 1);
+    }
+
     int actual;
     struct req_header romfs_req;
     struct ack_header romfs_ack;
@@ -135,6 +259,27 @@ bool romfs_flash_sector_read(uint32_t offset, uint8_t *buffer, uint32_t need)
     printf("flash read %08X (%p) %d\n", offset, (void *)buffer, need);
 #endif
 
+    if (cart_version >= CART_READ_RANGE_VERSION) {
+        return usb_read_range(offset, buffer, need);
+    }
+
+    if (cart_version >= CART_V2_VERSION) {
+        uint32_t count = need / ROMFS_FLASH_SECTOR;
+        uint32_t tail = need % ROMFS_FLASH_SECTOR;
+
+        if (count && !usb_stream_sectors(CART_READ_SECS, offset, buffer, count)) {
+            return false;
+        }
+        if (tail) {
+            uint8_t tmp[ROMFS_FLASH_SECTOR];
+            if (!usb_stream_sectors(CART_READ_SECS, offset + count * ROMFS_FLASH_SECTOR, tmp, 1)) {
+                return false;
+            }
+            memmove(&buffer[count * ROMFS_FLASH_SECTOR], tmp, tail);
+        }
+        return true;
+    }
+
     int actual;
     struct req_header romfs_req;
 
@@ -179,6 +324,39 @@ bool romfs_flash_sector_read(uint32_t offset, uint8_t *buffer, uint32_t need)
     return true;
 }
 
+static bool flash_sector_copy(uint32_t offset, uint32_t src_offset)
+{
+#ifdef DEBUG
+    printf("flash copy %08X -> %08X\n", src_offset, offset);
+#endif
+
+    int actual;
+    struct req_copy_header romfs_req;
+    struct ack_header romfs_ack;
+
+    romfs_req.type = CART_COPY_SEC;
+    romfs_req.offset = offset;
+    romfs_req.src_offset = src_offset;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "Header error transfer\n");
+        return false;
+    }
+
+    bulk_transfer(dev_handle, 0x82, (void *)&romfs_ack, sizeof(romfs_ack), &actual, 5000);
+    if (actual != sizeof(romfs_ack)) {
+        fprintf(stderr, "Header reply error transfer\n");
+        return false;
+    }
+
+    if (romfs_ack.type != ACK_NOERROR) {
+        return false;
+    }
+
+    return true;
+}
+
 int tcp_read_all(tcp_channel *c, void *buf, size_t len)
 {
     char *ptr = buf;
@@ -241,6 +419,8 @@ static int usb_romfs(tcp_channel *client)
 
     libusb_claim_interface(dev_handle, 0);
 
+    cart_version = 0;
+
     int actual;
     struct req_header romfs_req;
     struct ack_header romfs_info;
@@ -276,6 +456,10 @@ static int usb_romfs(tcp_channel *client)
                 goto err;
             }
 
+            if (romfs_req.type == CART_INFO && romfs_info.type == ACK_NOERROR) {
+                cart_version = romfs_info.info.vers;
+            }
+
             romfs_info.type = htons(romfs_info.type);
             romfs_info.info.start = htonl(romfs_info.info.start);
             romfs_info.info.size = htonl(romfs_info.info.size);
@@ -349,6 +533,93 @@ static int usb_romfs(tcp_channel *client)
                 fprintf(stderr, "flash sector write error\n");
                 goto err;
             }
+        } else if (cmd == USB_WRITE_SECTOR_LZ) {
+            struct sector_info sec;
+            if ((r = tcp_read_all(client, &sec, sizeof(sec))) != sizeof(sec)) {
+                fprintf(stderr, "tcp_read_all() error at line %d\n", __LINE__);
+                goto err;
+            }
+            sec.offset = ntohl(sec.offset);
+            sec.length = ntohl(sec.length);
+            if (sec.length > ROMFS_FLASH_SECTOR) {
+                fprintf(stderr, "compressed sector size too big %d\n", sec.length);
+                goto err;
+            }
+            uint8_t record[2 + ROMFS_FLASH_SECTOR + 64];
+            if ((r = tcp_read_all(client, &record[2], sec.length)) != sec.length) {
+                fprintf(stderr, "tcp_read_all() error at line %d\n", __LINE__);
+                goto err;
+            }
+            uint8_t ok;
+            if (cart_version >= CART_WRITE_LZ_VERSION) {
+                // the cart unpacks it itself
+                record[0] = sec.length;
+                record[1] = sec.length >> 8;
+                ok = usb_write_lz(sec.offset, record, 2 + sec.length);
+            } else {
+                uint8_t buf[ROMFS_FLASH_SECTOR];
+                ok = cart_lz_unpack(buf, ROMFS_FLASH_SECTOR, &record[2], sec.length) && romfs_flash_sector_write(sec.offset, buf);
+            }
+            if ((r = tcp_write_all(client, &ok, sizeof(ok))) != sizeof(ok)) {
+                fprintf(stderr, "tcp_write_all() error at line %d\n", __LINE__);
+                goto err;
+            }
+            if (!ok) {
+                fprintf(stderr, "flash sector write error\n");
+                goto err;
+            }
+        } else if (cmd == USB_COPY_SECTOR) {
+            struct sector_copy_info sec;
+            if ((r = tcp_read_all(client, &sec, sizeof(sec))) != sizeof(sec)) {
+                fprintf(stderr, "tcp_read_all() error at line %d\n", __LINE__);
+                goto err;
+            }
+            sec.offset = ntohl(sec.offset);
+            sec.src_offset = ntohl(sec.src_offset);
+            uint8_t ok = flash_sector_copy(sec.offset, sec.src_offset);
+            if ((r = tcp_write_all(client, &ok, sizeof(ok))) != sizeof(ok)) {
+                fprintf(stderr, "tcp_write_all() error at line %d\n", __LINE__);
+                goto err;
+            }
+            if (!ok) {
+                fprintf(stderr, "flash sector copy error\n");
+                goto err;
+            }
+        } else if (cmd == USB_PI_STATS) {
+            uint32_t reset;
+            if ((r = tcp_read_all(client, &reset, sizeof(reset))) != sizeof(reset)) {
+                fprintf(stderr, "tcp_read_all() error at line %d\n", __LINE__);
+                goto err;
+            }
+
+            struct req_header stats_req;
+            struct pi_stats_ack stats;
+            stats_req.type = CART_PI_STATS;
+            stats_req.offset = ntohl(reset);
+
+            bulk_transfer(dev_handle, 0x01, (void *)&stats_req, sizeof(stats_req), &actual, 5000);
+            if (actual != sizeof(stats_req)) {
+                fprintf(stderr, "Header error transfer\n");
+                goto err;
+            }
+
+            memset(&stats, 0, sizeof(stats));
+            bulk_transfer(dev_handle, 0x82, (void *)&stats, sizeof(stats), &actual, 5000);
+            if (actual != sizeof(stats)) {
+                stats.type = ACK_ERROR;
+            }
+
+            stats.type = htons(stats.type);
+            stats.rom_words = htonl(stats.rom_words);
+            stats.sram_accesses = htonl(stats.sram_accesses);
+            stats.fram_accesses = htonl(stats.fram_accesses);
+            stats.unknown_hits = htonl(stats.unknown_hits);
+            stats.max_wait = htonl(stats.max_wait);
+
+            if ((r = tcp_write_all(client, &stats, sizeof(stats))) != sizeof(stats)) {
+                fprintf(stderr, "tcp_write_all() error at line %d\n", __LINE__);
+                goto err;
+            }
         }
     }
 
@@ -7,9 +7,17 @@ enum {
     USB_ERASE_SECTOR,
     USB_READ_SECTOR,
     USB_WRITE_SECTOR,
+    USB_COPY_SECTOR,
+    USB_PI_STATS,
+    USB_WRITE_SECTOR_LZ,    // sector_info length is the cart_lz_record() block size
 };
 
 struct __attribute__((__packed__)) sector_info {
     uint32_t offset;
     uint32_t length;
 };
+
+struct __attribute__((__packed__)) sector_copy_info {
+    uint32_t offset;
+    uint32_t src_offset;
+};
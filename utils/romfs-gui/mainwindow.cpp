@@ -167,6 +167,9 @@ void MainWindow::setupActions() {
   connect(renameAction_, &QAction::triggered, this,
           &MainWindow::renameSelection);
 
+  copyAction_ = ui_->actionCopy;
+  connect(copyAction_, &QAction::triggered, this, &MainWindow::copySelection);
+
   formatAction_ = ui_->actionFormat;
   connect(formatAction_, &QAction::triggered, this, &MainWindow::formatRomfs);
 
@@ -316,6 +319,7 @@ void MainWindow::onContextMenuRequested(const QPoint &pos) {
   menu.addAction(downloadAction_);
   menu.addAction(newFolderAction_);
   menu.addAction(renameAction_);
+  menu.addAction(copyAction_);
   menu.addAction(deleteAction_);
   menu.exec(sourceView->viewport()->mapToGlobal(pos));
 }
@@ -437,6 +441,29 @@ void MainWindow::renameSelection() {
   loadDirectory();
 }
 
+void MainWindow::copySelection() {
+  if (!ensureConnected()) {
+    return;
+  }
+  QVector<RomfsEntry> entries = selectedEntries();
+  if (entries.size() != 1 || entries.first().isDirectory) {
+    showInfo(tr("Select a single file to copy"));
+    return;
+  }
+  QString newName =
+      requestText(tr("Copy"), tr("New name:"), entries.first().name);
+  if (newName.isEmpty()) {
+    return;
+  }
+  QString error;
+  if (!device_.copyEntry(entries.first().path,
+                         childPath(currentPath_, newName), false, &error)) {
+    showError(error);
+    return;
+  }
+  loadDirectory();
+}
+
 void MainWindow::formatRomfs() {
   if (!ensureConnected()) {
     return;
@@ -666,6 +693,8 @@ void MainWindow::updateActions() {
   deleteAction_->setEnabled(connected && !selectedEntries().isEmpty());
   newFolderAction_->setEnabled(connected);
   renameAction_->setEnabled(connected && selectedEntries().size() == 1);
+  copyAction_->setEnabled(connected && selectedEntries().size() == 1 &&
+                          !selectedEntries().first().isDirectory);
   formatAction_->setEnabled(connected);
   rebootAction_->setEnabled(connected);
   bootloaderAction_->setEnabled(connected);
@@ -49,6 +49,7 @@ private slots:
     void deleteSelection();
     void createDirectory();
     void renameSelection();
+    void copySelection();
     void formatRomfs();
     void rebootCart();
     void enterBootloader();
@@ -130,6 +131,7 @@ private:
     QAction *deleteAction_ = nullptr;
     QAction *newFolderAction_ = nullptr;
     QAction *renameAction_ = nullptr;
+    QAction *copyAction_ = nullptr;
     QAction *formatAction_ = nullptr;
     QAction *rebootAction_ = nullptr;
     QAction *bootloaderAction_ = nullptr;
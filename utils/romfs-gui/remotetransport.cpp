@@ -1,10 +1,16 @@
 #include "remotetransport.h"
 
+#include <algorithm>
+
 #include <QByteArray>
 #include <QtEndian>
 
 #include "romfs.h"
 
+extern "C" {
+#include "../cart_lz.h"
+}
+
 #include "../proxy-romfs.h"
 #include "../simple-connection-lib/src/tcp.h"
 
@@ -13,6 +19,11 @@ struct RemoteSectorCommand {
     sector_info info;
 } __attribute__((packed));
 
+struct RemoteCopyCommand {
+    uint16_t command;
+    sector_copy_info info;
+} __attribute__((packed));
+
 struct CommandPacket {
     uint16_t command;
     req_header header;
@@ -54,6 +65,7 @@ void RemoteTransport::disconnectDevice()
         tcp_close(channel_);
         channel_ = nullptr;
     }
+    firmwareVersion_ = 0;
 }
 
 bool RemoteTransport::writeAll(const void *data, size_t length, QString *errorString)
@@ -140,6 +152,10 @@ bool RemoteTransport::sendCommand(uint16_t type, ack_header *ack, QString *error
         return false;
     }
 
+    if (type == CART_INFO) {
+        firmwareVersion_ = target->info.vers;
+    }
+
     return true;
 }
 
@@ -174,22 +190,57 @@ bool RemoteTransport::eraseSector(uint32_t offset, QString *errorString)
     return true;
 }
 
+bool RemoteTransport::copySector(uint32_t offset, uint32_t srcOffset, QString *errorString)
+{
+    if (!connectDevice(errorString)) {
+        return false;
+    }
+
+    RemoteCopyCommand command;
+    command.command = qToBigEndian<uint16_t>(USB_COPY_SECTOR);
+    command.info.offset = qToBigEndian<uint32_t>(offset);
+    command.info.src_offset = qToBigEndian<uint32_t>(srcOffset);
+
+    if (!writeAll(&command, sizeof(command), errorString)) {
+        return false;
+    }
+
+    uint8_t ok = 0;
+    if (!readAll(&ok, sizeof(ok), errorString)) {
+        return false;
+    }
+
+    if (!ok) {
+        setLastError(QStringLiteral("Remote copy command failed"));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    return true;
+}
+
 bool RemoteTransport::writeSector(uint32_t offset, const uint8_t *buffer, QString *errorString)
 {
     if (!connectDevice(errorString)) {
         return false;
     }
 
+    uint8_t record[2 + CART_LZ_BOUND(ROMFS_FLASH_SECTOR)];
+    const bool packed = firmwareVersion_ >= CART_WRITE_LZ_VERSION;
+    const uint32_t length = packed ? cart_lz_record(record, buffer, ROMFS_FLASH_SECTOR) - 2 : ROMFS_FLASH_SECTOR;
+
     RemoteSectorCommand command;
-    command.command = qToBigEndian<uint16_t>(USB_WRITE_SECTOR);
+    command.command = qToBigEndian<uint16_t>(packed ? USB_WRITE_SECTOR_LZ : USB_WRITE_SECTOR);
     command.info.offset = qToBigEndian<uint32_t>(offset);
-    command.info.length = qToBigEndian<uint32_t>(ROMFS_FLASH_SECTOR);
+    command.info.length = qToBigEndian<uint32_t>(length);
 
     if (!writeAll(&command, sizeof(command), errorString)) {
         return false;
     }
 
-    if (!writeAll(buffer, ROMFS_FLASH_SECTOR, errorString)) {
+    if (!writeAll(packed ? &record[2] : buffer, length, errorString)) {
         return false;
     }
 
@@ -214,13 +265,16 @@ bool RemoteTransport::readSector(uint32_t offset, uint8_t *buffer, uint32_t leng
         return false;
     }
 
-    RemoteSectorCommand command;
-    command.command = qToBigEndian<uint16_t>(USB_READ_SECTOR);
-    command.info.offset = qToBigEndian<uint32_t>(offset);
-    command.info.length = qToBigEndian<uint32_t>(length);
+    // the proxy serves at most a sector per request, queue them all before reading
+    for (uint32_t pos = 0; pos < length; pos += ROMFS_FLASH_SECTOR) {
+        RemoteSectorCommand command;
+        command.command = qToBigEndian<uint16_t>(USB_READ_SECTOR);
+        command.info.offset = qToBigEndian<uint32_t>(offset + pos);
+        command.info.length = qToBigEndian<uint32_t>(std::min<uint32_t>(length - pos, ROMFS_FLASH_SECTOR));
 
-    if (!writeAll(&command, sizeof(command), errorString)) {
-        return false;
+        if (!writeAll(&command, sizeof(command), errorString)) {
+            return false;
+        }
     }
 
     if (!readAll(buffer, length, errorString)) {
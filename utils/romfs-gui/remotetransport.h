@@ -21,6 +21,7 @@ public:
     bool eraseSector(uint32_t offset, QString *errorString = nullptr) override;
     bool writeSector(uint32_t offset, const uint8_t *buffer, QString *errorString = nullptr) override;
     bool readSector(uint32_t offset, uint8_t *buffer, uint32_t length, QString *errorString = nullptr) override;
+    bool copySector(uint32_t offset, uint32_t srcOffset, QString *errorString = nullptr) override;
 
 private:
     bool writeAll(const void *data, size_t length, QString *errorString);
@@ -29,4 +30,6 @@ private:
     QHostAddress address_;
     quint16 port_ = 0;
     tcp_channel *channel_ = nullptr;
+    // from the last CART_INFO, the proxy takes packed sectors with CART_WRITE_LZ firmware
+    uint32_t firmwareVersion_ = 0;
 };
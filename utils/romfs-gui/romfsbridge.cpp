@@ -39,3 +39,11 @@ extern "C" bool romfs_flash_sector_read(uint32_t offset, uint8_t *buffer, uint32
     }
     return g_currentTransport->readSector(offset, buffer, need, nullptr);
 }
+
+extern "C" bool romfs_bridge_sector_copy(uint32_t offset, uint32_t src_offset)
+{
+    if (!g_currentTransport) {
+        return false;
+    }
+    return g_currentTransport->copySector(offset, src_offset, nullptr);
+}
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstdint>
+
 class RomfsTransport;
 
 void registerRomfsTransport(RomfsTransport *transport);
 RomfsTransport *currentRomfsTransport();
 
+extern "C" bool romfs_bridge_sector_copy(uint32_t offset, uint32_t src_offset);
+
@@ -6,6 +6,7 @@
 #include <QCoreApplication>
 #include <QDebug>
 #include <QDir>
+#include <algorithm>
 #include <cstring>
 #include <utility>
 
@@ -175,6 +176,7 @@ bool RomfsDevice::uploadFile(const QString &localPath, const QString &remotePath
         qint64 fileSize = info.size();
         int romType = -1;
         bool fixPiFreq = (piBusSpeed >= 0);
+        uint32_t crc = 0;
         while (true) {
             qint64 read = in.read(chunk.data(), chunk.size());
             if (read <= 0) {
@@ -231,6 +233,7 @@ bool RomfsDevice::uploadFile(const QString &localPath, const QString &remotePath
             if (romfs_write_file(chunk.constData(), static_cast<uint32_t>(read), &romFile) == 0) {
                 break;
             }
+            crc = cart_crc32(crc, reinterpret_cast<const uint8_t *>(chunk.constData()), static_cast<uint32_t>(read));
             total += read;
             QString description = tr("Uploading %1").arg(info.fileName());
             if (fixRom && romType >= 0 && romType <= 2) {
@@ -266,6 +269,12 @@ bool RomfsDevice::uploadFile(const QString &localPath, const QString &remotePath
             setError(QStringLiteral("Unable to close remote file"), err);
             return false;
         }
+
+        // only when the cart can hash, reading everything back would double the upload time
+        if (transport_->canHashRange()) {
+            emit operationProgress(tr("Verifying %1").arg(info.fileName()), total, fileSize);
+            return verifyFile(remoteBytes, crc, err);
+        }
         return true;
     }, errorString);
 }
@@ -286,7 +295,8 @@ bool RomfsDevice::downloadFile(const QString &remotePath, const QString &localPa
             return false;
         }
 
-        QByteArray chunk(ROMFS_FLASH_SECTOR, Qt::Uninitialized);
+        // large reads let romfs hand whole runs of sectors to one range transfer
+        QByteArray chunk(ROMFS_FLASH_SECTOR * 64, Qt::Uninitialized);
         while (true) {
             int read = romfs_read_file(chunk.data(), chunk.size(), &romFile);
             if (read <= 0) {
@@ -362,6 +372,20 @@ bool RomfsDevice::renameEntry(const QString &oldPath, const QString &newPath, bo
     }, errorString);
 }
 
+bool RomfsDevice::copyEntry(const QString &srcPath, const QString &dstPath, bool createDirs, QString *errorString)
+{
+    return runRomfsOperation([&](QString *err) {
+        QByteArray src = toPathBytes(srcPath);
+        QByteArray dst = toPathBytes(dstPath);
+        uint32_t rc = romfs_copy_path(src.constData(), dst.constData(), reinterpret_cast<uint8_t *>(flashBuffer_.data()), createDirs);
+        if (rc != ROMFS_NOERR) {
+            setError(QStringLiteral("copy failed: %1").arg(QString::fromUtf8(romfs_strerror(rc))), err);
+            return false;
+        }
+        return true;
+    }, errorString);
+}
+
 bool RomfsDevice::format(QString *errorString)
 {
     return runRomfsOperation([&](QString *err) {
@@ -440,6 +464,20 @@ bool RomfsDevice::leaveSpiMode()
     }
 
     QString error;
+    if (cartInfo_.info.vers >= CART_FLASH_JOBS_VERSION) {
+        // let queued flash jobs drain while the bus stays free
+        for (;;) {
+            ack_header status {};
+            if (transport_->sendCommand(CART_FLASH_STATUS, &status, &error)) {
+                break;
+            }
+            if (status.type != ACK_BUSY) {
+                qWarning() << "Failed to poll flash status:" << error;
+                break;
+            }
+        }
+    }
+
     bool ok = transport_->sendCommand(FLASH_QUAD_MODE, nullptr, &error);
     if (!ok) {
         qWarning() << "Failed to switch flash back to quad mode:" << error;
@@ -448,6 +486,52 @@ bool RomfsDevice::leaveSpiMode()
     return ok;
 }
 
+bool RomfsDevice::verifyFile(const QByteArray &remotePath, uint32_t expectedCrc, QString *errorString)
+{
+    romfs_file romFile;
+    if (romfs_open_path(remotePath.constData(), &romFile, reinterpret_cast<uint8_t *>(flashBuffer_.data())) != ROMFS_NOERR) {
+        setError(QStringLiteral("Cannot open %1 for verification").arg(QString::fromUtf8(remotePath)), errorString);
+        return false;
+    }
+
+    uint16_t sectors[256];
+    uint32_t left = romFile.entry.size;
+    uint32_t runOffset = 0;
+    uint32_t runLength = 0;
+    uint32_t crc = 0;
+    uint32_t count;
+
+    // one request per run of consecutive sectors
+    while ((count = romfs_map_iter_next(&romFile, sectors, sizeof(sectors) / sizeof(sectors[0]))) > 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t offset = sectors[i] * ROMFS_FLASH_SECTOR;
+            const uint32_t length = std::min<uint32_t>(left, ROMFS_FLASH_SECTOR);
+            left -= length;
+            if (runLength && runOffset + runLength == offset && runLength + length <= CART_CRC_RANGE_MAX) {
+                runLength += length;
+                continue;
+            }
+            if (runLength && !transport_->hashRange(runOffset, runLength, &crc, errorString)) {
+                return false;
+            }
+            runOffset = offset;
+            runLength = length;
+        }
+    }
+
+    if (runLength && !transport_->hashRange(runOffset, runLength, &crc, errorString)) {
+        return false;
+    }
+
+    if (crc != expectedCrc) {
+        setError(QStringLiteral("Verification failed: CRC %1, expected %2")
+                     .arg(crc, 8, 16, QLatin1Char('0'))
+                     .arg(expectedCrc, 8, 16, QLatin1Char('0')), errorString);
+        return false;
+    }
+    return true;
+}
+
 bool RomfsDevice::restartRomfs(QString *errorString)
 {
     uint32_t mapSize = 0;
@@ -462,10 +546,11 @@ bool RomfsDevice::restartRomfs(QString *errorString)
 
     auto *map = reinterpret_cast<uint16_t *>(flashMap_.data());
     auto *list = reinterpret_cast<uint8_t *>(flashList_.data());
-    if (!romfs_start(cartInfo_.info.start, cartInfo_.info.size, map, list)) {
+    if (!romfs_start_lazy(cartInfo_.info.start, cartInfo_.info.size, map, list)) {
         setError(QStringLiteral("Cannot start ROMFS"), errorString);
         return false;
     }
+    romfs_set_sector_copy(cartInfo_.info.vers >= CART_COPY_SEC_VERSION ? romfs_bridge_sector_copy : nullptr);
     return true;
 }
 
@@ -47,6 +47,7 @@ public:
     bool makeDirectory(const QString &remotePath, QString *errorString = nullptr);
     bool removeDirectory(const QString &remotePath, QString *errorString = nullptr);
     bool renameEntry(const QString &oldPath, const QString &newPath, bool createDirs, QString *errorString = nullptr);
+    bool copyEntry(const QString &srcPath, const QString &dstPath, bool createDirs, QString *errorString = nullptr);
     bool format(QString *errorString = nullptr);
     quint64 freeSpace(QString *errorString = nullptr);
     bool reboot(QString *errorString = nullptr);
@@ -67,6 +68,7 @@ private:
     bool enterSpiMode(QString *errorString);
     bool leaveSpiMode();
     bool restartRomfs(QString *errorString);
+    bool verifyFile(const QByteArray &remotePath, uint32_t expectedCrc, QString *errorString);
     bool runRomfsOperation(const std::function<bool(QString *)> &operation, QString *errorString);
     QVector<RomfsEntry> readDirectory(const QString &path, QString *errorString);
     QByteArray normalizePath(const QString &path) const;
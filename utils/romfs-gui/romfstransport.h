@@ -24,6 +24,24 @@ public:
     virtual bool eraseSector(uint32_t offset, QString *errorString = nullptr) = 0;
     virtual bool writeSector(uint32_t offset, const uint8_t *buffer, QString *errorString = nullptr) = 0;
     virtual bool readSector(uint32_t offset, uint8_t *buffer, uint32_t length, QString *errorString = nullptr) = 0;
+    virtual bool copySector(uint32_t offset, uint32_t srcOffset, QString *errorString = nullptr) = 0;
+
+    // CRC-32 of a flash range computed on the cart, crc holds the value to continue from
+    virtual bool canHashRange() const
+    {
+        return false;
+    }
+    virtual bool hashRange(uint32_t offset, uint32_t length, uint32_t *crc, QString *errorString = nullptr)
+    {
+        Q_UNUSED(offset)
+        Q_UNUSED(length)
+        Q_UNUSED(crc)
+        setLastError(QStringLiteral("Range hashing is not supported"));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
 
     QString lastError() const
     {
@@ -231,6 +231,17 @@
         <source>New name:</source>
         <translation>Новое имя:</translation>
     </message>
+    <message>
+        <location filename="../mainwindow.ui" line="216"/>
+        <location filename="../mainwindow.cpp" line="431"/>
+        <source>Copy</source>
+        <translation>Копировать</translation>
+    </message>
+    <message>
+        <location filename="../mainwindow.cpp" line="427"/>
+        <source>Select a single file to copy</source>
+        <translation>Выберите один файл для копирования</translation>
+    </message>
     <message>
         <location filename="../mainwindow.cpp" line="432"/>
         <source>This will erase the entire cartridge. Continue?</source>
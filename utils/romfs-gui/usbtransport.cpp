@@ -6,6 +6,10 @@
 
 #include "romfs.h"
 
+extern "C" {
+#include "../cart_lz.h"
+}
+
 namespace
 {
 constexpr int kRetryMax = 50;
@@ -89,6 +93,7 @@ void UsbTransport::disconnectDevice()
         libusb_close(handle_);
         handle_ = nullptr;
     }
+    firmwareVersion_ = 0;
     if (ctx_) {
         libusb_exit(ctx_);
         ctx_ = nullptr;
@@ -160,6 +165,216 @@ bool UsbTransport::sendCommand(uint16_t type, ack_header *ack, QString *errorStr
         return false;
     }
 
+    if (type == CART_INFO) {
+        firmwareVersion_ = target->info.vers;
+    }
+
+    return true;
+}
+
+bool UsbTransport::streamSectors(uint16_t type, uint32_t offset, uint8_t *buffer, uint32_t count, QString *errorString)
+{
+    req_range_header req = {};
+    req.type = type;
+    req.offset = offset;
+    req.count = count;
+
+    int actual = 0;
+    int ret = bulkTransfer(kOutEndpoint, reinterpret_cast<unsigned char *>(&req), sizeof(req), &actual, 5000);
+    if (ret != 0 || actual != static_cast<int>(sizeof(req))) {
+        setLastError(QStringLiteral("Flash stream request failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    const int length = static_cast<int>(count * ROMFS_FLASH_SECTOR);
+    ret = bulkTransfer(type == CART_WRITE_SECS ? kOutEndpoint : kInEndpoint, buffer, length, &actual, 5000 + count * 100);
+    if (ret != 0 || actual != length) {
+        setLastError(QStringLiteral("Flash stream data failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    ack_header ack;
+    ret = bulkTransfer(kInEndpoint, reinterpret_cast<unsigned char *>(&ack), sizeof(ack), &actual, 5000);
+    if (ret != 0 || actual != static_cast<int>(sizeof(ack))) {
+        setLastError(QStringLiteral("Flash stream status failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    if (ack.type != ACK_NOERROR) {
+        setLastError(QStringLiteral("Flash stream returned error"));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+    return true;
+}
+
+bool UsbTransport::readRange(uint32_t offset, uint8_t *buffer, uint32_t length, QString *errorString)
+{
+    req_range_header req = {};
+    req.type = CART_READ_RANGE;
+    req.offset = offset;
+    req.count = length;
+
+    int actual = 0;
+    int ret = bulkTransfer(kOutEndpoint, reinterpret_cast<unsigned char *>(&req), sizeof(req), &actual, 5000);
+    if (ret != 0 || actual != static_cast<int>(sizeof(req))) {
+        setLastError(QStringLiteral("Flash range request failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    if (length) {
+        ret = bulkTransfer(kInEndpoint, buffer, static_cast<int>(length), &actual, 5000 + length / ROMFS_FLASH_SECTOR * 100);
+        if (ret != 0 || actual != static_cast<int>(length)) {
+            setLastError(QStringLiteral("Flash range data failed (%1)").arg(ret));
+            if (errorString) {
+                *errorString = lastError();
+            }
+            return false;
+        }
+    }
+
+    range_ack ack;
+    ret = bulkTransfer(kInEndpoint, reinterpret_cast<unsigned char *>(&ack), sizeof(ack), &actual, 5000);
+    if (ret != 0 || actual != static_cast<int>(sizeof(ack))) {
+        setLastError(QStringLiteral("Flash range status failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    if (ack.type != ACK_NOERROR || ack.length != length) {
+        setLastError(QStringLiteral("Flash range returned error"));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    if (ack.crc != cart_crc32(0, buffer, length)) {
+        setLastError(QStringLiteral("Flash range CRC mismatch at 0x%1").arg(offset, 0, 16));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+    return true;
+}
+
+bool UsbTransport::writeCompressed(uint32_t offset, const uint8_t *buffer, QString *errorString)
+{
+    uint8_t stream[2 + CART_LZ_BOUND(ROMFS_FLASH_SECTOR) + 64];
+    uint32_t length = cart_lz_record(stream, buffer, ROMFS_FLASH_SECTOR);
+    // the cart takes whole packets only
+    while (length & 63) {
+        stream[length++] = 0;
+    }
+
+    req_lz_header req = {};
+    req.type = CART_WRITE_LZ;
+    req.offset = offset;
+    req.count = 1;
+    req.length = length;
+
+    int actual = 0;
+    int ret = bulkTransfer(kOutEndpoint, reinterpret_cast<unsigned char *>(&req), sizeof(req), &actual, 5000);
+    if (ret != 0 || actual != static_cast<int>(sizeof(req))) {
+        setLastError(QStringLiteral("Compressed write request failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    ret = bulkTransfer(kOutEndpoint, stream, static_cast<int>(length), &actual, 5100);
+    if (ret != 0 || actual != static_cast<int>(length)) {
+        setLastError(QStringLiteral("Compressed write data failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    ack_header ack;
+    ret = bulkTransfer(kInEndpoint, reinterpret_cast<unsigned char *>(&ack), sizeof(ack), &actual, 5000);
+    if (ret != 0 || actual != static_cast<int>(sizeof(ack))) {
+        setLastError(QStringLiteral("Compressed write status failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    if (ack.type != ACK_NOERROR) {
+        setLastError(QStringLiteral("Compressed write returned error"));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+    return true;
+}
+
+bool UsbTransport::canHashRange() const
+{
+    return handle_ && firmwareVersion_ >= CART_CRC_RANGE_VERSION;
+}
+
+bool UsbTransport::hashRange(uint32_t offset, uint32_t length, uint32_t *crc, QString *errorString)
+{
+    if (!ensureConnected(errorString)) {
+        return false;
+    }
+
+    req_crc_header req = {};
+    req.type = CART_CRC_RANGE;
+    req.offset = offset;
+    req.count = length;
+    req.crc = *crc;
+
+    int actual = 0;
+    int ret = bulkTransfer(kOutEndpoint, reinterpret_cast<unsigned char *>(&req), sizeof(req), &actual, 5000);
+    if (ret != 0 || actual != static_cast<int>(sizeof(req))) {
+        setLastError(QStringLiteral("Flash CRC request failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    range_ack ack;
+    ret = bulkTransfer(kInEndpoint, reinterpret_cast<unsigned char *>(&ack), sizeof(ack), &actual, 5000);
+    if (ret != 0 || actual != static_cast<int>(sizeof(ack))) {
+        setLastError(QStringLiteral("Flash CRC status failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    if (ack.type != ACK_NOERROR || ack.length != length) {
+        setLastError(QStringLiteral("Flash CRC returned error"));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    *crc = ack.crc;
     return true;
 }
 
@@ -203,12 +418,63 @@ bool UsbTransport::eraseSector(uint32_t offset, QString *errorString)
     return true;
 }
 
+bool UsbTransport::copySector(uint32_t offset, uint32_t srcOffset, QString *errorString)
+{
+    if (!ensureConnected(errorString)) {
+        return false;
+    }
+
+    req_copy_header req = {};
+    req.type = CART_COPY_SEC;
+    req.offset = offset;
+    req.src_offset = srcOffset;
+
+    int actual = 0;
+    int ret = bulkTransfer(kOutEndpoint, reinterpret_cast<unsigned char *>(&req), sizeof(req), &actual, 5000);
+    if (ret != 0 || actual != static_cast<int>(sizeof(req))) {
+        setLastError(QStringLiteral("Flash copy request failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    ack_header ack;
+    ret = bulkTransfer(kInEndpoint, reinterpret_cast<unsigned char *>(&ack), sizeof(ack), &actual, 5000);
+    if (ret != 0 || actual != static_cast<int>(sizeof(ack))) {
+        setLastError(QStringLiteral("Flash copy reply failed (%1)").arg(ret));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+
+    if (ack.type != ACK_NOERROR) {
+        setLastError(QStringLiteral("Flash copy returned error"));
+        if (errorString) {
+            *errorString = lastError();
+        }
+        return false;
+    }
+    return true;
+}
+
 bool UsbTransport::writeSector(uint32_t offset, const uint8_t *buffer, QString *errorString)
 {
     if (!ensureConnected(errorString)) {
         return false;
     }
 
+    if (firmwareVersion_ >= CART_WRITE_LZ_VERSION) {
+        return writeCompressed(offset, buffer, errorString);
+    }
+
+    if (firmwareVersion_ >= CART_V2_VERSION) {
+        uint8_t sector[ROMFS_FLASH_SECTOR];
+        std::memcpy(sector, buffer, sizeof(sector));
+        return streamSectors(CART_WRITE_SECS, offset, sector, 1, errorString);
+    }
+
     req_header req = {};
     req.type = CART_WRITE_SEC;
     req.offset = offset;
@@ -280,6 +546,27 @@ bool UsbTransport::readSector(uint32_t offset, uint8_t *buffer, uint32_t length,
         return false;
     }
 
+    if (firmwareVersion_ >= CART_READ_RANGE_VERSION) {
+        return readRange(offset, buffer, length, errorString);
+    }
+
+    if (firmwareVersion_ >= CART_V2_VERSION) {
+        const uint32_t count = length / ROMFS_FLASH_SECTOR;
+        const uint32_t tail = length % ROMFS_FLASH_SECTOR;
+
+        if (count && !streamSectors(CART_READ_SECS, offset, buffer, count, errorString)) {
+            return false;
+        }
+        if (tail) {
+            uint8_t sector[ROMFS_FLASH_SECTOR];
+            if (!streamSectors(CART_READ_SECS, offset + count * ROMFS_FLASH_SECTOR, sector, 1, errorString)) {
+                return false;
+            }
+            std::memcpy(buffer + count * ROMFS_FLASH_SECTOR, sector, tail);
+        }
+        return true;
+    }
+
     req_header req = {};
     req.type = CART_READ_SEC;
     req.offset = offset;
@@ -19,13 +19,21 @@ public:
     bool eraseSector(uint32_t offset, QString *errorString = nullptr) override;
     bool writeSector(uint32_t offset, const uint8_t *buffer, QString *errorString = nullptr) override;
     bool readSector(uint32_t offset, uint8_t *buffer, uint32_t length, QString *errorString = nullptr) override;
+    bool copySector(uint32_t offset, uint32_t srcOffset, QString *errorString = nullptr) override;
+    bool canHashRange() const override;
+    bool hashRange(uint32_t offset, uint32_t length, uint32_t *crc, QString *errorString = nullptr) override;
 
 private:
     int bulkTransfer(unsigned char endpoint, unsigned char *data, int length, int *transferred, unsigned int timeout);
     bool ensureConnected(QString *errorString);
+    bool streamSectors(uint16_t type, uint32_t offset, uint8_t *buffer, uint32_t count, QString *errorString);
+    bool writeCompressed(uint32_t offset, const uint8_t *buffer, QString *errorString);
+    bool readRange(uint32_t offset, uint8_t *buffer, uint32_t length, QString *errorString);
 
     libusb_context *ctx_ = nullptr;
     libusb_device_handle *handle_ = nullptr;
     bool interfaceClaimed_ = false;
+    // taken from the last CART_INFO reply, selects the v2 and range transfers
+    uint32_t firmwareVersion_ = 0;
 };
 
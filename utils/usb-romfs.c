@@ -10,6 +10,7 @@
 #include <alloca.h>
 #endif
 
+#include "cart_lz.h"
 #include "romfs.h"
 #include "utils2.h"
 
@@ -17,6 +18,13 @@
 #define strtoimax strtoll
 #endif
 
+// firmware version from CART_INFO, selects the transfers the cart understands
+static uint32_t cart_version;
+
+// sectors sent as CART_WRITE_LZ records and the bytes they took on the wire
+static uint32_t lz_sectors;
+static uint32_t lz_bytes;
+
 #ifdef ENABLE_REMOTE
 #include "proxy-romfs.h"
 
@@ -80,6 +88,233 @@ static int bulk_transfer(struct libusb_device_handle *devh, unsigned char endpoi
     return ret;
 }
 
+static bool usb_stream_sectors(uint16_t type, uint32_t offset, uint8_t *buffer, uint32_t count)
+{
+    int actual;
+    struct req_range_header romfs_req;
+    struct ack_header romfs_ack;
+    int length = count * ROMFS_FLASH_SECTOR;
+
+    romfs_req.type = type;
+    romfs_req.offset = offset;
+    romfs_req.count = count;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "Stream request error transfer\n");
+        return false;
+    }
+
+    bulk_transfer(dev_handle, (type == CART_WRITE_SECS) ? 0x01 : 0x82, buffer, length, &actual, 5000 + count * 100);
+    if (actual != length) {
+        fprintf(stderr, "Stream data error transfer\n");
+        return false;
+    }
+
+    bulk_transfer(dev_handle, 0x82, (void *)&romfs_ack, sizeof(romfs_ack), &actual, 5000);
+    if (actual != sizeof(romfs_ack)) {
+        fprintf(stderr, "Stream reply error transfer\n");
+        return false;
+    }
+
+    return romfs_ack.type == ACK_NOERROR;
+}
+
+static bool usb_write_lz(uint32_t offset, uint8_t *buffer, uint32_t count)
+{
+    int actual;
+    struct req_lz_header romfs_req;
+    struct ack_header romfs_ack;
+    uint32_t length = 0;
+    bool ok = false;
+
+    uint8_t *stream = malloc(count * (2 + CART_LZ_BOUND(ROMFS_FLASH_SECTOR)) + 64);
+    if (!stream) {
+        fprintf(stderr, "Cannot allocate compression buffer\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        length += cart_lz_record(&stream[length], &buffer[i * ROMFS_FLASH_SECTOR], ROMFS_FLASH_SECTOR);
+    }
+    // the cart takes whole packets only
+    while (length & 63) {
+        stream[length++] = 0;
+    }
+
+    lz_sectors += count;
+    lz_bytes += length;
+
+    romfs_req.type = CART_WRITE_LZ;
+    romfs_req.offset = offset;
+    romfs_req.count = count;
+    romfs_req.length = length;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "Compressed write request error transfer\n");
+        goto out;
+    }
+
+    bulk_transfer(dev_handle, 0x01, stream, length, &actual, 5000 + count * 100);
+    if (actual != length) {
+        fprintf(stderr, "Compressed write data error transfer\n");
+        goto out;
+    }
+
+    bulk_transfer(dev_handle, 0x82, (void *)&romfs_ack, sizeof(romfs_ack), &actual, 5000);
+    if (actual != sizeof(romfs_ack)) {
+        fprintf(stderr, "Compressed write reply error transfer\n");
+        goto out;
+    }
+
+    ok = romfs_ack.type == ACK_NOERROR;
+
+out:
+    free(stream);
+    return ok;
+}
+
+// CART_READ_RANGE and CART_CRC_SECTORS replies, length bytes of data checked by the range_ack
+static bool usb_read_stream(uint16_t type, uint32_t offset, uint32_t count, uint8_t *buffer, uint32_t length)
+{
+    int actual;
+    struct req_range_header romfs_req;
+    struct range_ack romfs_ack;
+
+    romfs_req.type = type;
+    romfs_req.offset = offset;
+    romfs_req.count = count;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "Range request error transfer\n");
+        return false;
+    }
+
+    if (length) {
+        bulk_transfer(dev_handle, 0x82, buffer, length, &actual, 5000 + length / ROMFS_FLASH_SECTOR * 100);
+        if (actual != length) {
+            fprintf(stderr, "Range data error transfer\n");
+            return false;
+        }
+    }
+
+    bulk_transfer(dev_handle, 0x82, (void *)&romfs_ack, sizeof(romfs_ack), &actual, 5000);
+    if (actual != sizeof(romfs_ack)) {
+        fprintf(stderr, "Range reply error transfer\n");
+        return false;
+    }
+
+    if (romfs_ack.type != ACK_NOERROR || romfs_ack.length != length) {
+        return false;
+    }
+
+    if (romfs_ack.crc != cart_crc32(0, buffer, length)) {
+        fprintf(stderr, "Range read CRC error at %08X\n", offset);
+        return false;
+    }
+
+    return true;
+}
+
+static bool usb_read_range(uint32_t offset, uint8_t *buffer, uint32_t length)
+{
+    return usb_read_stream(CART_READ_RANGE, offset, length, buffer, length);
+}
+
+static bool usb_crc_range(uint32_t offset, uint32_t length, uint32_t *crc)
+{
+    int actual;
+    struct req_crc_header romfs_req;
+    struct range_ack romfs_ack;
+
+    romfs_req.type = CART_CRC_RANGE;
+    romfs_req.offset = offset;
+    romfs_req.count = length;
+    romfs_req.crc = *crc;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "CRC request error transfer\n");
+        return false;
+    }
+
+    bulk_transfer(dev_handle, 0x82, (void *)&romfs_ack, sizeof(romfs_ack), &actual, 5000);
+    if (actual != sizeof(romfs_ack)) {
+        fprintf(stderr, "CRC reply error transfer\n");
+        return false;
+    }
+
+    if (romfs_ack.type != ACK_NOERROR || romfs_ack.length != length) {
+        return false;
+    }
+
+    *crc = romfs_ack.crc;
+
+    return true;
+}
+
+// CART_FILE_RPC round trip, false on transport errors, ack->err tells how romfs did
+static bool usb_file_rpc(uint16_t op, uint32_t arg, const void *payload, uint32_t length, uint8_t *reply, uint32_t reply_max, struct file_ack *ack)
+{
+    int actual;
+    struct req_file_header romfs_req;
+
+    romfs_req.type = CART_FILE_RPC;
+    romfs_req.op = op;
+    romfs_req.arg = arg;
+    romfs_req.length = length;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "File request error transfer\n");
+        return false;
+    }
+
+    if (length) {
+        bulk_transfer(dev_handle, 0x01, (void *)payload, length, &actual, 5000);
+        if (actual != length) {
+            fprintf(stderr, "File request data error transfer\n");
+            return false;
+        }
+    }
+
+    // flash writes happen before the reply, a full sector write takes a while
+    bulk_transfer(dev_handle, 0x82, (void *)ack, sizeof(*ack), &actual, 20000);
+    if (actual != sizeof(*ack)) {
+        fprintf(stderr, "File reply error transfer\n");
+        return false;
+    }
+
+    if (ack->type != ACK_NOERROR) {
+        return false;
+    }
+
+    if (ack->length > reply_max) {
+        fprintf(stderr, "File reply too long\n");
+        return false;
+    }
+
+    if (ack->length) {
+        bulk_transfer(dev_handle, 0x82, reply, ack->length, &actual, 5000);
+        if (actual != ack->length) {
+            fprintf(stderr, "File reply data error transfer\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint32_t usb_file_rpc_path(uint16_t op, uint32_t arg, const char *path, uint8_t *reply, struct file_ack *ack)
+{
+    if (!usb_file_rpc(op, arg, path, strlen(path), reply, CART_FILE_IO_MAX, ack)) {
+        return ROMFS_ERR_OPERATION;
+    }
+
+    return ack->err;
+}
 #endif
 
 bool romfs_flash_sector_erase(uint32_t offset)
@@ -148,16 +383,26 @@ bool romfs_flash_sector_write(uint32_t offset, uint8_t *buffer)
         struct sector_info s;
     } cmd;
 
-    cmd.c = htons(USB_WRITE_SECTOR);
+    // proxies that came with CART_WRITE_LZ firmware take the sector packed
+    uint8_t record[2 + CART_LZ_BOUND(ROMFS_FLASH_SECTOR)];
+    bool packed = cart_version >= CART_WRITE_LZ_VERSION;
+    uint32_t length = packed ? cart_lz_record(record, buffer, ROMFS_FLASH_SECTOR) - 2 : ROMFS_FLASH_SECTOR;
+
+    if (packed) {
+        lz_sectors++;
+        lz_bytes += length;
+    }
+
+    cmd.c = htons(packed ? USB_WRITE_SECTOR_LZ : USB_WRITE_SECTOR);
     cmd.s.offset = htonl(offset);
-    cmd.s.length = htonl(4096);
+    cmd.s.length = htonl(length);
 
     if (tcp_write_all(server, &cmd, sizeof(cmd)) != sizeof(cmd)) {
         fprintf(stderr, "Write flash sector write request error\n");
         return false;
     }
 
-    if (tcp_write_all(server, buffer, 4096) != 4096) {
+    if (tcp_write_all(server, packed ? &record[2] : buffer, length) != length) {
         fprintf(stderr, "Write flash sector write data error\n");
         return false;
     }
@@ -172,6 +417,14 @@ bool romfs_flash_sector_write(uint32_t offset, uint8_t *buffer)
         return false;
     }
 #else
+    if (cart_version >= CART_WRITE_LZ_VERSION) {
+        return usb_write_lz(offset, buffer, 1);
+    }
+
+    if (cart_version >= CART_V2_VERSION) {
+        return usb_stream_sectors(CART_WRITE_SECS, offset, buffer, 1);
+    }
+
     int actual;
     struct req_header romfs_req;
     struct ack_header romfs_ack;
@@ -230,13 +483,16 @@ bool romfs_flash_sector_read(uint32_t offset, uint8_t *buffer, uint32_t need)
         struct sector_info s;
     } cmd;
 
-    cmd.c = htons(USB_READ_SECTOR);
-    cmd.s.offset = htonl(offset);
-    cmd.s.length = htonl(need);
+    // the proxy serves at most a sector per request, queue them all before reading
+    for (uint32_t pos = 0; pos < need; pos += ROMFS_FLASH_SECTOR) {
+        cmd.c = htons(USB_READ_SECTOR);
+        cmd.s.offset = htonl(offset + pos);
+        cmd.s.length = htonl((need - pos < ROMFS_FLASH_SECTOR) ? need - pos : ROMFS_FLASH_SECTOR);
 
-    if (tcp_write_all(server, &cmd, sizeof(cmd)) != sizeof(cmd)) {
-        fprintf(stderr, "Write flash sector read request error\n");
-        return false;
+        if (tcp_write_all(server, &cmd, sizeof(cmd)) != sizeof(cmd)) {
+            fprintf(stderr, "Write flash sector read request error\n");
+            return false;
+        }
     }
 
     if (tcp_read_all(server, buffer, need) != need) {
@@ -244,6 +500,27 @@ bool romfs_flash_sector_read(uint32_t offset, uint8_t *buffer, uint32_t need)
         return false;
     }
 #else
+    if (cart_version >= CART_READ_RANGE_VERSION) {
+        return usb_read_range(offset, buffer, need);
+    }
+
+    if (cart_version >= CART_V2_VERSION) {
+        uint32_t count = need / ROMFS_FLASH_SECTOR;
+        uint32_t tail = need % ROMFS_FLASH_SECTOR;
+
+        if (count && !usb_stream_sectors(CART_READ_SECS, offset, buffer, count)) {
+            return false;
+        }
+        if (tail) {
+            uint8_t tmp[ROMFS_FLASH_SECTOR];
+            if (!usb_stream_sectors(CART_READ_SECS, offset + count * ROMFS_FLASH_SECTOR, tmp, 1)) {
+                return false;
+            }
+            memmove(&buffer[count * ROMFS_FLASH_SECTOR], tmp, tail);
+        }
+        return true;
+    }
+
     int actual;
     struct req_header romfs_req;
 
@@ -288,6 +565,111 @@ bool romfs_flash_sector_read(uint32_t offset, uint8_t *buffer, uint32_t need)
     return true;
 }
 
+static bool flash_sector_copy(uint32_t offset, uint32_t src_offset)
+{
+#ifdef DEBUG
+    printf("flash copy %08X -> %08X\n", src_offset, offset);
+#endif
+#ifdef ENABLE_REMOTE
+    struct __attribute__((__packed__)) {
+        uint16_t c;
+        struct sector_copy_info s;
+    } cmd;
+
+    cmd.c = htons(USB_COPY_SECTOR);
+    cmd.s.offset = htonl(offset);
+    cmd.s.src_offset = htonl(src_offset);
+
+    if (tcp_write_all(server, &cmd, sizeof(cmd)) != sizeof(cmd)) {
+        fprintf(stderr, "Write flash sector copy request error\n");
+        return false;
+    }
+
+    uint8_t ok = 0;
+    if (tcp_read_all(server, &ok, sizeof(ok)) != sizeof(ok)) {
+        fprintf(stderr, "Read flash sector copy status error\n");
+        return false;
+    }
+
+    if (!ok) {
+        return false;
+    }
+#else
+    int actual;
+    struct req_copy_header romfs_req;
+    struct ack_header romfs_ack;
+
+    romfs_req.type = CART_COPY_SEC;
+    romfs_req.offset = offset;
+    romfs_req.src_offset = src_offset;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "Header error transfer\n");
+        return false;
+    }
+
+    bulk_transfer(dev_handle, 0x82, (void *)&romfs_ack, sizeof(romfs_ack), &actual, 5000);
+    if (actual != sizeof(romfs_ack)) {
+        fprintf(stderr, "Header reply error transfer\n");
+        return false;
+    }
+
+    if (romfs_ack.type != ACK_NOERROR) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+static bool get_pi_stats(bool reset, struct pi_stats_ack *stats)
+{
+#ifdef ENABLE_REMOTE
+    struct __attribute__((__packed__)) {
+        uint16_t c;
+        uint32_t reset;
+    } cmd;
+
+    cmd.c = htons(USB_PI_STATS);
+    cmd.reset = htonl(reset);
+
+    if (tcp_write_all(server, &cmd, sizeof(cmd)) != sizeof(cmd)) {
+        fprintf(stderr, "PI stats request error transfer\n");
+        return false;
+    }
+
+    if (tcp_read_all(server, stats, sizeof(*stats)) != sizeof(*stats)) {
+        fprintf(stderr, "PI stats reply error transfer\n");
+        return false;
+    }
+
+    stats->type = ntohs(stats->type);
+    stats->rom_words = ntohl(stats->rom_words);
+    stats->sram_accesses = ntohl(stats->sram_accesses);
+    stats->fram_accesses = ntohl(stats->fram_accesses);
+    stats->unknown_hits = ntohl(stats->unknown_hits);
+    stats->max_wait = ntohl(stats->max_wait);
+#else
+    int actual;
+    struct req_header romfs_req;
+    romfs_req.type = CART_PI_STATS;
+    romfs_req.offset = reset;
+
+    bulk_transfer(dev_handle, 0x01, (void *)&romfs_req, sizeof(romfs_req), &actual, 5000);
+    if (actual != sizeof(romfs_req)) {
+        fprintf(stderr, "PI stats request error transfer\n");
+        return false;
+    }
+
+    bulk_transfer(dev_handle, 0x82, (void *)stats, sizeof(*stats), &actual, 5000);
+    if (actual != sizeof(*stats)) {
+        fprintf(stderr, "PI stats reply error transfer\n");
+        return false;
+    }
+#endif
+    return stats->type == ACK_NOERROR;
+}
+
 static bool send_usb_cmd(uint16_t type, struct ack_header *ack)
 {
     struct ack_header romfs_ack;
@@ -337,6 +719,250 @@ static bool send_usb_cmd(uint16_t type, struct ack_header *ack)
     return true;
 }
 
+// lets queued erase and program jobs finish without holding the USB bus
+static bool flash_wait_idle(uint32_t version)
+{
+    struct ack_header ack;
+
+    if (version < CART_FLASH_JOBS_VERSION) {
+        return true;
+    }
+
+    do {
+        if (!send_usb_cmd(CART_FLASH_STATUS, &ack)) {
+            return false;
+        }
+    } while (ack.type == ACK_BUSY);
+
+    return ack.type == ACK_NOERROR;
+}
+
+// CRC-32 of a romfs file, hashed on the cart when the firmware can do it
+static bool file_crc32(const char *path, uint8_t *io_buffer, uint32_t version, uint32_t *crc)
+{
+    romfs_file file;
+
+    if (romfs_open_path(path, &file, io_buffer) != ROMFS_NOERR) {
+        return false;
+    }
+
+    *crc = 0;
+
+#ifndef ENABLE_REMOTE
+    if (version >= CART_CRC_RANGE_VERSION) {
+        uint16_t sectors[256];
+        uint32_t left = file.entry.size;
+        uint32_t run_offset = 0;
+        uint32_t run_length = 0;
+        uint32_t count;
+
+        // one request per run of consecutive sectors
+        while ((count = romfs_map_iter_next(&file, sectors, sizeof(sectors) / sizeof(sectors[0]))) > 0) {
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t offset = sectors[i] * ROMFS_FLASH_SECTOR;
+                uint32_t length = (left < ROMFS_FLASH_SECTOR) ? left : ROMFS_FLASH_SECTOR;
+                left -= length;
+                if (run_length && run_offset + run_length == offset && run_length + length <= CART_CRC_RANGE_MAX) {
+                    run_length += length;
+                    continue;
+                }
+                if (run_length && !usb_crc_range(run_offset, run_length, crc)) {
+                    return false;
+                }
+                run_offset = offset;
+                run_length = length;
+            }
+        }
+
+        if (file.err != ROMFS_NOERR && file.err != ROMFS_ERR_EOF) {
+            return false;
+        }
+
+        return !run_length || usb_crc_range(run_offset, run_length, crc);
+    }
+#else
+    (void)version;
+#endif
+
+    static uint8_t buffer[ROMFS_FLASH_SECTOR * 64];
+    int ret;
+
+    while ((ret = romfs_read_file(buffer, sizeof(buffer), &file)) > 0) {
+        *crc = cart_crc32(*crc, buffer, ret);
+    }
+
+    return file.err == ROMFS_NOERR || file.err == ROMFS_ERR_EOF;
+}
+
+// Converts a chunk of an N64 or V64 ROM to Z64, rom_type starts at -1 and is detected from the first chunk
+static bool rom_fix_byte_order(uint8_t *buffer, int len, int *rom_type)
+{
+    if (*rom_type == -1) {
+        fprintf(stderr, "Detected ROM type: ");
+        if (buffer[0] == 0x80 && buffer[1] == 0x37 && buffer[2] == 0x12 && buffer[3] == 0x40) {
+            *rom_type = 0;
+            fprintf(stderr, "Z64\n");
+        } else if (buffer[0] == 0x40 && buffer[1] == 0x12 && buffer[2] == 0x37 && buffer[3] == 0x80) {
+            *rom_type = 1;
+            fprintf(stderr, "N64\n");
+        } else if (buffer[0] == 0x37 && buffer[1] == 0x80 && buffer[2] == 0x40 && buffer[3] == 0x12) {
+            *rom_type = 2;
+            fprintf(stderr, "V64\n");
+        } else {
+            fprintf(stderr, "Unknown\n\nError!\n");
+            return false;
+        }
+    }
+
+    if (len % 4 != 0) {
+        fprintf(stderr, "Unaligned read from local file, error!\n");
+        return false;
+    }
+
+    if (*rom_type) {
+        for (int i = 0; i < len; i += 4) {
+            uint8_t tmp;
+            if (*rom_type == 1) {
+                tmp = buffer[i + 0];
+                buffer[i + 0] = buffer[i + 3];
+                buffer[i + 3] = tmp;
+                tmp = buffer[i + 2];
+                buffer[i + 2] = buffer[i + 1];
+                buffer[i + 1] = tmp;
+            } else if (*rom_type == 2) {
+                tmp = buffer[i + 0];
+                buffer[i + 0] = buffer[i + 1];
+                buffer[i + 1] = tmp;
+                tmp = buffer[i + 2];
+                buffer[i + 2] = buffer[i + 3];
+                buffer[i + 3] = tmp;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool rom_fix_pi_freq(uint8_t *buffer, uint16_t pi_freq)
+{
+    if (buffer[0] == 0x80 && buffer[1] == 0x37 && buffer[3] == 0x40) {
+        printf("PI bus freq set to %02X\n", pi_freq);
+        buffer[2] = pi_freq;
+        return true;
+    }
+
+    fprintf(stderr, "Rom type is not Z64, use --fix-rom to convert to Z64 type!\n");
+    return false;
+}
+
+// Per-sector CRC-32 of count sectors from offset, hashed on the cart when the firmware can do it
+static bool sector_crcs(uint32_t version, uint32_t offset, uint32_t count, uint32_t *crcs)
+{
+#ifndef ENABLE_REMOTE
+    if (version >= CART_CRC_SECTORS_VERSION) {
+        uint8_t data[CART_CRC_SECTORS_MAX * 4];
+        if (count > CART_CRC_SECTORS_MAX || !usb_read_stream(CART_CRC_SECTORS, offset, count, data, count * 4)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            crcs[i] = data[i * 4] | (data[i * 4 + 1] << 8) | (data[i * 4 + 2] << 16) | ((uint32_t)data[i * 4 + 3] << 24);
+        }
+        return true;
+    }
+#else
+    (void)version;
+#endif
+
+    uint8_t data[ROMFS_FLASH_SECTOR];
+    for (uint32_t i = 0; i < count; i++) {
+        if (!romfs_flash_sector_read(offset + i * ROMFS_FLASH_SECTOR, data, ROMFS_FLASH_SECTOR)) {
+            return false;
+        }
+        crcs[i] = cart_crc32(0, data, ROMFS_FLASH_SECTOR);
+    }
+
+    return true;
+}
+
+//
+// Brings an existing remote file up to date with local data of the same
+// size by rewriting only the sectors whose hashes differ, in place.
+//
+static bool sync_sectors(romfs_file *file, uint8_t *data, uint32_t size, uint32_t version, uint32_t *updated)
+{
+    uint32_t num_sectors = (size + ROMFS_FLASH_SECTOR - 1) / ROMFS_FLASH_SECTOR;
+    uint16_t *sectors = malloc(num_sectors * sizeof(uint16_t));
+    uint32_t *crcs = malloc(num_sectors * sizeof(uint32_t));
+    uint32_t count = 0;
+    uint32_t got;
+    bool ok = false;
+
+    *updated = 0;
+
+    if (!num_sectors) {
+        ok = true;
+        goto out;
+    }
+
+    if (!sectors || !crcs) {
+        fprintf(stderr, "Out of memory\n");
+        goto out;
+    }
+
+    while (count < num_sectors && (got = romfs_map_iter_next(file, &sectors[count], num_sectors - count)) > 0) {
+        count += got;
+    }
+    if (count != num_sectors) {
+        fprintf(stderr, "romfs sector chain error %s\n", romfs_strerror(file->err));
+        goto out;
+    }
+
+    // hash runs of consecutive sectors in one request
+    for (uint32_t i = 0; i < num_sectors;) {
+        uint32_t run = 1;
+        while (i + run < num_sectors && run < CART_CRC_SECTORS_MAX && sectors[i + run] == sectors[i] + run) {
+            run++;
+        }
+        if (!sector_crcs(version, sectors[i] * ROMFS_FLASH_SECTOR, run, &crcs[i])) {
+            fprintf(stderr, "Cannot hash remote sectors at %08X\n", sectors[i] * ROMFS_FLASH_SECTOR);
+            goto out;
+        }
+        i += run;
+    }
+
+    for (uint32_t i = 0; i < num_sectors; i++) {
+        uint32_t offset = sectors[i] * ROMFS_FLASH_SECTOR;
+        uint8_t sector[ROMFS_FLASH_SECTOR];
+        uint32_t len = (size - i * ROMFS_FLASH_SECTOR < ROMFS_FLASH_SECTOR) ? size - i * ROMFS_FLASH_SECTOR : ROMFS_FLASH_SECTOR;
+
+        memmove(sector, &data[i * ROMFS_FLASH_SECTOR], len);
+        if (len < ROMFS_FLASH_SECTOR) {
+            // keep whatever follows the end of file in the last sector
+            if (!romfs_flash_sector_read(offset + len, &sector[len], ROMFS_FLASH_SECTOR - len)) {
+                goto out;
+            }
+        }
+
+        if (cart_crc32(0, sector, ROMFS_FLASH_SECTOR) != crcs[i]) {
+            if (!romfs_flash_sector_erase(offset) || !romfs_flash_sector_write(offset, sector)) {
+                fprintf(stderr, "Cannot update sector at %08X\n", offset);
+                goto out;
+            }
+            (*updated)++;
+        }
+        printf("\rSync %.1f%%", (double)(i + 1) / (double)num_sectors * 100.);
+        fflush(stdout);
+    }
+    printf("\n");
+
+    ok = true;
+
+out:
+    free(sectors);
+    free(crcs);
+    return ok;
+}
+
 static const char *find_filename(const char *path)
 {
     const char *pos = strrchr(path, '/');
@@ -346,6 +972,100 @@ static const char *find_filename(const char *path)
     return pos + 1;
 }
 
+// push and sync options, applied to the data before it goes to the cart
+struct push_options {
+    bool fix_endian;
+    int rom_type;
+    bool fix_pi_freq;
+    uint16_t pi_freq;
+    bool verify;
+};
+
+// Returns the index of the first argument after the options
+static int push_options_parse(int argc, char *argv[], struct push_options *opts)
+{
+    opts->fix_endian = false;
+    opts->rom_type = -1;
+    opts->fix_pi_freq = false;
+    opts->pi_freq = 0xff;
+    opts->verify = false;
+
+    int argi = 2;
+    while (argi < argc) {
+        const char *arg = argv[argi];
+        if (!strcmp(arg, "--fix-rom")) {
+            opts->fix_endian = true;
+        } else if (!strncmp(arg, "--fix-pi-bus-speed", 18)) {
+            opts->fix_pi_freq = true;
+            if (arg[18] == '=') {
+                opts->pi_freq = strtoimax(&arg[19], NULL, 16) & 0xff;
+                if (opts->pi_freq < 0x12) {
+                    opts->pi_freq = 0x12;
+                }
+            }
+        } else if (!strcmp(arg, "--verify")) {
+            opts->verify = true;
+        } else {
+            break;
+        }
+        argi++;
+    }
+
+    return argi;
+}
+
+static bool romfs_is_dir(const char *path)
+{
+    romfs_dir dir;
+
+    return romfs_dir_open_path(path, &dir) == ROMFS_NOERR;
+}
+
+//
+// Remote path for a pushed file, an existing directory or a trailing slash
+// takes the local file name. The caller frees it, NULL when out of memory.
+//
+static char *push_remote_path(const char *local_path, const char *remote_arg, bool (*is_dir)(const char *path))
+{
+    const char *basename = find_filename(local_path);
+    size_t arg_len = remote_arg ? strlen(remote_arg) : 0;
+
+    if (!arg_len) {
+        return strdup(basename);
+    }
+
+    if (remote_arg[arg_len - 1] == '/') {
+        arg_len--;
+    } else if (!is_dir(remote_arg)) {
+        return strdup(remote_arg);
+    }
+
+    if (!arg_len) {
+        return strdup(basename);
+    }
+
+    char *path = malloc(arg_len + 1 + strlen(basename) + 1);
+    if (path) {
+        sprintf(path, "%.*s/%s", (int)arg_len, remote_arg, basename);
+    }
+    return path;
+}
+
+// sync writes a resized file here first, next to the file it replaces
+#define SYNC_TEMP_NAME ".sync.tmp"
+
+static char *sync_temp_path(const char *remote_path)
+{
+    size_t dir_len = find_filename(remote_path) - remote_path;
+    char *path = malloc(dir_len + sizeof(SYNC_TEMP_NAME));
+
+    if (path) {
+        memcpy(path, remote_path, dir_len);
+        strcpy(&path[dir_len], SYNC_TEMP_NAME);
+    }
+    return path;
+}
+
 static const char *human_readable_size(double bytes, char *buf, size_t bufsize)
 {
     const char *units[] = {"B", "KB", "MB", "GB", "TB", "PB"};
@@ -360,6 +1080,128 @@ static const char *human_readable_size(double bytes, char *buf, size_t bufsize)
     return buf;
 }
 
+#ifndef ENABLE_REMOTE
+static void print_file_entry(const struct file_entry *entry, bool conv)
+{
+    char num_buf[128];
+    bool is_dir = (entry->type == ROMFS_TYPE_DIR);
+
+    if (conv) {
+        printf("%02X %03X %10s %s%s\n", entry->mode, entry->type, is_dir ? "-" : human_readable_size(entry->size, num_buf, sizeof(num_buf)), entry->name, is_dir ? "/" : "");
+    } else {
+        printf("%02X %03X %10u %s%s\n", entry->mode, entry->type, is_dir ? 0u : entry->size, entry->name, is_dir ? "/" : "");
+    }
+}
+
+//
+// Runs a metadata command with the filesystem on the cart, so the flash map
+// and directory sectors stay there. File data keeps going through the sector
+// path, which streams whole ranges and compresses writes. Returns false for
+// commands that need the local romfs or when the cart can't take requests.
+//
+static bool file_rpc_command(int argc, char *argv[], int *retval)
+{
+    static const char *const commands[] = { "free", "list", "delete", "mkdir", "rmdir", "rename" };
+    static uint8_t reply[CART_FILE_IO_MAX];
+    struct file_ack ack;
+    char num_buf[128];
+    uint32_t err;
+    size_t cmd;
+
+    for (cmd = 0; cmd < sizeof(commands) / sizeof(commands[0]); cmd++) {
+        if (!strcmp(argv[1], commands[cmd])) {
+            break;
+        }
+    }
+    if (cmd == sizeof(commands) / sizeof(commands[0])) {
+        return false;
+    }
+
+    // the menu answers file requests with an error, the free space is kept for the reply.
+    // A cart that has no room for the filesystem next to a large save fails the probe
+    // with an error of its own and the local romfs takes the command.
+    if (!usb_file_rpc(FILE_RPC_FREE, 0, NULL, 0, reply, sizeof(reply), &ack) || ack.err != ROMFS_NOERR) {
+        return false;
+    }
+    uint32_t free_bytes = ack.result;
+
+    if (!strcmp(argv[1], "free")) {
+        printf("Free %d bytes (%s)\n", free_bytes, human_readable_size(free_bytes, num_buf, sizeof(num_buf)));
+        *retval = 0;
+    } else if (!strcmp(argv[1], "list")) {
+        const char *path = "";
+        bool conv = false;
+        for (int i = 2; i < argc; i++) {
+            if (!strcmp(argv[i], "-h")) {
+                conv = true;
+            } else {
+                path = argv[i];
+            }
+        }
+
+        uint32_t cursor = 0;
+        uint32_t listed = 0;
+        printf("\n");
+        do {
+            if ((err = usb_file_rpc_path(FILE_RPC_LIST, cursor, path, reply, &ack)) != ROMFS_NOERR) {
+                break;
+            }
+            for (uint32_t pos = 0; pos + sizeof(struct file_entry) <= ack.length; pos += sizeof(struct file_entry)) {
+                print_file_entry((struct file_entry *)&reply[pos], conv);
+                listed++;
+            }
+            cursor = ack.result;
+        } while (cursor);
+
+        if (err != ROMFS_NOERR) {
+            fprintf(stderr, "Error: [%s] %s!\n", path[0] ? path : "/", romfs_strerror(err));
+        } else {
+            if (!listed) {
+                printf("(empty)\n");
+            }
+            printf("\nFree %d bytes (%s)\n", free_bytes, human_readable_size(free_bytes, num_buf, sizeof(num_buf)));
+            *retval = 0;
+        }
+    } else if (!strcmp(argv[1], "delete") || !strcmp(argv[1], "mkdir") || !strcmp(argv[1], "rmdir")) {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s %s <path>\n", argv[0], argv[1]);
+            return true;
+        }
+        uint16_t op = !strcmp(argv[1], "delete") ? FILE_RPC_DELETE : !strcmp(argv[1], "mkdir") ? FILE_RPC_MKDIR : FILE_RPC_RMDIR;
+        if ((err = usb_file_rpc_path(op, 0, argv[2], reply, &ack)) != ROMFS_NOERR) {
+            fprintf(stderr, "Error: [%s] %s!\n", argv[2], romfs_strerror(err));
+        } else {
+            *retval = 0;
+        }
+    } else if (!strcmp(argv[1], "rename")) {
+        if (argc < 4 || argc > 5 || (argc == 5 && strcmp(argv[4], "--create-dirs"))) {
+            fprintf(stderr, "Usage: %s rename <source> <destination> [--create-dirs]\n", argv[0]);
+            return true;
+        }
+        size_t src_len = strlen(argv[2]) + 1;
+        size_t dst_len = strlen(argv[3]);
+        if (src_len + dst_len > sizeof(reply)) {
+            fprintf(stderr, "Rename failed: %s\n", romfs_strerror(ROMFS_ERR_FILE_DATA_TOO_BIG));
+            return true;
+        }
+        uint8_t paths[CART_FILE_IO_MAX];
+        memcpy(paths, argv[2], src_len);
+        memcpy(&paths[src_len], argv[3], dst_len);
+        if (!usb_file_rpc(FILE_RPC_RENAME, (argc == 5) ? FILE_RPC_CREATE_DIRS : 0, paths, src_len + dst_len, reply, sizeof(reply), &ack)) {
+            fprintf(stderr, "Rename failed: %s\n", romfs_strerror(ROMFS_ERR_OPERATION));
+        } else if (ack.err != ROMFS_NOERR) {
+            fprintf(stderr, "Rename failed: %s\n", romfs_strerror(ack.err));
+        } else {
+            *retval = 0;
+        }
+    } else {
+        return false;
+    }
+
+    return true;
+}
+#endif
+
 static void usage(void)
 {
 #ifdef ENABLE_REMOTE
@@ -371,13 +1213,16 @@ static void usage(void)
     fprintf(stderr, "%s help\n", str);
     fprintf(stderr, "%s bootloader\n", str);
     fprintf(stderr, "%s reboot\n", str);
+    fprintf(stderr, "%s stats [--reset]\n", str);
     fprintf(stderr, "%s format\n", str);
     fprintf(stderr, "%s list [-h] [path]\n", str);
     fprintf(stderr, "%s delete <path>\n", str);
     fprintf(stderr, "%s mkdir <path>\n", str);
     fprintf(stderr, "%s rmdir <path>\n", str);
     fprintf(stderr, "%s rename <source> <destination> [--create-dirs]\n", str);
-    fprintf(stderr, "%s push [--fix-rom][--fix-pi-bus-speed[=12..FF]] <local filename>[ <remote path>]\n", str);
+    fprintf(stderr, "%s cp <source> <destination> [--create-dirs]\n", str);
+    fprintf(stderr, "%s push [--fix-rom][--fix-pi-bus-speed[=12..FF]][--verify] <local filename>[ <remote path>]\n", str);
+    fprintf(stderr, "%s sync [--fix-rom][--fix-pi-bus-speed[=12..FF]][--verify] <local filename>[ <remote path>]\n", str);
     fprintf(stderr, "%s pull <remote path>[ <local filename>]\n", str);
     fprintf(stderr, "%s free\n", str);
 }
@@ -426,11 +1271,14 @@ int main(int argc, char *argv[])
 #endif
 
     struct ack_header romfs_info;
+    romfs_write_stats write_stats;
 
     if (!send_usb_cmd(CART_INFO, &romfs_info)) {
         goto err;
     }
 
+    cart_version = romfs_info.info.vers;
+
     printf("firmware version  : %d.%d\n", romfs_info.info.vers >> 8, romfs_info.info.vers & 0xff);
     printf("ROMFS start offset: %08X\n", romfs_info.info.start);
     printf("ROMFS flash size  : %d\n", romfs_info.info.size);
@@ -444,23 +1292,47 @@ int main(int argc, char *argv[])
             if (send_usb_cmd(CART_REBOOT, NULL)) {
                 retval = 0;
             }
+        } else if (!strcmp(argv[1], "stats")) {
+            struct pi_stats_ack stats;
+            if (romfs_info.info.vers < CART_PI_STATS_VERSION) {
+                fprintf(stderr, "PI statistics are not supported by this firmware\n");
+            } else if (get_pi_stats(argc > 2 && !strcmp(argv[2], "--reset"), &stats)) {
+                printf("ROM words served  : %u\n", stats.rom_words);
+                printf("SRAM accesses     : %u\n", stats.sram_accesses);
+                printf("FlashRAM accesses : %u\n", stats.fram_accesses);
+                printf("Unknown addresses : %u\n", stats.unknown_hits);
+                printf("Max flash wait    : %u\n", stats.max_wait);
+                retval = 0;
+            } else {
+                fprintf(stderr, "Cannot read PI statistics\n");
+            }
         } else {
             if (!send_usb_cmd(FLASH_SPI_MODE, NULL)) {
                 fprintf(stderr, "cannot switch flash to spi mode, error!\n");
                 goto err_io;
             }
 
+#ifndef ENABLE_REMOTE
+            if (romfs_info.info.vers >= CART_FILE_RPC_VERSION && file_rpc_command(argc, argv, &retval)) {
+                goto err_io;
+            }
+#endif
+
             uint32_t flash_map_size, flash_list_size;
             romfs_get_buffers_sizes(romfs_info.info.size, &flash_map_size, &flash_list_size);
             uint16_t *romfs_flash_map = alloca(flash_map_size);
             uint8_t *romfs_flash_list = alloca(flash_list_size);
             uint8_t *romfs_flash_buffer = alloca(ROMFS_FLASH_SECTOR);
 
-            if (!romfs_start(romfs_info.info.start, romfs_info.info.size, romfs_flash_map, romfs_flash_list)) {
+            if (!romfs_start_lazy(romfs_info.info.start, romfs_info.info.size, romfs_flash_map, romfs_flash_list)) {
                 printf("Cannot start romfs!\n");
                 goto err_io;
             }
 
+            if (romfs_info.info.vers >= CART_COPY_SEC_VERSION) {
+                romfs_set_sector_copy(flash_sector_copy);
+            }
+
             if (!strcmp(argv[1], "format")) {
                 if (romfs_format()) {
                     retval = 0;
@@ -578,75 +1450,47 @@ int main(int argc, char *argv[])
                 } else {
                     retval = 0;
                 }
-            } else if (!strcmp(argv[1], "push")) {
-                bool fix_endian = false;
-                int rom_type = -1;
-                bool fix_pi_freq = false;
-                uint16_t pi_freq = 0xff;
-
-                int argi = 2;
-                while (argi < argc) {
-                    const char *arg = argv[argi];
-                    if (!strcmp(arg, "--fix-rom")) {
-                        fix_endian = true;
-                        argi++;
-                    } else if (!strncmp(arg, "--fix-pi-bus-speed", 18)) {
-                        fix_pi_freq = true;
-                        if (arg[18] == '=') {
-                            pi_freq = strtoimax(&arg[19], NULL, 16) & 0xff;
-                            if (pi_freq < 0x12) {
-                                pi_freq = 0x12;
-                            }
-                        }
-                        argi++;
+            } else if (!strcmp(argv[1], "cp")) {
+                if (argc < 4 || argc > 5) {
+                    fprintf(stderr, "Usage: %s cp <source> <destination> [--create-dirs]\n", argv[0]);
+                    goto err_io;
+                }
+
+                const char *src_path = argv[2];
+                const char *dst_path = argv[3];
+                bool create_dirs = false;
+
+                if (argc == 5) {
+                    if (!strcmp(argv[4], "--create-dirs")) {
+                        create_dirs = true;
                     } else {
-                        break;
+                        fprintf(stderr, "Unknown option '%s'\n", argv[4]);
+                        goto err_io;
                     }
                 }
 
+                uint32_t err = romfs_copy_path(src_path, dst_path, romfs_flash_buffer, create_dirs);
+                if (err != ROMFS_NOERR) {
+                    fprintf(stderr, "Copy failed: %s\n", romfs_strerror(err));
+                } else {
+                    retval = 0;
+                }
+            } else if (!strcmp(argv[1], "push")) {
+                struct push_options opts;
+                uint32_t local_crc = 0;
+
+                int argi = push_options_parse(argc, argv, &opts);
+
                 if (argi >= argc) {
                     fprintf(stderr, "Usage: %s push [options] <local filename> [<remote path>]\n", argv[0]);
                     goto err_io;
                 }
 
                 const char *local_path = argv[argi++];
-                const char *remote_arg = (argi < argc) ? argv[argi] : NULL;
-                const char *basename = find_filename(local_path);
-
-                char *remote_path = NULL;
-                if (!remote_arg || remote_arg[0] == '\0') {
-                    remote_path = strdup(basename);
-                } else {
-                    size_t arg_len = strlen(remote_arg);
-                    bool treat_as_dir = (arg_len > 0 && remote_arg[arg_len - 1] == '/');
-
-                    if (!treat_as_dir) {
-                        romfs_dir existing_dir;
-                        if (romfs_dir_open_path(remote_arg, &existing_dir) == ROMFS_NOERR) {
-                            treat_as_dir = true;
-                        }
-                    }
-
-                    if (treat_as_dir) {
-                        if (arg_len > 0 && remote_arg[arg_len - 1] == '/') {
-                            arg_len--; // trim trailing slash for concatenation
-                        }
-                        size_t new_len = arg_len + (arg_len ? 1 : 0) + strlen(basename);
-                        remote_path = malloc(new_len + 1);
-                        if (!remote_path) {
-                            fprintf(stderr, "Out of memory creating remote path\n");
-                            goto err_io;
-                        }
-                        if (arg_len) {
-                            memcpy(remote_path, remote_arg, arg_len);
-                            remote_path[arg_len++] = '/';
-                            memcpy(remote_path + arg_len, basename, strlen(basename) + 1);
-                        } else {
-                            strcpy(remote_path, basename);
-                        }
-                    } else {
-                        remote_path = strdup(remote_arg);
-                    }
+                char *remote_path = push_remote_path(local_path, (argi < argc) ? argv[argi] : NULL, romfs_is_dir);
+                if (!remote_path) {
+                    fprintf(stderr, "Out of memory creating remote path\n");
+                    goto err_io;
                 }
 
                 FILE *inf = fopen(local_path, "rb");
@@ -672,65 +1516,21 @@ int main(int argc, char *argv[])
                 int total = 0;
                 printf("\n");
                 while ((ret = fread(buffer, 1, sizeof(buffer), inf)) > 0) {
-                    if (fix_endian) {
-                        if (rom_type == -1) {
-                            fprintf(stderr, "Detected ROM type: ");
-                            if (buffer[0] == 0x80 && buffer[1] == 0x37 && buffer[2] == 0x12 && buffer[3] == 0x40) {
-                                rom_type = 0;
-                                fprintf(stderr, "Z64\n");
-                            } else if (buffer[0] == 0x40 && buffer[1] == 0x12 && buffer[2] == 0x37 && buffer[3] == 0x80) {
-                                rom_type = 1;
-                                fprintf(stderr, "N64\n");
-                            } else if (buffer[0] == 0x37 && buffer[1] == 0x80 && buffer[2] == 0x40 && buffer[3] == 0x12) {
-                                rom_type = 2;
-                                fprintf(stderr, "V64\n");
-                            } else {
-                                fprintf(stderr, "Unknown\n\nError!\n");
-                                break;
-                            }
-                        }
-
-                        if (ret % 4 != 0) {
-                            fprintf(stderr, "Unaligned read from local file, error!\n");
-                            break;
-                        }
-
-                        if (rom_type) {
-                            for (int i = 0; i < ret; i += 4) {
-                                uint8_t tmp;
-                                if (rom_type == 1) {
-                                    tmp = buffer[i + 0];
-                                    buffer[i + 0] = buffer[i + 3];
-                                    buffer[i + 3] = tmp;
-                                    tmp = buffer[i + 2];
-                                    buffer[i + 2] = buffer[i + 1];
-                                    buffer[i + 1] = tmp;
-                                } else if (rom_type == 2) {
-                                    tmp = buffer[i + 0];
-                                    buffer[i + 0] = buffer[i + 1];
-                                    buffer[i + 1] = tmp;
-                                    tmp = buffer[i + 2];
-                                    buffer[i + 2] = buffer[i + 3];
-                                    buffer[i + 3] = tmp;
-                                }
-                            }
-                        }
+                    if (opts.fix_endian && !rom_fix_byte_order(buffer, ret, &opts.rom_type)) {
+                        break;
                     }
 
-                    if (fix_pi_freq) {
-                        if (buffer[0] == 0x80 && buffer[1] == 0x37 && buffer[3] == 0x40) {
-                            printf("PI bus freq set to %02X\n", pi_freq);
-                            buffer[2] = pi_freq;
-                        } else {
-                            fprintf(stderr, "Rom type is not Z64, use --fix-rom to convert to Z64 type!\n");
+                    if (opts.fix_pi_freq) {
+                        if (!rom_fix_pi_freq(buffer, opts.pi_freq)) {
                             break;
                         }
-                        fix_pi_freq = false;
+                        opts.fix_pi_freq = false;
                     }
 
                     if (romfs_write_file(buffer, ret, &file) == 0) {
                         break;
                     }
+                    local_crc = cart_crc32(local_crc, buffer, ret);
                     total += ret;
                     printf("\rWrite %.1f%%", (double)total / (double)file_size * 100.);
                     fflush(stdout);
@@ -740,6 +1540,16 @@ int main(int argc, char *argv[])
                 if (file.err == ROMFS_NOERR) {
                     if (romfs_close_file(&file) != ROMFS_NOERR) {
                         fprintf(stderr, "romfs close error %s\n", romfs_strerror(file.err));
+                    } else if (opts.verify) {
+                        uint32_t remote_crc;
+                        if (!file_crc32(remote_path, romfs_flash_buffer, romfs_info.info.vers, &remote_crc)) {
+                            fprintf(stderr, "Cannot verify %s\n", remote_path);
+                        } else if (remote_crc != local_crc) {
+                            fprintf(stderr, "Verify failed: CRC %08X, expected %08X\n", remote_crc, local_crc);
+                        } else {
+                            printf("Verify OK, CRC %08X\n", local_crc);
+                            retval = 0;
+                        }
                     } else {
                         retval = 0;
                     }
@@ -749,6 +1559,102 @@ int main(int argc, char *argv[])
 
                 fclose(inf);
                 free(remote_path);
+            } else if (!strcmp(argv[1], "sync")) {
+                struct push_options opts;
+
+                int argi = push_options_parse(argc, argv, &opts);
+
+                if (argi >= argc) {
+                    fprintf(stderr, "Usage: %s sync [options] <local filename> [<remote path>]\n", argv[0]);
+                    goto err_io;
+                }
+
+                const char *local_path = argv[argi++];
+
+                FILE *inf = fopen(local_path, "rb");
+                if (!inf) {
+                    fprintf(stderr, "Cannot open file %s\n", local_path);
+                    goto err_io;
+                }
+                fseek(inf, 0, SEEK_END);
+                long file_size = ftell(inf);
+                fseek(inf, 0, SEEK_SET);
+                uint8_t *data = malloc(file_size ? file_size : 1);
+                if (!data || fread(data, 1, file_size, inf) != (size_t)file_size) {
+                    fprintf(stderr, "Cannot read file %s\n", local_path);
+                    free(data);
+                    fclose(inf);
+                    goto err_io;
+                }
+                fclose(inf);
+
+                if ((opts.fix_endian && file_size >= 4 && !rom_fix_byte_order(data, file_size, &opts.rom_type)) ||
+                    (opts.fix_pi_freq && file_size >= 4 && !rom_fix_pi_freq(data, opts.pi_freq))) {
+                    free(data);
+                    goto err_io;
+                }
+
+                char *remote_path = push_remote_path(local_path, (argi < argc) ? argv[argi] : NULL, romfs_is_dir);
+                char *temp_path = remote_path ? sync_temp_path(remote_path) : NULL;
+                if (!temp_path) {
+                    fprintf(stderr, "Out of memory creating remote path\n");
+                    free(remote_path);
+                    free(data);
+                    goto err_io;
+                }
+
+                romfs_file file;
+                uint32_t updated = 0;
+                bool synced = false;
+                if (romfs_open_path(remote_path, &file, romfs_flash_buffer) == ROMFS_NOERR && file.entry.size == (uint32_t)file_size) {
+                    synced = sync_sectors(&file, data, file_size, romfs_info.info.vers, &updated);
+                    romfs_close_file(&file);
+                    if (synced) {
+                        printf("%u of %u sectors updated\n", updated, (uint32_t)((file_size + ROMFS_FLASH_SECTOR - 1) / ROMFS_FLASH_SECTOR));
+                    }
+                } else {
+                    // sectors can only be replaced in place, a new or resized file is written in full
+                    // under a temporary name, the old one goes only once the new copy is complete
+                    printf("%s is missing or has a different size, writing the whole file\n", remote_path);
+                    romfs_delete_path(temp_path);
+                    synced = romfs_create_path(temp_path, &file, ROMFS_MODE_READWRITE, ROMFS_TYPE_MISC, romfs_flash_buffer, true) == ROMFS_NOERR &&
+                             romfs_write_file(data, file_size, &file) == (uint32_t)file_size &&
+                             romfs_close_file(&file) == ROMFS_NOERR;
+                    if (!synced) {
+                        fprintf(stderr, "romfs error writing %s: %s\n", temp_path, romfs_strerror(file.err));
+                        romfs_delete_path(temp_path);
+                    } else {
+                        uint32_t err = romfs_delete_path(remote_path);
+                        if (err == ROMFS_NOERR || err == ROMFS_ERR_NO_ENTRY) {
+                            err = romfs_rename_path(temp_path, remote_path, false);
+                        }
+                        if (err != ROMFS_NOERR) {
+                            fprintf(stderr, "romfs error replacing %s with %s: %s\n", remote_path, temp_path, romfs_strerror(err));
+                            synced = false;
+                        }
+                    }
+                }
+
+                if (synced && opts.verify) {
+                    uint32_t remote_crc;
+                    uint32_t local_crc = cart_crc32(0, data, file_size);
+                    if (!file_crc32(remote_path, romfs_flash_buffer, romfs_info.info.vers, &remote_crc)) {
+                        fprintf(stderr, "Cannot verify %s\n", remote_path);
+                        synced = false;
+                    } else if (remote_crc != local_crc) {
+                        fprintf(stderr, "Verify failed: CRC %08X, expected %08X\n", remote_crc, local_crc);
+                        synced = false;
+                    } else {
+                        printf("Verify OK, CRC %08X\n", local_crc);
+                    }
+                }
+
+                if (synced) {
+                    retval = 0;
+                }
+                free(temp_path);
+                free(remote_path);
+                free(data);
             } else if (!strcmp(argv[1], "pull")) {
                 if (argc < 3) {
                     fprintf(stderr, "Usage: %s pull <remote path> [<local filename>]\n", argv[0]);
@@ -760,7 +1666,7 @@ int main(int argc, char *argv[])
                 if (romfs_open_path(remote_path, &file, romfs_flash_buffer) == ROMFS_NOERR) {
                     FILE *outf = fopen(local_path, "wb");
                     if (outf) {
-                        uint8_t buffer[4096];
+                        static uint8_t buffer[ROMFS_FLASH_SECTOR * 64];
                         int ret;
                         printf("\n");
                         while ((ret = romfs_read_file(buffer, sizeof(buffer), &file)) > 0) {
@@ -788,6 +1694,17 @@ int main(int argc, char *argv[])
             }
 
         err_io:
+            romfs_get_write_stats(&write_stats);
+            if (write_stats.written || write_stats.unchanged || write_stats.blank) {
+                printf("flash sectors     : %u written, %u unchanged, %u blank\n", write_stats.written, write_stats.unchanged, write_stats.blank);
+            }
+            if (lz_sectors) {
+                printf("compressed writes : %u sectors in %u bytes\n", lz_sectors, lz_bytes);
+            }
+            if (!flash_wait_idle(romfs_info.info.vers)) {
+                fprintf(stderr, "flash jobs did not complete, error!\n");
+                retval = 1;
+            }
             if (!send_usb_cmd(FLASH_QUAD_MODE, NULL)) {
                 fprintf(stderr, "cannot switch flash to quad mode, error!\n");
                 retval = 1;
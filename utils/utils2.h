@@ -18,9 +18,47 @@
 #define FLASH_QUAD_MODE 0x234D
 #define BOOTLOADER_MODE 0x234E
 #define CART_REBOOT 0x234F
+#define CART_COPY_SEC 0x2350
+#define CART_PI_STATS 0x2351
+#define CART_WRITE_SECS 0x2352
+#define CART_READ_SECS 0x2353
+#define CART_READ_RANGE 0x2354
+#define CART_ERASE_BLOCK 0x2355
+#define CART_FLASH_STATUS 0x2356
+#define CART_CRC_RANGE 0x2357
+#define CART_CRC_SECTORS 0x2358
+#define CART_WRITE_LZ 0x2359
+#define CART_FILE_RPC 0x235A
+
+/* First firmware version that understands CART_COPY_SEC */
+#define CART_COPY_SEC_VERSION 0x010d
+/* First firmware version that understands CART_PI_STATS */
+#define CART_PI_STATS_VERSION 0x010e
+/* First firmware version with the streaming v2 commands CART_WRITE_SECS and CART_READ_SECS */
+#define CART_V2_VERSION 0x010f
+/* First firmware version that understands CART_READ_RANGE */
+#define CART_READ_RANGE_VERSION 0x0110
+/*
+ * First firmware version that runs erase and program in the background,
+ * with CART_ERASE_BLOCK (64K aligned) and CART_FLASH_STATUS. ACK_BUSY
+ * means the job queue is full or still running, poll CART_FLASH_STATUS.
+ * Every page is read back after it is written or erased. A mismatch
+ * makes the next idle CART_FLASH_STATUS, or the final ack of a
+ * CART_WRITE_SECS / CART_WRITE_LZ stream, return ACK_ERROR.
+ */
+#define CART_FLASH_JOBS_VERSION 0x0111
+/* First firmware version that understands CART_CRC_RANGE */
+#define CART_CRC_RANGE_VERSION 0x0112
+/* First firmware version that understands CART_CRC_SECTORS */
+#define CART_CRC_SECTORS_VERSION 0x0113
+/* First firmware version that understands CART_WRITE_LZ */
+#define CART_WRITE_LZ_VERSION 0x0114
+/* First firmware version that understands CART_FILE_RPC, the menu still answers it with ACK_ERROR */
+#define CART_FILE_RPC_VERSION 0x0115
 
 #define ACK_NOERROR 0x5432
 #define ACK_ERROR 0x5433
+#define ACK_BUSY 0x5434
 
 struct __attribute__((__packed__)) cart_info {
     uint32_t start;
@@ -33,7 +71,139 @@ struct __attribute__((__packed__)) req_header {
     uint32_t offset;
 };
 
+struct __attribute__((__packed__)) req_copy_header {
+    uint16_t type;
+    uint32_t offset;
+    uint32_t src_offset;
+};
+
+/*
+ * v2 transfer of count sectors from offset. The data follows the request
+ * (CART_WRITE_SECS) or is returned (CART_READ_SECS) as one bulk transfer
+ * of 64-byte packets, then a single ack_header reports the result.
+ * CART_READ_RANGE takes count in bytes, offset need not be aligned, and
+ * ends the stream with a range_ack instead.
+ */
+struct __attribute__((__packed__)) req_range_header {
+    uint16_t type;
+    uint32_t offset;
+    uint32_t count;
+};
+
 struct __attribute__((__packed__)) ack_header {
     uint16_t type;
     struct cart_info info;
 };
+
+/*
+ * CART_CRC_RANGE hashes count bytes of flash from offset on the cart and
+ * replies with a range_ack. crc is the value to continue from, 0 to start,
+ * so long ranges and romfs sector chains are sent as several requests.
+ */
+#define CART_CRC_RANGE_MAX (1024 * 1024)
+
+struct __attribute__((__packed__)) req_crc_header {
+    uint16_t type;
+    uint32_t offset;
+    uint32_t count;
+    uint32_t crc;
+};
+
+/*
+ * CART_CRC_SECTORS takes a req_range_header with count in sectors and
+ * streams back one little-endian CRC-32 per sector, ended by a range_ack
+ * like CART_READ_RANGE.
+ */
+#define CART_CRC_SECTORS_MAX 256
+
+/*
+ * CART_WRITE_LZ programs count sectors from offset like CART_WRITE_SECS,
+ * each sector sent as a cart_lz_record() (see cart_lz.h). length is the
+ * size of the record stream, zero padded to whole 64-byte packets.
+ */
+struct __attribute__((__packed__)) req_lz_header {
+    uint16_t type;
+    uint32_t offset;
+    uint32_t count;
+    uint32_t length;
+};
+
+/*
+ * CART_FILE_RPC runs romfs metadata requests on the cart, file data goes
+ * through the sector requests. length bytes of payload follow the request
+ * as one bulk transfer, the cart answers with a file_ack and then streams
+ * ack.length bytes of reply data. Paths are sent without the terminating
+ * zero, numbers are little-endian.
+ */
+enum {
+    FILE_RPC_FREE = 0,  /* result: free bytes */
+    FILE_RPC_LIST = 5,  /* arg: cursor, payload: dir path, reply: file_entry list, result: next cursor or 0 */
+    FILE_RPC_RENAME = 7,        /* arg: FILE_RPC_CREATE_DIRS, payload: source path, zero, destination path */
+    FILE_RPC_DELETE,    /* payload: path */
+    FILE_RPC_MKDIR,     /* payload: path, parents are created too */
+    FILE_RPC_RMDIR,     /* payload: path */
+};
+
+#define FILE_RPC_CREATE_DIRS 0x100
+
+/* payload and reply size limit */
+#define CART_FILE_IO_MAX 4096
+
+struct __attribute__((__packed__)) req_file_header {
+    uint16_t type;
+    uint16_t op;
+    uint32_t arg;
+    uint32_t length;
+};
+
+/* err is a romfs error code */
+struct __attribute__((__packed__)) file_ack {
+    uint16_t type;
+    uint32_t err;
+    uint32_t result;
+    uint32_t length;
+};
+
+/* FILE_RPC_LIST record, one USB packet each */
+struct __attribute__((__packed__)) file_entry {
+    char name[54];
+    uint8_t mode;
+    uint8_t type;
+    uint32_t size;
+    uint32_t reserved;
+};
+
+/* CART_READ_RANGE trailer, crc is the CRC-32 of the streamed bytes */
+struct __attribute__((__packed__)) range_ack {
+    uint16_t type;
+    uint32_t length;
+    uint32_t crc;
+};
+
+/* CRC-32 (IEEE 802.3), pass 0 to start and the previous result to continue */
+static inline uint32_t cart_crc32(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    static const uint32_t nibble[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        crc = (crc >> 4) ^ nibble[crc & 0x0f];
+        crc = (crc >> 4) ^ nibble[crc & 0x0f];
+    }
+
+    return ~crc;
+}
+
+/* CART_PI_STATS reply, a non-zero request offset clears the counters after reading */
+struct __attribute__((__packed__)) pi_stats_ack {
+    uint16_t type;
+    uint32_t rom_words;
+    uint32_t sram_accesses;
+    uint32_t fram_accesses;
+    uint32_t unknown_hits;
+    uint32_t max_wait;
+};